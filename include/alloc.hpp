@@ -0,0 +1,164 @@
+#pragma once
+/*
+ * allocation counting. replaces the global operator new and delete, so it must be included by exactly one translation unit.
+ * every thread counts into its own cache line, allocations() adds them up. allocations made inside dpp's and opencv's
+ * DLLs use their own heap and are not seen, anything inlined from their headers is.
+ * with alloc_attribution on, an allocation_scope also charges what its thread allocates to itself, which the
+ * ledger adds up per command and checks against that command's budget.
+ * e.g. allocation_scope scope{}; handler(); ledger.charge(ledger.of("lvl"), scope.total());
+ */
+#include <new>
+#include <atomic>
+#include <array>
+#include <cstdlib>
+#include <string>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <format>
+#include <utility>
+
+struct allocation_count {
+	uint64_t count{}, bytes{};
+};
+
+namespace alloc_detail {
+	struct alignas(64) slot {
+		std::atomic<uint64_t> count{}, bytes{};
+	};
+	/* threads past the last slot share it */
+	inline std::array<slot, 256> slots{};
+	inline std::atomic<size_t> used{};
+	/* plain pointers, so looking them up never allocates or registers a destructor from inside operator new */
+	inline thread_local slot* mine = nullptr;
+	inline thread_local allocation_count* scope = nullptr;
+
+	inline void count(size_t size) {
+		if (not mine) mine = &slots[std::min(used.fetch_add(1, std::memory_order_relaxed), slots.size() - 1)];
+		mine->count.fetch_add(1, std::memory_order_relaxed);
+		mine->bytes.fetch_add(size, std::memory_order_relaxed);
+		if (scope) {
+			scope->count++;
+			scope->bytes += size;
+		}
+	}
+}
+
+/* off by default, scopes opened while it is off count nothing and cost nothing */
+inline std::atomic<bool> alloc_attribution = false;
+
+/* allocations since startup, every thread. subtract two samples to count a stretch of work */
+inline allocation_count allocations() {
+	allocation_count total{};
+	size_t n = std::min(alloc_detail::used.load(std::memory_order_relaxed), alloc_detail::slots.size());
+	for (size_t i = 0; i < n; i++) {
+		total.count += alloc_detail::slots[i].count.load(std::memory_order_relaxed);
+		total.bytes += alloc_detail::slots[i].bytes.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+void* operator new(std::size_t size) {
+	alloc_detail::count(size);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+/* what the calling thread allocates from construction to destruction. an outer scope also counts its inner ones */
+class allocation_scope {
+	allocation_count own{};
+	allocation_count* previous = nullptr;
+	bool on = alloc_attribution.load(std::memory_order_relaxed);
+public:
+	allocation_scope() {
+		if (this->on) this->previous = std::exchange(alloc_detail::scope, &this->own);
+	}
+	allocation_scope(const allocation_scope&) = delete;
+	allocation_scope& operator=(const allocation_scope&) = delete;
+	~allocation_scope() {
+		if (not this->on) return;
+		alloc_detail::scope = this->previous;
+		if (this->previous) {
+			this->previous->count += this->own.count;
+			this->previous->bytes += this->own.bytes;
+		}
+	}
+	allocation_count total() const {
+		return this->own;
+	}
+};
+
+/* allocations per command over every handler run, and the runs that went past the command's budget */
+class allocation_ledger {
+public:
+	struct entry {
+		allocation_count budget{}; /* per run, 0 for no limit */
+		std::atomic<uint64_t> runs{}, count{}, bytes{}, max_count{}, max_bytes{}, over{};
+	};
+private:
+	std::mutex lock{};
+	std::map<std::string, std::unique_ptr<entry>, std::less<>> entries{};
+public:
+	/* the entry for a command, created on first use. the reference stays valid */
+	entry& of(std::string_view command) {
+		std::lock_guard<std::mutex> g(this->lock);
+		auto it = this->entries.find(command);
+		if (it == this->entries.end()) it = this->entries.emplace(std::string(command), std::make_unique<entry>()).first;
+		return *it->second;
+	}
+	/* set before traffic starts, the limit itself isn't synchronized */
+	void budget(std::string_view command, allocation_count limit) {
+		this->of(command).budget = limit;
+	}
+	/* adds one run, true if it went over its budget */
+	bool charge(entry& e, allocation_count run) {
+		e.runs.fetch_add(1, std::memory_order_relaxed);
+		e.count.fetch_add(run.count, std::memory_order_relaxed);
+		e.bytes.fetch_add(run.bytes, std::memory_order_relaxed);
+		for (uint64_t seen = e.max_count.load(std::memory_order_relaxed); run.count > seen and not e.max_count.compare_exchange_weak(seen, run.count););
+		for (uint64_t seen = e.max_bytes.load(std::memory_order_relaxed); run.bytes > seen and not e.max_bytes.compare_exchange_weak(seen, run.bytes););
+		bool over = (e.budget.count and run.count > e.budget.count) or (e.budget.bytes and run.bytes > e.budget.bytes);
+		if (over) e.over.fetch_add(1, std::memory_order_relaxed);
+		return over;
+	}
+	template<typename F> void each(F fn) {
+		std::lock_guard<std::mutex> g(this->lock);
+		for (const auto& [command, e] : this->entries) fn(command, *e);
+	}
+	/* runs past their budget, every command */
+	uint64_t over() {
+		uint64_t total = 0;
+		this->each([&total](std::string_view, const entry& e) { total += e.over.load(std::memory_order_relaxed); });
+		return total;
+	}
+	/* one line per command that ran, e.g. for a benchmark's summary */
+	std::vector<std::string> report() {
+		std::vector<std::string> lines{};
+		this->each([&lines](std::string_view command, const entry& e)
+			{
+				uint64_t runs = e.runs.load(std::memory_order_relaxed);
+				if (not runs) return;
+				lines.emplace_back(std::format("{0}: {1} runs, {2:.1f} allocations/run ({3} max, budget {4}), {5:.0f} bytes/run ({6} max, budget {7}), {8} over budget",
+					command, runs, static_cast<double>(e.count.load(std::memory_order_relaxed)) / runs, e.max_count.load(std::memory_order_relaxed),
+					e.budget.count ? std::to_string(e.budget.count) : std::string("none"), static_cast<double>(e.bytes.load(std::memory_order_relaxed)) / runs,
+					e.max_bytes.load(std::memory_order_relaxed), e.budget.bytes ? std::to_string(e.budget.bytes) : std::string("none"), e.over.load(std::memory_order_relaxed)));
+			});
+		return lines;
+	}
+};
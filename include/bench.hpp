@@ -0,0 +1,38 @@
+#pragma once
+/*
+ * offline benchmarks. e.g. neko.exe --bench decode --input gateway.log
+ * results go to stdout and nothing here touches the network. each module's bench is in its own header, e.g. market_bench.hpp
+ */
+#include <features.hpp> // option()
+#include <decode_bench.hpp>
+#include <lanes_bench.hpp>
+#include <voice_bench.hpp>
+#include <record_bench.hpp>
+#include <random_bench.hpp>
+#include <duration_bench.hpp>
+#include <poll_bench.hpp>
+#include <ecs_bench.hpp>
+#include <tick_bench.hpp>
+#include <combat_bench.hpp>
+#include <loot_bench.hpp>
+#include <market_bench.hpp>
+
+/* --bench <name> dispatch, returns the process exit code */
+inline int bench(int argc, char* argv[], std::string_view name) {
+	if (name == "decode") return decode_bench(std::string(option(argc, argv, "--input")));
+	if (name == "lanes") return lanes_bench(1'000'000, 10'000, 1.1);
+	if (name == "fairness") return fairness_bench(100'000, 100);
+	if (name == "mix") return mix_bench({ 1, 2, 4, 8, 16 });
+	if (name == "record") return record_bench({ 1, 100, 500 });
+	if (name == "duration") return duration_bench(1'000'000);
+	if (name == "poll") return poll_bench({ 1, 2, 4, 8 }, 100'000);
+	if (name == "ecs") return ecs_bench(1'000'000, 20);
+	if (name == "tick") return tick_bench(10'000, 100, 0.05, std::chrono::seconds(5));
+	if (name == "combat") return combat_bench(1000, 200, 256, 50);
+	if (name == "loot") return loot_bench(5000, 100'000);
+	if (name == "market") return market_bench(1'000'000, 8);
+	if (name == "random") return random_bench({ 6, 1000, 1ull << 40, (1ull << 63) + 1 });
+	if (name == "voice") return voice_bench(option(argc, argv, "--clip"), { 1, 100, 300, 1000 }, std::chrono::seconds(10));
+	std::cout << std::format("unknown benchmark: {0}", name) << std::endl;
+	return 1;
+}
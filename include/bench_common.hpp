@@ -0,0 +1,68 @@
+#pragma once
+/*
+ * helpers shared by the --bench headers: timing, skewed guild ids and the checks every bench reports last
+ */
+#include <stats.hpp>
+#include <random>
+#include <cmath>
+#include <iostream>
+#include <format>
+#include <atomic>
+#include <string_view>
+
+/* cpu nanoseconds per item, repeating the whole set until at least 1s of cpu time was spent */
+template<typename T, typename F> double cpu_per_item(const std::vector<T>& items, F fn) {
+	uint64_t start = thread_cpu(), spent = 0, done = 0;
+	do {
+		for (const T& item : items) fn(item);
+		done += items.size();
+	} while ((spent = thread_cpu() - start) < 1'000'000'000 and not items.empty());
+	return (done) ? static_cast<double>(spent) / done : 0.0;
+}
+
+/* guild ids drawn from zipf(s) over n guilds, the shape of real traffic where a few big guilds get most events */
+inline std::vector<dpp::snowflake> zipf_guilds(size_t count, size_t guilds, double s, uint64_t seed = 1) {
+	std::vector<double> cdf(guilds);
+	double sum = 0.0;
+	for (size_t i = 0; i < guilds; i++) cdf[i] = (sum += 1.0 / std::pow(static_cast<double>(i + 1), s));
+	std::mt19937_64 engine(seed);
+	std::uniform_real_distribution<double> uniform(0.0, sum);
+	std::vector<dpp::snowflake> out{};
+	out.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		size_t g = std::ranges::lower_bound(cdf, uniform(engine)) - cdf.begin();
+		out.emplace_back(static_cast<uint64_t>(std::min(g, guilds - 1) + 1) << 22);
+	}
+	return out;
+}
+
+/* stand-in for handler work that does not touch guild state */
+inline uint64_t busy(uint64_t x, int rounds = 200) {
+	for (int i = 0; i < rounds; i++) x = x * 6364136223846793005ull + 1442695040888963407ull;
+	return x;
+}
+
+/*
+ * a bench's correctness checks, counted apart from its timings and reported last. safe to use from worker threads
+ * e.g. bench_checks checks{}; checks.expect(counts == expected, "poll counts"); return checks.report();
+ */
+class bench_checks {
+	std::atomic<size_t> failed = 0;
+public:
+	/* counts a failure if not ok, printing the first few with what failed and on which input */
+	bool expect(bool ok, std::string_view what, std::string_view input = {}) {
+		if (not ok and failed++ < 10) std::cout << (input.empty() ? std::format("failed: {0}\n", what) : std::format("failed: {0}: \"{1}\"\n", what, input));
+		return ok;
+	}
+	/* failures a component counted itself, e.g. a recorder's write failures */
+	void add(size_t n, std::string_view what) {
+		if (n) std::cout << std::format("failed: {0} {1}\n", n, what);
+		failed += n;
+	}
+	size_t failures() const { return failed; }
+	/* prints the total, returns the process exit code */
+	int report() const {
+		std::cout << std::format("{0} failures", failed.load()) << std::endl;
+		return failed ? 1 : 0;
+	}
+};
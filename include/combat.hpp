@@ -0,0 +1,229 @@
+#pragma once
+/*
+ * raid combat. a click doesn't resolve anything, it queues an action on its encounter; once a tick the encounter resolves
+ * every queued action in one pass, reading each fighter's stats (attack, crit chance and multiplier, armor penetration)
+ * from structure-of-arrays columns, eight actions at a time with avx2 where that's fastest here, and hands back one
+ * summary of the tick to post instead of a message per hit. rolls come from the encounter's own seeded xoshiro256**,
+ * so a fight replays exactly.
+ * e.g. encounter boss(seed, 1'000'000, 400); boss.join(user, { 120, 0.2f, 2.0f, 50 }); boss.act(user, 1.5f); post(boss.resolve().to_string());
+ */
+#include <cpu.hpp>
+#include <random.hpp>
+#include <immintrin.h>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <bit>
+
+/* a fighter's stats, from their gear and buffs when they join */
+struct fighter {
+	float attack{}, crit_chance{}, crit_multiplier = 1.5f, penetration{};
+};
+
+/* how an encounter resolves its actions */
+enum combat_kernel : uint8_t {
+	ck_scalar, ck_avx2
+};
+inline constexpr std::string_view combat_kernel_names[] = { "scalar", "avx2" };
+
+namespace combat_detail {
+	/* damage kept behind armor is armor_scale / (armor_scale + armor), so 400 armor halves it */
+	inline constexpr float armor_scale = 400.0f;
+	/* 2^-24, turns the top 24 bits of a roll into [0, 1) */
+	inline constexpr float unit = 1.0f / 16777216.0f;
+	/* fighter columns, indexed by row */
+	struct columns {
+		const float* attack, * crit_chance, * crit_multiplier, * penetration;
+	};
+	/* damage of each of n actions into out, returns how many crit */
+	using kernel = uint32_t(*)(const columns& c, const uint32_t* rows, const float* power, const uint32_t* rolls, size_t n, float armor, float* out);
+
+	inline uint32_t resolve_scalar(const columns& c, const uint32_t* rows, const float* power, const uint32_t* rolls, size_t n, float armor, float* out) {
+		uint32_t crits = 0;
+		for (size_t i = 0; i < n; i++) {
+			uint32_t r = rows[i];
+			bool crit = static_cast<float>(rolls[i] >> 8) * unit < c.crit_chance[r];
+			float dealt = c.attack[r] * power[i] * (crit ? c.crit_multiplier[r] : 1.0f);
+			out[i] = dealt * (armor_scale / (armor_scale + std::max(armor - c.penetration[r], 0.0f)));
+			crits += crit;
+		}
+		return crits;
+	}
+	/* the same arithmetic in the same order as resolve_scalar, so both give the same numbers */
+	inline uint32_t resolve_avx2(const columns& c, const uint32_t* rows, const float* power, const uint32_t* rolls, size_t n, float armor, float* out) {
+		const __m256 scale = _mm256_set1_ps(armor_scale), to_unit = _mm256_set1_ps(unit), one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps(), a = _mm256_set1_ps(armor);
+		uint32_t crits = 0;
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + i));
+			__m256 attack = _mm256_i32gather_ps(c.attack, r, 4), chance = _mm256_i32gather_ps(c.crit_chance, r, 4);
+			__m256 multiplier = _mm256_i32gather_ps(c.crit_multiplier, r, 4), penetration = _mm256_i32gather_ps(c.penetration, r, 4);
+			__m256 roll = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(rolls + i)), 8)), to_unit);
+			__m256 crit = _mm256_cmp_ps(roll, chance, _CMP_LT_OQ);
+			__m256 dealt = _mm256_mul_ps(_mm256_mul_ps(attack, _mm256_loadu_ps(power + i)), _mm256_blendv_ps(one, multiplier, crit));
+			__m256 kept = _mm256_div_ps(scale, _mm256_add_ps(scale, _mm256_max_ps(_mm256_sub_ps(a, penetration), zero)));
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(dealt, kept));
+			crits += std::popcount(static_cast<uint32_t>(_mm256_movemask_ps(crit)));
+		}
+		return crits + resolve_scalar(c, rows + i, power + i, rolls + i, n - i, armor, out + i);
+	}
+	inline kernel of(combat_kernel k) {
+		return (k == ck_avx2) ? &resolve_avx2 : &resolve_scalar;
+	}
+	/* whether k runs on this CPU */
+	inline bool available(combat_kernel k) {
+		return k == ck_scalar or detect_cpu().avx2;
+	}
+	/* like the mixer, measured rather than assumed: gathers are slow enough on some CPUs that the plain loop wins */
+	inline combat_kernel fastest() {
+		constexpr size_t fighters = 256, actions = 4096;
+		std::vector<float> stat(fighters, 0.5f), power(actions, 1.0f), out(actions);
+		std::vector<uint32_t> rows(actions), rolls(actions);
+		for (size_t i = 0; i < actions; i++) rows[i] = static_cast<uint32_t>(i * 97 % fighters);
+		columns c{ stat.data(), stat.data(), stat.data(), stat.data() };
+		combat_kernel best = ck_scalar;
+		std::chrono::nanoseconds best_time = std::chrono::nanoseconds::max();
+		for (combat_kernel candidate : { ck_scalar, ck_avx2 }) {
+			if (not available(candidate)) continue;
+			kernel k = of(candidate);
+			for (int round = 0; round < 5; round++) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int i = 0; i < 20; i++) k(c, rows.data(), power.data(), rolls.data(), actions, 100.0f, out.data());
+				std::chrono::nanoseconds took = std::chrono::steady_clock::now() - start;
+				if (took < best_time) {
+					best = candidate;
+					best_time = took;
+				}
+			}
+		}
+		return best;
+	}
+}
+
+/* what one tick of an encounter did, posted as one message */
+struct combat_summary {
+	uint64_t tick{};
+	size_t actions{};
+	uint32_t crits{};
+	double damage{}, hp{}, max_hp{};
+	bool defeated = false;
+	std::vector<std::pair<uint64_t, float>> top{}; /* this tick's biggest hitters, most damage first */
+
+	std::string to_string() const {
+		std::string out = std::format("> **{0}** attacks, **{1}** crits, **{2:.0f}** damage. ", this->actions, this->crits, this->damage);
+		out += (this->defeated) ? "The boss is down!" : std::format("Boss at **{0:.1f}%**", (this->max_hp > 0) ? 100.0 * this->hp / this->max_hp : 0.0);
+		for (size_t i = 0; i < this->top.size(); i++) out += std::format("{0}<@{1}> {2:.0f}", (i) ? ", " : "\nTop: ", this->top[i].first, this->top[i].second);
+		return out;
+	}
+};
+
+/* one boss and everyone fighting it. not thread safe, it lives on its guild's lane */
+class encounter {
+	std::unordered_map<uint64_t, uint32_t> rows{};
+	std::vector<uint64_t> users{};
+	std::vector<float> attack{}, crit_chance{}, crit_multiplier{}, penetration{};
+	std::vector<double> dealt{}; /* whole fight, per row */
+	std::vector<float> this_tick{}; /* per row, only rows in touched are non zero */
+	std::vector<uint64_t> touched_at{}; /* per row, the tick it last went into touched */
+	std::vector<uint32_t> touched{};
+	/* this tick's actions */
+	std::vector<uint32_t> queued{};
+	std::vector<float> power{};
+	/* resolve() scratch, kept to not allocate every tick */
+	std::vector<uint64_t> bits{};
+	std::vector<uint32_t> rolls{};
+	std::vector<float> damage{};
+	xoshiro256 rng;
+	combat_detail::kernel fn;
+public:
+	const double max_hp;
+	double hp;
+	float armor;
+	uint64_t tick{};
+	const combat_kernel kernel;
+
+	/* @param kernel by default the fastest here, measured once per process */
+	encounter(uint64_t seed, double hp, float armor, combat_kernel kernel = chosen()) : rng(seed), fn(combat_detail::of(kernel)), max_hp(hp), hp(hp), armor(armor), kernel(kernel) {}
+	static combat_kernel chosen() {
+		static const combat_kernel once = combat_detail::fastest();
+		return once;
+	}
+	/* adds user, or updates their stats if they're already in */
+	void join(uint64_t user, fighter f) {
+		auto [it, fresh] = this->rows.try_emplace(user, static_cast<uint32_t>(this->users.size()));
+		if (fresh) {
+			this->users.push_back(user);
+			for (std::vector<float>* column : { &this->attack, &this->crit_chance, &this->crit_multiplier, &this->penetration, &this->this_tick }) column->push_back(0.0f);
+			this->dealt.push_back(0.0);
+			this->touched_at.push_back(0);
+		}
+		uint32_t r = it->second;
+		this->attack[r] = f.attack;
+		this->crit_chance[r] = f.crit_chance;
+		this->crit_multiplier[r] = f.crit_multiplier;
+		this->penetration[r] = f.penetration;
+	}
+	/* queues an attack of power times user's attack for the next resolve(). false if they haven't joined or it's over */
+	bool act(uint64_t user, float power = 1.0f) {
+		auto it = this->rows.find(user);
+		if (it == this->rows.end() or this->hp <= 0.0) return false;
+		this->queued.push_back(it->second);
+		this->power.push_back(power);
+		return true;
+	}
+	size_t pending() const {
+		return this->queued.size();
+	}
+	size_t fighters() const {
+		return this->users.size();
+	}
+	/* resolves every queued action, every hit of the tick lands even past the killing one */
+	combat_summary resolve(size_t top = 3) {
+		combat_summary s{ ++this->tick, this->queued.size() };
+		size_t n = this->queued.size();
+		if (n) {
+			this->bits.resize((n + 1) / 2);
+			this->rng.fill(this->bits);
+			this->rolls.resize(n);
+			std::memcpy(this->rolls.data(), this->bits.data(), n * sizeof(uint32_t));
+			this->damage.resize(n);
+			combat_detail::columns c{ this->attack.data(), this->crit_chance.data(), this->crit_multiplier.data(), this->penetration.data() };
+			s.crits = this->fn(c, this->queued.data(), this->power.data(), this->rolls.data(), n, this->armor, this->damage.data());
+			for (size_t i = 0; i < n; i++) {
+				uint32_t r = this->queued[i];
+				if (this->touched_at[r] not_eq s.tick) {
+					this->touched_at[r] = s.tick;
+					this->touched.push_back(r);
+				}
+				this->this_tick[r] += this->damage[i];
+				this->dealt[r] += this->damage[i];
+				s.damage += this->damage[i];
+			}
+			std::partial_sort(this->touched.begin(), this->touched.begin() + std::min(top, this->touched.size()), this->touched.end(),
+				[this](uint32_t a, uint32_t b) { return this->this_tick[a] > this->this_tick[b]; });
+			for (size_t i = 0; i < std::min(top, this->touched.size()); i++) s.top.emplace_back(this->users[this->touched[i]], this->this_tick[this->touched[i]]);
+			for (uint32_t r : this->touched) this->this_tick[r] = 0.0f;
+			this->touched.clear();
+			this->queued.clear();
+			this->power.clear();
+		}
+		bool alive = this->hp > 0.0;
+		this->hp = std::max(this->hp - s.damage, 0.0);
+		s.hp = this->hp;
+		s.max_hp = this->max_hp;
+		s.defeated = alive and this->hp <= 0.0;
+		return s;
+	}
+	/* the fight's n biggest hitters so far */
+	std::vector<std::pair<uint64_t, double>> leaderboard(size_t n) const {
+		std::vector<std::pair<uint64_t, double>> out{};
+		for (size_t r = 0; r < this->users.size(); r++) out.emplace_back(this->users[r], this->dealt[r]);
+		std::partial_sort(out.begin(), out.begin() + std::min(n, out.size()), out.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+		out.resize(std::min(n, out.size()));
+		return out;
+	}
+};
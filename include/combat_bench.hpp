@@ -0,0 +1,75 @@
+#pragma once
+/*
+ * raids resolved one action at a time against batched. e.g. neko.exe --bench combat
+ */
+#include <bench_common.hpp>
+#include <combat.hpp>
+#include <random.hpp>
+
+/*
+ * many raids at once, each getting a burst of attacks every tick: resolved one at a time as they come in with a message
+ * each, then batched per encounter with every kernel the CPU has. the batched kernels must agree to the bit
+ */
+inline int combat_bench(size_t encounters, size_t fighters, size_t per_tick, size_t ticks) {
+	std::vector<uint64_t> attackers(per_tick * ticks);
+	std::vector<float> powers(attackers.size());
+	xoshiro256 rng(1);
+	for (size_t i = 0; i < attackers.size(); i++) {
+		attackers[i] = 1 + bounded(rng, fighters);
+		powers[i] = 1.0f + static_cast<float>(bounded(rng, 3));
+	}
+	auto stats = [](uint64_t user) { return fighter{ 80.0f + user % 40, 0.05f + (user % 7) * 0.05f, 1.5f + (user % 3) * 0.25f, static_cast<float>(user % 5) * 20.0f }; };
+	auto rate = [&](std::chrono::steady_clock::time_point start) { return encounters * per_tick * ticks / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+	/* the first thing anyone would write: look the fighter up, roll, post */
+	{
+		std::vector<std::unordered_map<uint64_t, fighter>> raids(encounters);
+		std::vector<double> hp(encounters, 1e12);
+		for (auto& raid : raids) for (uint64_t u = 1; u <= fighters; u++) raid[u] = stats(u);
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> roll(0.0f, 1.0f);
+		size_t messages = 0, bytes = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t t = 0; t < ticks; t++)
+			for (size_t e = 0; e < encounters; e++)
+				for (size_t i = t * per_tick; i < (t + 1) * per_tick; i++) {
+					const fighter& f = raids[e].at(attackers[i]);
+					bool crit = roll(random) < f.crit_chance;
+					double damage = f.attack * powers[i] * (crit ? f.crit_multiplier : 1.0f) * (400.0f / (400.0f + std::max(400.0f - f.penetration, 0.0f)));
+					hp[e] -= damage;
+					std::string m = std::format("> <@{0}> hit for **{1:.0f}**{2}", attackers[i], damage, (crit) ? " (crit!)" : "");
+					messages++;
+					bytes += m.size();
+				}
+		std::cout << std::format("one at a time: {0:.2f} M actions/s, {1} messages ({2} per encounter-tick)\n", rate(start) / 1e6, messages, messages / (encounters * ticks));
+	}
+	std::vector<std::vector<combat_summary>> results{};
+	for (combat_kernel kernel : { ck_scalar, ck_avx2 }) {
+		if (not combat_detail::available(kernel)) continue;
+		std::vector<encounter> raids{};
+		raids.reserve(encounters);
+		for (size_t e = 0; e < encounters; e++) {
+			raids.emplace_back(e + 1, 1e12, 400.0f, kernel);
+			for (uint64_t u = 1; u <= fighters; u++) raids.back().join(u, stats(u));
+		}
+		std::vector<combat_summary>& out = results.emplace_back();
+		size_t bytes = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t t = 0; t < ticks; t++)
+			for (encounter& raid : raids) {
+				for (size_t i = t * per_tick; i < (t + 1) * per_tick; i++) raid.act(attackers[i], powers[i]);
+				combat_summary s = raid.resolve();
+				bytes += s.to_string().size();
+				out.push_back(std::move(s));
+			}
+		std::cout << std::format("batched, {0}: {1:.2f} M actions/s, {2} messages (1 per encounter-tick){3}\n", combat_kernel_names[kernel], rate(start) / 1e6, out.size(),
+			(kernel == encounter::chosen()) ? ", chosen" : "");
+	}
+	size_t differ = 0;
+	for (size_t k = 1; k < results.size(); k++)
+		for (size_t i = 0; i < results[0].size(); i++)
+			if (results[k][i].damage not_eq results[0][i].damage or results[k][i].crits not_eq results[0][i].crits or results[k][i].top not_eq results[0][i].top) differ++;
+	std::cout << std::format("{0} encounters x {1} fighters, {2} actions a tick each: {3} summaries differ between kernels\n", encounters, fighters, per_tick, differ);
+	bench_checks checks{};
+	checks.add(differ, "summaries differ between kernels");
+	return checks.report();
+}
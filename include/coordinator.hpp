@@ -0,0 +1,119 @@
+#pragma once
+/*
+ * multi-process sharding. a local coordinator hands each bot process a cluster_id slice of the shards over a unix socket.
+ * e.g. neko.exe --coordinator 2 --shards 8, then neko.exe --cluster auto for every bot process (extra ones wait as standbys)
+ *
+ * a bot process keeps its connection open for as long as it runs. when it exits the coordinator sees the socket close and
+ * hands the same cluster_id to the next standby, which resumes that slice's giveaways from .\giveaways\ on ready.
+ */
+#include <dpp/snowflake.h>
+#include <winsock2.h>
+#include <afunix.h> // AF_UNIX, sockaddr_un
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <format>
+
+inline constexpr const char* coordinator_path = "neko.sock";
+
+struct shard_range {
+	uint32_t cluster_id{}, maxclusters = 1, shards{};
+};
+
+/* shard a guild's gateway events arrive on. the process running that shard owns the guild's state */
+inline uint32_t shard_of(dpp::snowflake guild, uint32_t shards) {
+	return (shards) ? static_cast<uint32_t>((static_cast<uint64_t>(guild) >> 22) % shards) : 0;
+}
+
+class coordinator {
+	shard_range base{};
+	std::vector<SOCKET> slots{}; /* connection owning each cluster_id, INVALID_SOCKET if free */
+	std::deque<SOCKET> standby{};
+	std::mutex lock{};
+
+	static sockaddr_un address() {
+		sockaddr_un addr{};
+		addr.sun_family = AF_UNIX;
+		strncpy_s(addr.sun_path, sizeof(addr.sun_path), coordinator_path, _TRUNCATE);
+		return addr;
+	}
+	/* "<cluster_id> <maxclusters> <shards>\n" */
+	bool assign(SOCKET connection, uint32_t id) {
+		std::string line = std::format("{0} {1} {2}\n", id, this->base.maxclusters, this->base.shards);
+		if (send(connection, line.data(), static_cast<int>(line.size()), 0) == SOCKET_ERROR) return false;
+		this->slots[id] = connection;
+		std::cout << std::format("coordinator: cluster {0} assigned", id) << std::endl;
+		return true;
+	}
+	/* must hold lock. gives a free slot to the first standby that is still connected */
+	void fill(uint32_t id) {
+		while (not this->standby.empty()) {
+			SOCKET next = this->standby.front();
+			this->standby.pop_front();
+			if (this->assign(next, id)) return;
+			closesocket(next);
+		}
+	}
+	void serve(SOCKET connection) {
+		{
+			std::lock_guard<std::mutex> l(this->lock);
+			auto free = std::ranges::find(this->slots, INVALID_SOCKET);
+			if (free == this->slots.end() or not this->assign(connection, static_cast<uint32_t>(free - this->slots.begin())))
+				this->standby.emplace_back(connection);
+		}
+		char buffer[64];
+		while (recv(connection, buffer, sizeof(buffer), 0) > 0); /* the connection only carries liveness */
+		std::lock_guard<std::mutex> l(this->lock);
+		if (auto owned = std::ranges::find(this->slots, connection); owned not_eq this->slots.end()) {
+			uint32_t id = static_cast<uint32_t>(owned - this->slots.begin());
+			*owned = INVALID_SOCKET;
+			std::cout << std::format("coordinator: cluster {0} released", id) << std::endl;
+			this->fill(id);
+		}
+		else std::erase(this->standby, connection);
+		closesocket(connection);
+	}
+public:
+	coordinator(uint32_t clusters, uint32_t shards) : base{ 0, std::max<uint32_t>(clusters, 1), std::max(shards, clusters) } {
+		this->slots.assign(this->base.maxclusters, INVALID_SOCKET);
+	}
+	int run() {
+		WSADATA wsa{};
+		if (WSAStartup(MAKEWORD(2, 2), &wsa) not_eq 0) return 1;
+		SOCKET listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr = address();
+		std::filesystem::remove(coordinator_path);
+		if (listener == INVALID_SOCKET or bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR or listen(listener, SOMAXCONN) == SOCKET_ERROR) {
+			std::cout << std::format("coordinator: cannot listen on {0} ({1})", coordinator_path, WSAGetLastError()) << std::endl;
+			return 1;
+		}
+		std::cout << std::format("coordinator: {0} clusters, {1} shards", this->base.maxclusters, this->base.shards) << std::endl;
+		for (SOCKET connection; (connection = accept(listener, nullptr, nullptr)) not_eq INVALID_SOCKET;)
+			std::thread(&coordinator::serve, this, connection).detach();
+		closesocket(listener);
+		return 0;
+	}
+	/*
+	 * asks the coordinator for a slice, blocking while this process is a standby.
+	 * connection must stay open for as long as the slice is in use; closing it hands the slice over.
+	 */
+	static shard_range join(SOCKET& connection) {
+		WSADATA wsa{};
+		WSAStartup(MAKEWORD(2, 2), &wsa); /* ahead of dpp::cluster, which does its own */
+		connection = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr = address();
+		if (connection == INVALID_SOCKET or connect(connection, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR)
+			throw std::runtime_error(std::format("no coordinator on {0}", coordinator_path));
+		std::string line{};
+		for (char c; line.empty() or line.back() not_eq '\n';) {
+			if (recv(connection, &c, 1, 0) <= 0) throw std::runtime_error("coordinator closed the connection");
+			line += c;
+		}
+		shard_range range{};
+		std::istringstream{ line } >> range.cluster_id >> range.maxclusters >> range.shards;
+		return range;
+	}
+};
@@ -0,0 +1,23 @@
+#pragma once
+/*
+ * what the processor this runs on can do, so a kernel is picked at startup instead of at compile time.
+ * e.g. if (detect_cpu().avx2) kernel = &resolve_avx2;
+ */
+#include <intrin.h> // __cpuid()
+#include <immintrin.h> // _xgetbv()
+
+/* instruction sets both the CPU and the OS (saved register state) support */
+struct cpu_features {
+	bool avx = false, avx2 = false;
+};
+
+inline cpu_features detect_cpu() {
+	cpu_features cpu{};
+	int info[4]{};
+	__cpuid(info, 1);
+	cpu.avx = (info[2] & (1 << 28)) and (info[2] & (1 << 27)) and (_xgetbv(0) & 0x6) == 0x6;
+	if (not cpu.avx) return cpu;
+	__cpuidex(info, 7, 0);
+	cpu.avx2 = info[1] & (1 << 5);
+	return cpu;
+}
@@ -0,0 +1,119 @@
+#pragma once
+/*
+ * the /stats card. a timer samples the bot every few seconds into a short history, and the card is drawn from that
+ * history at most once per redraw interval and served from memory in between, so a /stats flood costs one render.
+ */
+#include <dpp/cluster.h>
+#include <palette.hpp>
+#include <image.hpp>
+#include <stats.hpp>
+#include <lanes.hpp>
+#include <rest.hpp>
+#include <metrics.hpp>
+#include <deque>
+
+struct stats_sample {
+	double events{}; /* gateway events per second */
+	double p50{}, p99{}; /* handler time over the sample, ms */
+	size_t queued{};
+	rest_scheduler::totals_t rest{};
+	size_t rss{};
+	size_t shards{};
+	double ping_mean{}, ping_max{}; /* websocket heartbeat round trip, ms */
+};
+
+class dashboard {
+	dpp::cluster& cluster;
+	lanes& pool;
+	rest_scheduler& rest;
+	family<histogram>& handlers;
+	gateway_rate rate{};
+	std::array<uint64_t, histogram::size> seen{}; /* handler buckets at the last sample */
+	std::mutex lock{};
+	std::deque<stats_sample> history{};
+	std::mutex drawing{};
+	std::string card{};
+	std::chrono::steady_clock::time_point drawn{};
+
+	std::string draw(const std::deque<stats_sample>& h) {
+		constexpr int width = 600, height = 300, chart_top = 205, chart_bottom = 285;
+		palette text{ blue(), green(), red() }, muted{ blue(150), green(150), red(150) }, events{ blue(242), green(101), red(88) }, slow{ blue(60), green(170), red(250) };
+		image img({ height, width }, { blue(43), green(45), red(49) });
+		const stats_sample& now = h.back();
+		uint64_t users = dpp::get_user_count(), guilds = dpp::get_guild_count(), channels = dpp::get_channel_count();
+		std::vector<std::string> lines = {
+			std::format("events    {0:.1f}/s", now.events),
+			std::format("handlers  p50 {0:.2f} ms, p99 {1:.2f} ms", now.p50, now.p99),
+			std::format("queued    {0} tasks", now.queued),
+			std::format("rest      {0} 429s, {1} avoided, {2} merged", now.rest.received, now.rest.avoided, now.rest.merged),
+			std::format("memory    {0} MiB", now.rss / (1024 * 1024)),
+			std::format("shards    {0}, ping mean {1:.0f} ms, max {2:.0f} ms", now.shards, now.ping_mean, now.ping_max),
+			std::format("cache     {0} users, {1} guilds, {2} channels", users, guilds, channels)
+		};
+		img.add_text("neko", { 15, 28 }, cv::FONT_HERSHEY_DUPLEX, text);
+		for (size_t i = 0; i < lines.size(); i++) img.add_text(lines[i], { 15, 55 + static_cast<int>(i) * 20 }, cv::FONT_HERSHEY_PLAIN, muted);
+		/* events/s and handler p99 over the history, each scaled to its own peak */
+		img.add_rectangle({ 15, chart_top }, { width - 15, chart_bottom }, muted, 1);
+		double peak_events = 1e-9, peak_p99 = 1e-9;
+		for (const stats_sample& s : h) {
+			peak_events = std::max(peak_events, s.events);
+			peak_p99 = std::max(peak_p99, s.p99);
+		}
+		auto x = [&](size_t i) { return 15 + static_cast<int>(i * (width - 30) / std::max<size_t>(h.size() - 1, 1)); };
+		auto y = [&](double v, double peak) { return chart_bottom - static_cast<int>(v / peak * (chart_bottom - chart_top - 4)); };
+		for (size_t i = 1; i < h.size(); i++) {
+			img.add_line({ x(i - 1), y(h[i - 1].events, peak_events) }, { x(i), y(h[i].events, peak_events) }, events, 2);
+			img.add_line({ x(i - 1), y(h[i - 1].p99, peak_p99) }, { x(i), y(h[i].p99, peak_p99) }, slow, 1);
+		}
+		img.add_text(std::format("events/s (peak {0:.0f})", peak_events), { 20, chart_top + 14 }, cv::FONT_HERSHEY_PLAIN, events);
+		img.add_text(std::format("handler p99 (peak {0:.1f} ms)", peak_p99), { width / 2, chart_top + 14 }, cv::FONT_HERSHEY_PLAIN, slow);
+		return img.encoded(".png");
+	}
+public:
+	/* samples kept, with a 5s timer about five minutes */
+	static constexpr size_t keep = 60;
+	/* a card is reused for this long */
+	std::chrono::seconds redraw{ 10 };
+
+	dashboard(dpp::cluster& cluster, lanes& pool, rest_scheduler& rest, family<histogram>& handlers) : cluster(cluster), pool(pool), rest(rest), handlers(handlers) {}
+	/* called from a timer */
+	void sample() {
+		stats_sample s{ this->rate.sample(this->cluster) };
+		std::array<uint64_t, histogram::size> total{}, window{};
+		this->handlers.each([&total](std::string_view, const histogram& h)
+			{
+				auto [count, sum, buckets] = h.snapshot();
+				for (size_t i = 0; i < histogram::size; i++) total[i] += buckets[i];
+			});
+		for (size_t i = 0; i < histogram::size; i++) window[i] = total[i] - this->seen[i];
+		this->seen = total;
+		s.p50 = histogram::percentile(window, 0.5) / 1e6;
+		s.p99 = histogram::percentile(window, 0.99) / 1e6;
+		s.queued = this->pool.queued();
+		s.rest = this->rest.totals();
+		s.rss = rss();
+		for (const auto& [id, shard] : this->cluster.get_shards()) {
+			s.shards++;
+			s.ping_mean += shard->websocket_ping * 1000.0;
+			s.ping_max = std::max(s.ping_max, shard->websocket_ping * 1000.0);
+		}
+		if (s.shards) s.ping_mean /= s.shards;
+		std::lock_guard<std::mutex> g(this->lock);
+		this->history.emplace_back(s);
+		if (this->history.size() > keep) this->history.pop_front();
+	}
+	/* the card as png. callers arriving while it is drawn wait for that one instead of drawing their own */
+	std::string get() {
+		std::lock_guard<std::mutex> g(this->drawing);
+		if (not this->card.empty() and std::chrono::steady_clock::now() < this->drawn + this->redraw) return this->card;
+		std::deque<stats_sample> h{};
+		{
+			std::lock_guard<std::mutex> l(this->lock);
+			h = this->history;
+		}
+		if (h.empty()) h.emplace_back(); /* asked before the first sample */
+		this->card = this->draw(h);
+		this->drawn = std::chrono::steady_clock::now();
+		return this->card;
+	}
+};
@@ -0,0 +1,45 @@
+#pragma once
+/*
+ * replaying a gateway capture through both decoders. e.g. neko.exe --bench decode --input gateway.log
+ */
+#include <dpp/etf.h>
+#include <dpp/nlohmann/json.hpp>
+#include <bench_common.hpp>
+#include <fstream>
+
+/*
+ * replays captured gateway payloads through nlohmann and dpp::etf_parser.
+ * input is one JSON payload per line (dpp's "R: " trace lines are accepted as is);
+ * the ETF side is encoded from the same payloads so both decoders see the same event mix. lines that don't parse are
+ * skipped and counted, e.g. a trace line cut off when the capture stopped
+ */
+inline int decode_bench(const std::string& file) {
+	std::vector<std::string> json{}, etf{};
+	dpp::etf_parser etf_parser{};
+	size_t json_bytes = 0, etf_bytes = 0, malformed = 0;
+	std::ifstream in{ file };
+	for (std::string line; std::getline(in, line);) {
+		std::string_view payload(line);
+		if (payload.starts_with("R: ")) payload.remove_prefix(3);
+		if (payload.empty() or payload.front() not_eq '{') continue;
+		nlohmann::json parsed = nlohmann::json::parse(payload, nullptr, false);
+		if (parsed.is_discarded()) {
+			malformed++;
+			continue;
+		}
+		json.emplace_back(payload);
+		etf.emplace_back(etf_parser.build(parsed));
+		json_bytes += json.back().size();
+		etf_bytes += etf.back().size();
+	}
+	if (json.empty()) {
+		std::cout << std::format("no gateway payloads in {0}", file) << std::endl;
+		return 1;
+	}
+	double json_ns = cpu_per_item(json, [](const std::string& p) { return nlohmann::json::parse(p).size(); });
+	double etf_ns = cpu_per_item(etf, [&etf_parser](const std::string& p) { etf_parser.parse(p); });
+	std::cout << std::format("{0} events, {1} malformed lines skipped\n", json.size(), malformed)
+		<< std::format("json: {0:.0f} ns cpu/event, {1} bytes/event\n", json_ns, json_bytes / json.size())
+		<< std::format("etf:  {0:.0f} ns cpu/event, {1} bytes/event\n", etf_ns, etf_bytes / etf.size());
+	return 0;
+}
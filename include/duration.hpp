@@ -0,0 +1,264 @@
+#pragma once
+/*
+ * when something should happen, from what a user typed. one pass over a string_view, no allocations, no exceptions,
+ * and constexpr so the examples below are checked by the compiler.
+ * accepts
+ *   durations   1h30m, 1h 30m, 1h, 30m, 1w2d, 1.5h, 2 days 3 hours
+ *   ISO-8601    P1W, P2DT3H, PT90M, PT1.5S (a year is 365 days and a month 30, there's no calendar to ask)
+ *   timestamps  2025-01-31, 2025-01-31 18:00, 2025-01-31T18:00:00Z, 2025-01-31T18:00+02:00 (UTC unless an offset is given)
+ *   Discord     <t:1738346400>, <t:1738346400:R>, what the client inserts for a picked date
+ * e.g. parsed_time t = parse_time("1h 30m"); if (not t.error) ends = t.resolve(time(0));
+ */
+#include <string_view>
+#include <cstdint>
+#include <limits>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
+
+enum time_error : uint8_t {
+	te_none, te_empty, te_number, te_unit, te_overflow, te_date, te_trailing
+};
+inline constexpr std::string_view time_error_names[] = {
+	"ok", "nothing given", "expected a number", "unknown unit", "too far away", "not a valid date or time", "unexpected text"
+};
+
+struct parsed_time {
+	int64_t seconds{}; /* a duration, or seconds since the epoch when absolute */
+	bool absolute = false;
+	time_error error = te_none;
+	size_t at = 0; /* where the error is */
+
+	/* the moment it names, counted from now when it's a duration */
+	constexpr time_t resolve(time_t now) const {
+		return this->absolute ? static_cast<time_t>(this->seconds) : now + static_cast<time_t>(this->seconds);
+	}
+};
+
+namespace duration_detail {
+	inline constexpr int64_t limit = std::numeric_limits<int64_t>::max();
+	/*
+	 * the furthest a duration may reach, 100 years of 365 days, and the latest moment: the end of 9999, or less where
+	 * system_clock counts finer, so a duration from the latest moment still passes through system_clock::from_time_t.
+	 * past either is te_overflow
+	 */
+	inline constexpr int64_t horizon = 100LL * 31536000;
+	inline constexpr int64_t latest = std::min<int64_t>(253402300799,
+		std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::duration::max()).count() - horizon);
+
+	struct cursor {
+		std::string_view s{};
+		size_t i = 0;
+		constexpr bool done() const { return this->i >= this->s.size(); }
+		constexpr char peek() const { return this->done() ? '\0' : this->s[this->i]; }
+		constexpr bool digit() const { return this->peek() >= '0' and this->peek() <= '9'; }
+		constexpr bool take(char c) {
+			if (this->peek() not_eq c) return false;
+			this->i++;
+			return true;
+		}
+		constexpr void spaces() {
+			while (this->peek() == ' ' or this->peek() == '\t') this->i++;
+		}
+	};
+	constexpr char lower(char c) {
+		return (c >= 'A' and c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+	/* digits into out, false on overflow. at least one digit must be there */
+	constexpr bool number(cursor& c, int64_t& out, size_t max_digits = 19) {
+		out = 0;
+		size_t n = 0;
+		for (; c.digit(); c.i++, n++) {
+			int64_t d = c.peek() - '0';
+			if (n == max_digits or out > limit / 10 or (out == limit / 10 and d > limit % 10)) return false;
+			out = out * 10 + d;
+		}
+		return n > 0;
+	}
+	/* exactly n digits */
+	constexpr bool fixed(cursor& c, size_t n, int64_t& out) {
+		size_t start = c.i;
+		if (not number(c, out, n)) return false;
+		return c.i - start == n;
+	}
+	/* amounts are at most this many digits, about 3000 years of seconds, so amount times any unit fits without checking */
+	inline constexpr size_t amount_digits = 11;
+	/* value times unit plus fraction / scale of a unit, added to total. false past the horizon */
+	constexpr bool add(int64_t& total, int64_t value, int64_t fraction, int64_t scale, int64_t unit) {
+		/* value < 10^11 and fraction < scale <= 10^9, unit <= 31536000: neither product overflows */
+		int64_t part = value * unit + ((fraction) ? fraction * unit / scale : 0);
+		if (part > horizon - total) return false;
+		total += part;
+		return true;
+	}
+	/* a number with an optional fraction, e.g. 1.5. scale is 10^digits of the fraction */
+	constexpr time_error amount(cursor& c, int64_t& value, int64_t& fraction, int64_t& scale) {
+		fraction = 0;
+		scale = 1;
+		if (not c.digit()) return te_number;
+		if (not number(c, value, amount_digits)) return te_overflow;
+		if (c.take('.')) {
+			if (not c.digit()) return te_number;
+			for (; c.digit(); c.i++)
+				if (scale < 1'000'000'000) {
+					fraction = fraction * 10 + (c.peek() - '0');
+					scale *= 10;
+				}
+		}
+		return te_none;
+	}
+	/* word equals spelling, ignoring case */
+	constexpr bool is(std::string_view word, std::string_view spelling) {
+		if (word.size() not_eq spelling.size()) return false;
+		for (size_t k = 0; k < word.size(); k++)
+			if (lower(word[k]) not_eq spelling[k]) return false;
+		return true;
+	}
+	/* seconds in the unit named by the word at the cursor, 0 if it isn't one. "mo" or "minx" aren't minutes */
+	constexpr int64_t unit(cursor& c) {
+		size_t end = c.i;
+		while (end < c.s.size() and lower(c.s[end]) >= 'a' and lower(c.s[end]) <= 'z') end++;
+		std::string_view word = c.s.substr(c.i, end - c.i);
+		int64_t seconds = 0;
+		switch (lower(c.peek())) {
+		case 's': seconds = (is(word, "s") or is(word, "sec") or is(word, "secs") or is(word, "second") or is(word, "seconds")) ? 1 : 0; break;
+		case 'm': seconds = (is(word, "m") or is(word, "min") or is(word, "mins") or is(word, "minute") or is(word, "minutes")) ? 60 : 0; break;
+		case 'h': seconds = (is(word, "h") or is(word, "hr") or is(word, "hrs") or is(word, "hour") or is(word, "hours")) ? 3600 : 0; break;
+		case 'd': seconds = (is(word, "d") or is(word, "day") or is(word, "days")) ? 86400 : 0; break;
+		case 'w': seconds = (is(word, "w") or is(word, "week") or is(word, "weeks")) ? 604800 : 0; break;
+		}
+		if (seconds) c.i = end;
+		return seconds;
+	}
+	/* days since 1970-01-01 of a proleptic Gregorian date (Hinnant, "chrono-compatible low-level date algorithms") */
+	constexpr int64_t days_from_civil(int64_t y, int64_t m, int64_t d) {
+		y -= m <= 2;
+		int64_t era = (y >= 0 ? y : y - 399) / 400, yoe = y - era * 400;
+		int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1, doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return era * 146097 + doe - 719468;
+	}
+	constexpr int64_t days_in_month(int64_t y, int64_t m) {
+		constexpr int64_t days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		bool leap = (y % 4 == 0 and y % 100 not_eq 0) or y % 400 == 0;
+		return (m == 2 and leap) ? 29 : days[m - 1];
+	}
+
+	constexpr parsed_time fail(time_error e, const cursor& c) {
+		return { 0, false, e, c.i };
+	}
+	/* 1h30m, 1h 30m, 1h, 30m, 2 days 3 hours */
+	constexpr parsed_time relative(cursor c) {
+		int64_t total = 0;
+		while (true) {
+			c.spaces();
+			if (c.done()) break;
+			int64_t value{}, fraction{}, scale{};
+			if (time_error e = amount(c, value, fraction, scale)) return fail(e, c);
+			c.spaces();
+			int64_t seconds = unit(c);
+			if (not seconds) return fail(te_unit, c);
+			if (not add(total, value, fraction, scale, seconds)) return fail(te_overflow, c);
+			c.spaces();
+			c.take(','); /* the old "1h, 30m" */
+		}
+		return { total };
+	}
+	/* P[nY][nM][nW][nD][T[nH][nM][nS]] */
+	constexpr parsed_time iso_duration(cursor c) {
+		c.i++; /* P */
+		int64_t total = 0;
+		bool time = false, any = false;
+		while (not c.done()) {
+			if (not time and (c.peek() == 'T' or c.peek() == 't')) {
+				c.i++;
+				time = true;
+				if (c.done()) return fail(te_number, c);
+				continue;
+			}
+			int64_t value{}, fraction{}, scale{};
+			if (time_error e = amount(c, value, fraction, scale)) return fail(e, c);
+			int64_t seconds = 0;
+			switch (lower(c.peek())) {
+			case 'y': seconds = time ? 0 : 31536000; break;
+			case 'm': seconds = time ? 60 : 2592000; break;
+			case 'w': seconds = time ? 0 : 604800; break;
+			case 'd': seconds = time ? 0 : 86400; break;
+			case 'h': seconds = time ? 3600 : 0; break;
+			case 's': seconds = time ? 1 : 0; break;
+			}
+			if (not seconds) return fail(te_unit, c);
+			c.i++;
+			if (not add(total, value, fraction, scale, seconds)) return fail(te_overflow, c);
+			any = true;
+		}
+		if (not any) return fail(te_number, c);
+		return { total };
+	}
+	/* YYYY-MM-DD[(T| )HH:MM[:SS]][Z|(+|-)HH[:]MM] */
+	constexpr parsed_time timestamp(cursor c) {
+		int64_t y{}, mo{}, d{}, h{}, mi{}, sec{};
+		if (not fixed(c, 4, y) or not c.take('-') or not fixed(c, 2, mo) or not c.take('-') or not fixed(c, 2, d)) return fail(te_date, c);
+		if (mo < 1 or mo > 12 or d < 1 or d > days_in_month(y, mo)) return fail(te_date, c);
+		if (c.peek() == 'T' or c.peek() == 't' or (c.peek() == ' ' and c.i + 1 < c.s.size() and c.s[c.i + 1] >= '0' and c.s[c.i + 1] <= '9')) {
+			c.i++;
+			if (not fixed(c, 2, h) or not c.take(':') or not fixed(c, 2, mi)) return fail(te_date, c);
+			if (c.take(':') and not fixed(c, 2, sec)) return fail(te_date, c);
+			if (h > 23 or mi > 59 or sec > 60) return fail(te_date, c);
+		}
+		int64_t offset = 0;
+		c.spaces();
+		if (c.peek() == 'Z' or c.peek() == 'z') c.i++;
+		else if (c.peek() == '+' or c.peek() == '-') {
+			int64_t sign = (c.s[c.i++] == '-') ? -1 : 1, oh{}, om{};
+			if (not fixed(c, 2, oh)) return fail(te_date, c);
+			c.take(':');
+			if (not fixed(c, 2, om) or oh > 23 or om > 59) return fail(te_date, c);
+			offset = sign * (oh * 3600 + om * 60);
+		}
+		c.spaces();
+		if (not c.done()) return fail(te_trailing, c);
+		int64_t at = days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + sec - offset;
+		if (at > latest) return fail(te_overflow, c);
+		return { at, true };
+	}
+	/* <t:seconds> or <t:seconds:style> */
+	constexpr parsed_time discord(cursor c) {
+		c.i += 3;
+		int64_t seconds{};
+		if (not c.digit()) return fail(te_number, c);
+		if (not number(c, seconds) or seconds > latest) return fail(te_overflow, c);
+		if (c.take(':')) {
+			if (c.done() or c.peek() == '>') return fail(te_unit, c);
+			c.i++; /* t, T, d, D, f, F or R */
+		}
+		if (not c.take('>')) return fail(te_trailing, c);
+		c.spaces();
+		if (not c.done()) return fail(te_trailing, c);
+		return { seconds, true };
+	}
+}
+
+constexpr parsed_time parse_time(std::string_view text) {
+	using namespace duration_detail;
+	cursor c{ text };
+	c.spaces();
+	if (c.done()) return fail(te_empty, c);
+	std::string_view rest = text.substr(c.i);
+	if (rest.starts_with("<t:")) return discord(c);
+	if (rest[0] == 'P' or rest[0] == 'p') return iso_duration(c);
+	if (rest.size() >= 5 and rest[4] == '-' and rest[0] >= '0' and rest[0] <= '9') return timestamp(c);
+	return relative(c);
+}
+
+static_assert(parse_time("1h30m").seconds == 5400 and parse_time("1h 30m").seconds == 5400 and parse_time("1h, 30m").seconds == 5400);
+static_assert(parse_time("1w2d").seconds == 777600 and parse_time("1.5h").seconds == 5400 and parse_time("2 days 3 hours").seconds == 183600);
+static_assert(parse_time("P2DT3H").seconds == 183600 and parse_time("PT90M").seconds == 5400 and parse_time("P1W").seconds == 604800);
+static_assert(parse_time("2025-01-31T18:00:00Z").seconds == 1738346400 and parse_time("2025-01-31 20:00+02:00").seconds == 1738346400);
+static_assert(parse_time("<t:1738346400:R>").absolute and parse_time("<t:1738346400:R>").seconds == 1738346400);
+static_assert(parse_time("30").error == te_unit and parse_time("").error == te_empty and parse_time("2025-02-30").error == te_date);
+static_assert(parse_time("99999999999999999999s").error == te_overflow and parse_time("1h 3x").error == te_unit and parse_time("1h 3x").at == 4);
+static_assert(parse_time("99999999999w99999999999w").error == te_overflow and parse_time("P101Y").error == te_overflow and parse_time("P100Y").seconds == duration_detail::horizon);
+static_assert(parse_time("<t:999999999999>").error == te_overflow and parse_time("<t:4102444800>").seconds == 4102444800);
+/* ns clocks (libstdc++) end in 2262, MSVC's 100 ns ticks about 29000 years on, either leaves room for what's asked for */
+static_assert(duration_detail::latest + duration_detail::horizon <= std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::duration::max()).count()
+	and duration_detail::latest >= 4'102'444'800); /* 2100-01-01 */
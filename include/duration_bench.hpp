@@ -0,0 +1,96 @@
+#pragma once
+/*
+ * parse_time fuzzed and timed. e.g. neko.exe --bench duration
+ */
+#include <bench_common.hpp>
+#include <duration.hpp>
+#include <random.hpp>
+
+/*
+ * random text must never be read past its end or give a negative duration or one past the horizon; random durations
+ * and timestamps written out in every accepted spelling must parse back exactly
+ */
+inline void duration_fuzz(bench_checks& checks, size_t rounds) {
+	xoshiro256 rng(1);
+	constexpr std::string_view alphabet = "0123456789 .,:-+<>tTPpYMWDHSZmhdswinouraey";
+	std::string text{};
+	for (size_t r = 0; r < rounds; r++) {
+		text.resize(bounded(rng, 24));
+		for (char& c : text) c = alphabet[bounded(rng, alphabet.size())];
+		parsed_time t = parse_time(text);
+		checks.expect(t.at <= text.size() and (t.error or t.absolute or (t.seconds >= 0 and t.seconds <= duration_detail::horizon)), "garbage", text);
+	}
+	constexpr std::string_view spellings[][3] = { { "w", "week", "weeks" }, { "d", "day", "days" }, { "h", "hr", "hours" }, { "m", "min", "minutes" }, { "s", "sec", "seconds" } };
+	constexpr int64_t units[] = { 604800, 86400, 3600, 60, 1 };
+	constexpr std::string_view separators[] = { "", " ", ", ", "  " };
+	for (size_t r = 0; r < rounds; r++) {
+		int64_t expected = 0;
+		std::string relative{}, iso = "P";
+		for (size_t u = 0; u < 5; u++) {
+			if (bounded(rng, 2)) continue;
+			int64_t n = bounded(rng, 1000);
+			expected += n * units[u];
+			relative += std::format("{0}{1}{2}{3}", relative.empty() ? "" : separators[bounded(rng, 4)], n, bounded(rng, 2) ? " " : "", spellings[u][bounded(rng, 3)]);
+			if (u >= 2 and iso.find('T') == std::string::npos) iso += "T";
+			iso += std::format("{0}{1}", n, "WDHMS"[u]);
+		}
+		if (relative.empty()) continue;
+		parsed_time spelled = parse_time(relative), standard = parse_time(iso);
+		checks.expect(not spelled.error and spelled.seconds == expected, "duration", relative);
+		checks.expect(not standard.error and standard.seconds == expected, "iso duration", iso);
+	}
+	for (size_t r = 0; r < rounds; r++) {
+		int64_t at = bounded(rng, 4'000'000'000), days = at / 86400, second = at % 86400;
+		/* civil_from_days, the inverse of duration_detail::days_from_civil */
+		int64_t z = days + 719468, era = z / 146097, doe = z - era * 146097, yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100), mp = (5 * doy + 2) / 153, d = doy - (153 * mp + 2) / 5 + 1, m = mp < 10 ? mp + 3 : mp - 9, y = yoe + era * 400 + (m <= 2);
+		int64_t offset = static_cast<int64_t>(bounded(rng, 27)) * 1800 - 12 * 3600, local = at + offset;
+		int64_t ld = local / 86400 - days, ls = local % 86400;
+		if (local < 0 or ld not_eq 0) continue; /* offset moved it to another day, skip rather than redo the calendar here */
+		std::string zulu = std::format("{0:04}-{1:02}-{2:02}T{3:02}:{4:02}:{5:02}Z", y, m, d, second / 3600, second / 60 % 60, second % 60);
+		std::string zoned = std::format("{0:04}-{1:02}-{2:02} {3:02}:{4:02}:{5:02}{6}{7:02}:{8:02}", y, m, d, ls / 3600, ls / 60 % 60, ls % 60, offset < 0 ? '-' : '+', std::abs(offset) / 3600, std::abs(offset) / 60 % 60);
+		std::string discord = std::format("<t:{0}:R>", at);
+		for (const std::string& stamp : { zulu, zoned, discord }) {
+			parsed_time t = parse_time(stamp);
+			checks.expect(not t.error and t.absolute and t.seconds == at, "timestamp", stamp);
+		}
+	}
+	std::cout << std::format("fuzz: {0} rounds each, {1} failures\n", rounds, checks.failures());
+}
+
+/* fuzzes parse_time, then times it against the parser it replaced. fails if the fuzzing does */
+inline int duration_bench(size_t rounds) {
+	bench_checks checks{};
+	duration_fuzz(checks, rounds);
+	/* what string_to_time did: copy, strip spaces, split on commas, scan each piece for a unit, stoull */
+	auto legacy = [](std::string str) -> time_t
+		{
+			try {
+				time_t t = 0;
+				str.erase(std::remove(str.begin(), str.end(), ' '), str.end());
+				std::unique_ptr<std::vector<std::string>> pieces = std::make_unique<std::vector<std::string>>();
+				for (std::string_view rest(str); not rest.empty();) {
+					size_t comma = std::min(rest.find(','), rest.size());
+					if (comma) pieces->emplace_back(rest.substr(0, comma));
+					rest.remove_prefix(std::min(comma + 1, rest.size()));
+				}
+				for (std::string& i : *pieces) {
+					if (std::ranges::find(i | std::views::reverse, 's') not_eq i.rend()) t += std::stoull(dpp::rtrim(i));
+					if (std::ranges::find(i | std::views::reverse, 'm') not_eq i.rend()) t += std::stoull(dpp::rtrim(i)) * 60;
+					if (std::ranges::find(i | std::views::reverse, 'h') not_eq i.rend()) t += std::stoull(dpp::rtrim(i)) * 60 * 60;
+					if (std::ranges::find(i | std::views::reverse, 'd') not_eq i.rend()) t += std::stoull(dpp::rtrim(i)) * 60 * 60 * 24;
+				}
+				return t;
+			}
+			catch (...) {
+				return 0;
+			}
+		};
+	std::vector<std::string> inputs{};
+	for (int i = 0; i < 100; i++) inputs.insert(inputs.end(), { "1h", "30m", "2d", "1h, 30m", "1d, 12h, 30m, 15s", "45s", "1h,x" });
+	time_t sink = 0;
+	double old = cpu_per_item(inputs, [&](const std::string& i) { sink += legacy(i); });
+	double now = cpu_per_item(inputs, [&](const std::string& i) { sink += parse_time(i).seconds; });
+	std::cout << std::format("string_to_time {0:.0f} ns, parse_time {1:.0f} ns per input (sink {2})\n", old, now, sink & 1);
+	return checks.report();
+}
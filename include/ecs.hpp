@@ -0,0 +1,365 @@
+#pragma once
+/*
+ * entity component system for the game. entities with the same set of components share an archetype, which keeps every
+ * component in its own packed column (structure of arrays), so a system walks a few contiguous arrays instead of
+ * chasing objects around the heap. handles are an index and a generation: they stay valid while the entity moves
+ * between archetypes, and once it's destroyed its handle stops resolving instead of reaching whoever reuses the slot.
+ * components are plain data (trivially copyable), anything owning memory is kept elsewhere and referred to by id.
+ * a schedule runs systems that don't write what another one touches side by side, and splits big archetypes across cores.
+ * e.g. entity e = w.create(position{}, velocity{ 1, 0 }); w.each<position, const velocity>([](position& p, const velocity& v) { p.x += v.dx; });
+ */
+#include <vector>
+#include <array>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstring>
+#include <bit>
+#include <type_traits>
+#include <stdexcept>
+#include <string>
+
+/* one bit per component type, so a world knows at most 64 of them */
+using component_mask = uint64_t;
+
+struct entity {
+	uint32_t index{}, generation{};
+	friend bool operator==(entity, entity) = default;
+};
+
+namespace ecs_detail {
+	inline constexpr size_t max_components = 64;
+	inline std::atomic<uint32_t> next_component{};
+	inline std::array<uint32_t, max_components> sizes{};
+	template<typename C> using bare = std::remove_cvref_t<C>;
+	/* ids are handed out on first use, the same for every world */
+	template<typename C> uint32_t component_id() {
+		static_assert(std::is_trivially_copyable_v<C>, "components are plain data, rows are moved with memcpy");
+		static_assert(alignof(C) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "columns are only aligned like operator new");
+		static const uint32_t id = []
+			{
+				uint32_t id = next_component.fetch_add(1, std::memory_order_relaxed);
+				if (id >= max_components) throw std::length_error("more than 64 component types");
+				sizes[id] = sizeof(C);
+				return id;
+			}();
+		return id;
+	}
+	template<typename... Cs> component_mask mask_of() {
+		return (component_mask{} | ... | (component_mask{ 1 } << component_id<bare<Cs>>()));
+	}
+	template<typename... Cs> component_mask writes_of() {
+		return (component_mask{} | ... | ((std::is_const_v<std::remove_reference_t<Cs>>) ? component_mask{} : component_mask{ 1 } << component_id<bare<Cs>>()));
+	}
+
+	/* runs n jobs over a few threads and the calling one. only one run at a time */
+	class worker_pool {
+		std::vector<std::thread> threads{};
+		std::mutex lock{};
+		std::condition_variable wake{}, done{};
+		const std::function<void(size_t)>* job{};
+		size_t count{}, finished{}, active{};
+		std::atomic<size_t> next{};
+		uint64_t round{};
+		bool stopping = false;
+
+		void drain() {
+			size_t mine = 0;
+			for (size_t i; (i = this->next.fetch_add(1, std::memory_order_relaxed)) < this->count; mine++) (*this->job)(i);
+			std::lock_guard<std::mutex> g(this->lock);
+			if ((this->finished += mine) == this->count) this->done.notify_all();
+		}
+		void work() {
+			uint64_t seen = 0;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> g(this->lock);
+					this->wake.wait(g, [&] { return this->stopping or this->round not_eq seen; });
+					if (this->stopping) return;
+					seen = this->round;
+					this->active++; /* the next run waits for this one to leave before resetting next and count under it */
+				}
+				this->drain();
+				std::lock_guard<std::mutex> g(this->lock);
+				if (--this->active == 0) this->done.notify_all();
+			}
+		}
+	public:
+		explicit worker_pool(size_t threads) {
+			for (size_t i = 1; i < threads; i++) this->threads.emplace_back([this] { this->work(); });
+		}
+		~worker_pool() {
+			{
+				std::lock_guard<std::mutex> g(this->lock);
+				this->stopping = true;
+			}
+			this->wake.notify_all();
+			for (std::thread& t : this->threads) t.join();
+		}
+		size_t size() const {
+			return this->threads.size() + 1;
+		}
+		void run(size_t n, const std::function<void(size_t)>& fn) {
+			{
+				std::unique_lock<std::mutex> g(this->lock);
+				this->done.wait(g, [&] { return this->active == 0; });
+				this->job = &fn;
+				this->count = n;
+				this->finished = 0;
+				this->next.store(0, std::memory_order_relaxed);
+				this->round++;
+			}
+			if (n > 1) this->wake.notify_all();
+			this->drain();
+			std::unique_lock<std::mutex> g(this->lock);
+			this->done.wait(g, [&] { return this->finished == this->count; });
+		}
+	};
+}
+
+/* the entities with exactly one set of components, one column per component and one row per entity */
+class archetype {
+	struct column {
+		size_t size{};
+		std::vector<std::byte> data{};
+	};
+	std::array<uint8_t, ecs_detail::max_components> slot{}; /* column of a component id */
+	std::vector<column> columns{};
+	std::array<archetype*, ecs_detail::max_components> with{}, without{}; /* where an added or removed component leads, filled in as it's used */
+	friend class world;
+public:
+	const component_mask mask;
+	std::vector<entity> entities{};
+
+	explicit archetype(component_mask mask) : mask(mask) {
+		for (component_mask m = mask; m; m &= m - 1) {
+			uint32_t id = std::countr_zero(m);
+			this->slot[id] = static_cast<uint8_t>(this->columns.size());
+			this->columns.push_back({ ecs_detail::sizes[id] });
+		}
+	}
+	size_t size() const {
+		return this->entities.size();
+	}
+	bool has(uint32_t id) const {
+		return this->mask >> id & 1;
+	}
+	std::byte* at(uint32_t id, size_t row) {
+		column& c = this->columns[this->slot[id]];
+		return c.data.data() + row * c.size;
+	}
+	/* the column of C. const C gives a read only one */
+	template<typename C> C* column_of() {
+		return reinterpret_cast<C*>(this->columns[this->slot[ecs_detail::component_id<ecs_detail::bare<C>>()]].data.data());
+	}
+	/* a zeroed row for e */
+	size_t push(entity e) {
+		for (column& c : this->columns) c.data.resize(c.data.size() + c.size);
+		this->entities.push_back(e);
+		return this->entities.size() - 1;
+	}
+	/* moves the last row into row */
+	void erase(size_t row) {
+		size_t last = this->entities.size() - 1;
+		if (row not_eq last)
+			for (column& c : this->columns) std::memcpy(c.data.data() + row * c.size, c.data.data() + last * c.size, c.size);
+		for (column& c : this->columns) c.data.resize(c.data.size() - c.size);
+		this->entities[row] = this->entities[last];
+		this->entities.pop_back();
+	}
+};
+
+/* the entities and their archetypes. structural changes (create, destroy, add, remove) can't run while a system does */
+class world {
+	struct location {
+		archetype* type{};
+		uint32_t row{}, generation{};
+	};
+	std::vector<location> slots{};
+	std::vector<uint32_t> unused{};
+	std::unordered_map<component_mask, std::unique_ptr<archetype>> by_mask{};
+	std::vector<archetype*> types{};
+	size_t living{};
+
+	archetype* type_of(component_mask mask) {
+		std::unique_ptr<archetype>& t = this->by_mask[mask];
+		if (not t) {
+			t = std::make_unique<archetype>(mask);
+			this->types.push_back(t.get());
+		}
+		return t.get();
+	}
+	void unlink(const location& l) {
+		if (l.row + 1 < l.type->size()) this->slots[l.type->entities.back().index].row = l.row;
+		l.type->erase(l.row);
+	}
+	/* moves e's row to another archetype, keeping the components both have */
+	void relocate(entity e, archetype* to) {
+		location& l = this->slots[e.index];
+		size_t row = to->push(e);
+		for (component_mask m = l.type->mask & to->mask; m; m &= m - 1) {
+			uint32_t id = std::countr_zero(m);
+			std::memcpy(to->at(id, row), l.type->at(id, l.row), ecs_detail::sizes[id]);
+		}
+		this->unlink(l);
+		l.type = to;
+		l.row = static_cast<uint32_t>(row);
+	}
+public:
+	template<typename... Cs> entity create(Cs... components) {
+		entity e{};
+		if (this->unused.empty()) {
+			e.index = static_cast<uint32_t>(this->slots.size());
+			this->slots.push_back({});
+		}
+		else {
+			e.index = this->unused.back();
+			this->unused.pop_back();
+		}
+		location& l = this->slots[e.index];
+		e.generation = l.generation;
+		l.type = this->type_of(ecs_detail::mask_of<Cs...>());
+		l.row = static_cast<uint32_t>(l.type->push(e));
+		(std::memcpy(l.type->at(ecs_detail::component_id<Cs>(), l.row), &components, sizeof(Cs)), ...);
+		this->living++;
+		return e;
+	}
+	bool alive(entity e) const {
+		return e.index < this->slots.size() and this->slots[e.index].generation == e.generation and this->slots[e.index].type;
+	}
+	/* false if it was already gone */
+	bool destroy(entity e) {
+		if (not this->alive(e)) return false;
+		location& l = this->slots[e.index];
+		this->unlink(l);
+		l.type = nullptr;
+		l.generation++;
+		this->unused.push_back(e.index);
+		this->living--;
+		return true;
+	}
+	/* e's C, nullptr if it has none or is gone. only good until the next structural change */
+	template<typename C> C* get(entity e) {
+		if (not this->alive(e)) return nullptr;
+		location& l = this->slots[e.index];
+		uint32_t id = ecs_detail::component_id<C>();
+		return (l.type->has(id)) ? reinterpret_cast<C*>(l.type->at(id, l.row)) : nullptr;
+	}
+	/* gives e a C, or overwrites the one it has. false if e is gone */
+	template<typename C> bool add(entity e, C component) {
+		if (not this->alive(e)) return false;
+		location& l = this->slots[e.index];
+		uint32_t id = ecs_detail::component_id<C>();
+		if (not l.type->has(id)) {
+			archetype*& to = l.type->with[id];
+			if (not to) to = this->type_of(l.type->mask | component_mask{ 1 } << id);
+			this->relocate(e, to);
+		}
+		std::memcpy(l.type->at(id, l.row), &component, sizeof(C));
+		return true;
+	}
+	/* false if e is gone or has no C */
+	template<typename C> bool remove(entity e) {
+		if (not this->alive(e)) return false;
+		location& l = this->slots[e.index];
+		uint32_t id = ecs_detail::component_id<C>();
+		if (not l.type->has(id)) return false;
+		archetype*& to = l.type->without[id];
+		if (not to) to = this->type_of(l.type->mask & ~(component_mask{ 1 } << id));
+		this->relocate(e, to);
+		return true;
+	}
+	size_t size() const {
+		return this->living;
+	}
+	/* the archetypes holding at least the components in need */
+	template<typename F> void each_type(component_mask need, F fn) {
+		for (archetype* t : this->types)
+			if ((t->mask & need) == need and t->size()) fn(*t);
+	}
+	/* fn(Cs&...) for every entity with all of Cs, on this thread. const Cs are read only */
+	template<typename... Cs, typename F> void each(F fn) {
+		this->each_type(ecs_detail::mask_of<Cs...>(), [&fn](archetype& t)
+			{
+				[&](Cs*... columns) { for (size_t row = 0, rows = t.size(); row < rows; row++) fn(columns[row]...); }(t.template column_of<Cs>()...);
+			});
+	}
+};
+
+/*
+ * systems in the order they were added. each one goes in the stage after the last earlier system it conflicts with
+ * (one writes a component the other reads or writes), so conflicting systems keep their order and the rest of a stage
+ * runs at once, every archetype cut into slices of grain rows
+ */
+class schedule {
+	struct system {
+		std::string name{};
+		component_mask needs{}, writes{};
+		size_t stage{};
+		std::function<void(archetype&, size_t begin, size_t end)> run{};
+	};
+	struct slice {
+		const system* s{};
+		archetype* type{};
+		size_t begin{}, end{};
+	};
+	std::vector<system> systems{};
+	size_t stages{};
+	ecs_detail::worker_pool pool;
+	std::vector<slice> work{};
+public:
+	/* rows a slice gets, big enough that handing it out costs nothing next to running it */
+	size_t grain = 16 * 1024;
+
+	explicit schedule(size_t threads = std::max(std::thread::hardware_concurrency(), 1u)) : pool(threads) {}
+	size_t threads() const {
+		return this->pool.size();
+	}
+	/* fn(Cs&...) runs for every entity with all of Cs, one slice at a time. const Cs are only read */
+	template<typename... Cs, typename F> schedule& add(std::string name, F fn) {
+		system s{ std::move(name), ecs_detail::mask_of<Cs...>(), ecs_detail::writes_of<Cs...>() };
+		for (const system& earlier : this->systems)
+			if ((earlier.writes & s.needs) or (s.writes & earlier.needs)) s.stage = std::max(s.stage, earlier.stage + 1);
+		this->stages = std::max(this->stages, s.stage + 1);
+		s.run = [fn](archetype& t, size_t begin, size_t end)
+			{
+				[&](Cs*... columns) { for (size_t row = begin; row < end; row++) fn(columns[row]...); }(t.template column_of<Cs>()...);
+			};
+		this->systems.push_back(std::move(s));
+		return *this;
+	}
+	/* one tick: every stage in order, each stage's slices across the pool */
+	void run(world& w) {
+		const std::function<void(size_t)> job = [this](size_t i) { this->work[i].s->run(*this->work[i].type, this->work[i].begin, this->work[i].end); };
+		for (size_t stage = 0; stage < this->stages; stage++) {
+			this->work.clear();
+			for (const system& s : this->systems) {
+				if (s.stage not_eq stage) continue;
+				w.each_type(s.needs, [&](archetype& t)
+					{
+						for (size_t begin = 0; begin < t.size(); begin += this->grain) this->work.push_back({ &s, &t, begin, std::min(begin + this->grain, t.size()) });
+					});
+			}
+			this->pool.run(this->work.size(), job);
+		}
+	}
+	/* system names by stage, e.g. "move, regen | bounds" */
+	std::string to_string() const {
+		std::string out{};
+		for (size_t stage = 0; stage < this->stages; stage++) {
+			if (stage) out += " | ";
+			bool first = true;
+			for (const system& s : this->systems)
+				if (s.stage == stage) {
+					out += (first ? "" : ", ") + s.name;
+					first = false;
+				}
+		}
+		return out;
+	}
+};
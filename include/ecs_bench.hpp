@@ -0,0 +1,128 @@
+#pragma once
+/*
+ * the ecs against heap objects, and its handles through churn. e.g. neko.exe --bench ecs
+ */
+#include <bench_common.hpp>
+#include <ecs.hpp>
+#include <random.hpp>
+
+/*
+ * ticks a world of characters, players with health regen and monsters without, through three systems, against the same
+ * characters as heap objects with a virtual tick. both must end in the same state. then churns a tenth of the entities
+ * every round and fails if a destroyed handle still resolves or a living one lost its components
+ */
+inline int ecs_bench(size_t entities, size_t ticks) {
+	struct position { float x, y; };
+	struct velocity { float dx, dy; };
+	struct health { int32_t hp, max; };
+	struct regen { int32_t per_tick; };
+	struct tag { uint32_t n; };
+	constexpr float edge = 1000.0f;
+	auto move = [](position& p, const velocity& v) { p.x += v.dx; p.y += v.dy; };
+	auto bounce = [](position& p, velocity& v)
+		{
+			if (p.x < 0.0f or p.x > edge) v.dx = -v.dx;
+			if (p.y < 0.0f or p.y > edge) v.dy = -v.dy;
+		};
+	auto heal = [](health& h, const regen& r) { h.hp = std::min(h.hp + r.per_tick, h.max); };
+	struct character {
+		uint32_t n{};
+		position p{};
+		velocity v{};
+		health h{};
+		virtual ~character() = default;
+		virtual void tick() {
+			p.x += v.dx; p.y += v.dy;
+			if (p.x < 0.0f or p.x > edge) v.dx = -v.dx;
+			if (p.y < 0.0f or p.y > edge) v.dy = -v.dy;
+		}
+	};
+	struct player : character {
+		regen r{};
+		void tick() override {
+			character::tick();
+			h.hp = std::min(h.hp + r.per_tick, h.max);
+		}
+	};
+	xoshiro256 rng(1);
+	auto real = [&rng](float scale) { return static_cast<float>(rng() >> 40) / (1 << 24) * scale; };
+	world w{};
+	std::vector<std::unique_ptr<character>> objects{};
+	for (uint32_t i = 0; i < entities; i++) {
+		position p{ real(edge), real(edge) };
+		velocity v{ real(2.0f) - 1.0f, real(2.0f) - 1.0f };
+		health h{ static_cast<int32_t>(bounded(rng, 100)), 100 };
+		if (i % 5 < 3) {
+			regen r{ 1 + static_cast<int32_t>(bounded(rng, 3)) };
+			w.create(p, v, h, r, tag{ i });
+			std::unique_ptr<player> o = std::make_unique<player>();
+			o->r = r;
+			objects.push_back(std::move(o));
+		}
+		else {
+			w.create(p, v, h, tag{ i });
+			objects.push_back(std::make_unique<character>());
+		}
+		objects.back()->n = i;
+		objects.back()->p = p;
+		objects.back()->v = v;
+		objects.back()->h = h;
+	}
+	/* scattered like a long running bot's objects would be, not in allocation order */
+	for (size_t i = objects.size(); i > 1; i--) std::swap(objects[i - 1], objects[bounded(rng, i)]);
+	auto per_tick = [ticks](auto fn)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (size_t t = 0; t < ticks; t++) fn();
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / ticks;
+		};
+	double heap = per_tick([&] { for (std::unique_ptr<character>& o : objects) o->tick(); });
+	schedule single(1), parallel{};
+	for (schedule* s : { &single, &parallel })
+		s->add<position, const velocity>("move", move).add<health, const regen>("regen", heal).add<position, velocity>("bounce", bounce);
+	double one = per_tick([&] { single.run(w); });
+	double all = per_tick([&] { parallel.run(w); });
+	/* the world ticked twice as often */
+	for (size_t t = 0; t < ticks; t++) for (std::unique_ptr<character>& o : objects) o->tick();
+	bench_checks checks{};
+	size_t differ = 0;
+	std::vector<const character*> by_tag(entities);
+	for (const std::unique_ptr<character>& o : objects) by_tag[o->n] = o.get();
+	w.each<const tag, const position, const velocity, const health>([&](const tag& t, const position& p, const velocity& v, const health& h)
+		{
+			const character& o = *by_tag[t.n];
+			if (std::memcmp(&o.p, &p, sizeof(p)) or std::memcmp(&o.v, &v, sizeof(v)) or std::memcmp(&o.h, &h, sizeof(h))) differ++;
+		});
+	std::cout << std::format("{0} entities, stages: {1}\n", w.size(), parallel.to_string());
+	std::cout << std::format("heap objects {0:.2f} ms/tick, ecs 1 thread {1:.2f} ms/tick, ecs {2} threads {3:.2f} ms/tick, {4} differ\n",
+		heap, one, parallel.threads(), all, differ);
+	checks.add(differ, "entities differ from the heap objects");
+	/* handles through churn: a tenth destroyed and recreated every round, some gaining or losing regen */
+	std::vector<std::pair<entity, uint32_t>> living{}, dead{};
+	world churn{};
+	for (uint32_t i = 0; i < entities / 10; i++) living.push_back({ churn.create(tag{ i }, position{}), i });
+	uint32_t next = static_cast<uint32_t>(living.size());
+	size_t lost = 0;
+	for (int round = 0; round < 20; round++) {
+		for (size_t k = living.size() / 10; k; k--) {
+			size_t i = bounded(rng, living.size());
+			churn.destroy(living[i].first);
+			dead.push_back(living[i]);
+			living[i] = { churn.create(tag{ next }, position{}), next };
+			next++;
+		}
+		for (size_t k = living.size() / 20; k; k--) {
+			entity e = living[bounded(rng, living.size())].first;
+			if (churn.get<regen>(e)) churn.remove<regen>(e);
+			else churn.add(e, regen{ 1 });
+		}
+		for (const auto& [e, n] : living)
+			if (tag* t = churn.get<tag>(e); not t or t->n not_eq n) lost++;
+		for (const auto& [e, n] : dead)
+			if (churn.alive(e) or churn.get<tag>(e)) lost++;
+		dead.resize(std::min<size_t>(dead.size(), 10'000));
+	}
+	std::cout << std::format("churn: {0} handles lost or resurrected, {1} alive\n", lost, churn.size());
+	checks.add(lost, "handles lost or resurrected");
+	return checks.report();
+}
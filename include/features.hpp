@@ -0,0 +1,89 @@
+#pragma once
+/*
+ * startup configuration. every bot module declares the gateway intents and cache entities it needs,
+ * and the cluster is built from the union of those instead of dpp::i_all_intents + cpol_default.
+ * e.g. features().add({ "giveaway", dpp::i_guilds }).intents() -> dpp::i_guilds
+ */
+#include <dpp/intents.h>
+#include <dpp/message.h> // dpp::cache_policy_t
+#include <dpp/wsclient.h> // dpp::websocket_protocol_t
+#include <format>
+#include <optional>
+
+struct feature {
+	std::string name{};
+	uint32_t intents{};
+	/* cp_aggressive < cp_lazy < cp_none, so the most demanding module wins per entity */
+	dpp::cache_policy_t cache = dpp::cache_policy::cpol_none;
+};
+
+class features {
+	std::vector<feature> list{};
+public:
+	features& add(feature f) {
+		this->list.emplace_back(std::move(f));
+		return *this;
+	}
+	/* every module's name, e.g. to set up per-command state before traffic starts */
+	std::vector<std::string> names() const {
+		std::vector<std::string> out{};
+		for (const feature& f : this->list) out.emplace_back(f.name);
+		return out;
+	}
+	/* minimal intent mask covering every module */
+	uint32_t intents() const {
+		uint32_t mask = 0;
+		for (const feature& f : this->list) mask |= f.intents;
+		return mask;
+	}
+	/* per entity, the most aggressive setting any module asked for */
+	dpp::cache_policy_t cache_policy() const {
+		dpp::cache_policy_t cp = dpp::cache_policy::cpol_none;
+		for (const feature& f : this->list) {
+			cp.user_policy = std::min(cp.user_policy, f.cache.user_policy);
+			cp.emoji_policy = std::min(cp.emoji_policy, f.cache.emoji_policy);
+			cp.role_policy = std::min(cp.role_policy, f.cache.role_policy);
+			cp.channel_policy = std::min(cp.channel_policy, f.cache.channel_policy);
+			cp.guild_policy = std::min(cp.guild_policy, f.cache.guild_policy);
+		}
+		return cp;
+	}
+	/* e.g. "purge, gcreate, lvl (intents: 1, cache u/e/r/c/g: 2/2/2/2/2)" */
+	std::string to_string() const {
+		std::string names{};
+		for (const feature& f : this->list) names += (names.empty() ? "" : ", ") + f.name;
+		dpp::cache_policy_t cp = this->cache_policy();
+		return std::format("{0} (intents: {1}, cache u/e/r/c/g: {2}/{3}/{4}/{5}/{6})", names, this->intents(),
+			static_cast<int>(cp.user_policy), static_cast<int>(cp.emoji_policy), static_cast<int>(cp.role_policy),
+			static_cast<int>(cp.channel_policy), static_cast<int>(cp.guild_policy));
+	}
+};
+
+/*
+ * gateway wire format. ETF is what dpp recommends for production, JSON is easier to debug. the default stays what the
+ * bot always connected with until --bench decode on a capture of its own traffic says another profile is cheaper.
+ * e.g. --gateway etf, json, etf+zlib or json+zlib (default: json+zlib)
+ */
+struct gateway_profile {
+	dpp::websocket_protocol_t protocol = dpp::ws_json;
+	bool compressed = true;
+
+	/* nullopt for anything but the four names, so a typo doesn't quietly connect with something else */
+	static std::optional<gateway_profile> from(std::string_view name) {
+		if (name.empty() or name == "json+zlib") return gateway_profile{};
+		if (name == "etf+zlib") return gateway_profile{ dpp::ws_etf, true };
+		if (name == "etf") return gateway_profile{ dpp::ws_etf, false };
+		if (name == "json") return gateway_profile{ dpp::ws_json, false };
+		return std::nullopt;
+	}
+	std::string to_string() const {
+		return std::format("{0}{1}", (this->protocol == dpp::ws_etf) ? "etf" : "json", this->compressed ? "+zlib" : "");
+	}
+};
+
+/* value following a command line switch. e.g. option(argc, argv, "--gateway") -> "etf" */
+inline std::string_view option(int argc, char* argv[], std::string_view name) {
+	for (int i = 1; i < argc - 1; i++)
+		if (argv[i] == name) return argv[i + 1];
+	return {};
+}
@@ -1,3 +1,4 @@
+#pragma once
 #include <opencv2/opencv.hpp>
 #include <dpp/message.h>
 #include <filesystem>
@@ -5,6 +6,7 @@
 class image {
 	dpp::snowflake id{};
 	cv::Mat img{};
+	bool on_disk = false; /* written to path(), removed again by the destructor */
 public:
 	cv::String path(bool directory = false) {
 		if (directory) return cv::String(".\\cache\\");
@@ -16,6 +18,7 @@ public:
 	/* creates/overlaps a .jpg image */
 	bool image_write(cv::Mat new_img = cv::Mat()) {
 		if (not new_img.empty()) this->img = new_img;
+		this->on_disk = true;
 		return cv::imwrite(this->path(), this->img);
 	}
 	std::vector<int> dim() {
@@ -31,6 +34,8 @@ public:
 			cv::Mat::zeros(dim[0], dim[1], CV_8UC3) + cv::Scalar(BGR[0], BGR[1], BGR[2], BGR[3]) :
 			cv::imread(cv::String(std::format(".\\cache\\{0}.jpg", file_name))));
 	}
+	/* only in memory, for images that are sent with encoded() and never read back from the cache */
+	image(std::vector<int> dim, palette BGR) : img(cv::Mat::zeros(dim[0], dim[1], CV_8UC3) + cv::Scalar(BGR[0], BGR[1], BGR[2], BGR[3])) {}
 	/* adds a image within the original image */
 	image& add_image(std::string file_name, std::vector<int> at) {
 		try {
@@ -45,18 +50,32 @@ public:
 		catch (cv::Exception e) {
 			std::cout << e.what() << std::endl;
 		}
+		return *this;
 	}
 	image& add_line(std::vector<int> pt1, std::vector<int> pt2, palette BGR, int thickness = 1) {
 		cv::line(this->img,
 			cv::Point(std::clamp<int>(pt1[0], 0, this->dim()[1]), std::clamp<int>(pt1[1], 0, this->dim()[0])),
 			cv::Point(std::clamp<int>(pt2[0], 0, this->dim()[1]), std::clamp<int>(pt2[1], 0, this->dim()[0])),
 			cv::Scalar(BGR[0], BGR[1], BGR[2], BGR[3]), thickness);
+		return *this;
 	}
-	image& add_text(cv::String& text, std::vector<int> at, cv::HersheyFonts font, palette BGR, int thickness = 1) {
+	/* @param thickness -1 fills the rectangle */
+	image& add_rectangle(std::vector<int> pt1, std::vector<int> pt2, palette BGR, int thickness = -1) {
+		cv::rectangle(this->img, cv::Point(pt1[0], pt1[1]), cv::Point(pt2[0], pt2[1]), cv::Scalar(BGR[0], BGR[1], BGR[2], BGR[3]), thickness);
+		return *this;
+	}
+	image& add_text(const cv::String& text, std::vector<int> at, cv::HersheyFonts font, palette BGR, int thickness = 1) {
 		cv::putText(this->img, text, cv::Point(at[0], at[1]), font, 1.0, cv::Scalar(BGR[0], BGR[1], BGR[2], BGR[3]), thickness);
+		return *this;
+	}
+	/* the image encoded in memory, e.g. ".png", without another trip through the disk */
+	std::string encoded(const std::string& ext = ".png") {
+		std::vector<uchar> out{};
+		cv::imencode(ext, this->img, out);
+		return std::string(out.begin(), out.end());
 	}
 	~image() {
 		/* this deletes the physical copy and keeps the cloud copy (via discord) */
-		std::filesystem::remove(std::filesystem::path(this->path()));
+		if (this->on_disk) std::filesystem::remove(std::filesystem::path(this->path()));
 	}
 };
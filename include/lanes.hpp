@@ -0,0 +1,317 @@
+#pragma once
+/*
+ * guild-affine execution. every guild hashes to one lane and a lane runs its tasks one at a time, in order,
+ * so state owned by a lane (see guild_local) is mutated without locks.
+ * lanes are spread over one worker thread per core; a worker that runs dry steals whole runnable lanes from the others.
+ * work for another guild is done by posting a task to that guild's lane, never by touching its state directly.
+ * inside a lane, guilds take turns by deficit round robin so one huge guild can't starve the small ones sharing it.
+ */
+#include <dpp/snowflake.h>
+#include <trace.hpp>
+#include <functional>
+#include <utility>
+#include <unordered_map>
+#include <optional>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+
+/* latency histogram (queue wait, run time, round trips), log2 buckets of nanoseconds */
+struct queue_latency {
+	uint64_t count{}, total_ns{}, max_ns{};
+	std::array<uint64_t, 48> buckets{};
+	void add(uint64_t ns) {
+		this->count++;
+		this->total_ns += ns;
+		this->max_ns = std::max(this->max_ns, ns);
+		this->buckets[std::min<size_t>(std::bit_width(ns), this->buckets.size() - 1)]++;
+	}
+	/* upper bound of the bucket holding the p-th percentile (0..1), in milliseconds */
+	double percentile(double p) const {
+		uint64_t seen = 0, want = static_cast<uint64_t>(std::ceil(p * this->count));
+		for (size_t i = 0; i < this->buckets.size(); i++)
+			if ((seen += this->buckets[i]) >= want and seen) return std::min<double>(static_cast<double>(1ull << i), this->max_ns) / 1e6;
+		return this->max_ns / 1e6;
+	}
+	void merge(const queue_latency& other) {
+		this->count += other.count;
+		this->total_ns += other.total_ns;
+		this->max_ns = std::max(this->max_ns, other.max_ns);
+		for (size_t i = 0; i < this->buckets.size(); i++) this->buckets[i] += other.buckets[i];
+	}
+	double mean() const {
+		return (this->count) ? this->total_ns / 1e6 / this->count : 0.0;
+	}
+};
+
+class lanes {
+	struct task_t {
+		std::function<void()> run{};
+		std::chrono::steady_clock::time_point queued{};
+		uint64_t trace{}; /* trace_current when it was posted */
+	};
+	struct guild_queue {
+		std::deque<task_t> tasks{};
+		double weight = 1.0, deficit = 0.0;
+		bool active = false;
+		queue_latency latency{};
+	};
+	struct lane {
+		std::mutex lock{};
+		std::unordered_map<dpp::snowflake, guild_queue> guilds{}; /* only guilds with queued tasks or a weight set */
+		std::unordered_map<dpp::snowflake, queue_latency> retired{}; /* waits of guilds whose queue went, until latency() */
+		std::deque<dpp::snowflake> active{}; /* guilds with queued tasks, in round-robin order */
+		bool scheduled = false; /* queued on a worker or running */
+	};
+	struct worker {
+		std::mutex lock{};
+		std::deque<size_t> runnable{};
+		queue_latency handlers{}; /* time spent running tasks, guarded by lock */
+	};
+	/* tasks a lane may run before going back in line, so one busy lane can't hold a worker */
+	static constexpr size_t batch = 32;
+	std::vector<std::unique_ptr<lane>> lane_list{};
+	std::vector<std::unique_ptr<worker>> workers{};
+	std::mutex idle_lock{};
+	std::condition_variable_any idle{};
+	std::atomic<size_t> runnable{};
+	std::atomic<size_t> outstanding{}; /* posted and not yet finished */
+	std::vector<std::jthread> threads{}; /* last, so workers stop before the lanes go away */
+	static inline thread_local size_t running = -1;
+
+	void schedule(size_t l, size_t w) {
+		{
+			std::lock_guard<std::mutex> g(this->workers[w]->lock);
+			this->workers[w]->runnable.emplace_back(l);
+		}
+		this->runnable++;
+		{ std::lock_guard<std::mutex> g(this->idle_lock); } /* a worker between its check and its wait can't miss this */
+		this->idle.notify_one();
+	}
+	/* own lanes oldest first, then the newest lane of another worker */
+	std::optional<size_t> take(size_t w) {
+		for (size_t i = 0; i < this->workers.size(); i++) {
+			worker& from = *this->workers[(w + i) % this->workers.size()];
+			std::lock_guard<std::mutex> g(from.lock);
+			if (from.runnable.empty()) continue;
+			size_t l = (i == 0) ? from.runnable.front() : from.runnable.back();
+			(i == 0) ? from.runnable.pop_front() : from.runnable.pop_back();
+			this->runnable--;
+			return l;
+		}
+		return std::nullopt;
+	}
+	/*
+	 * deficit round robin over the lane's guilds: each turn a guild earns weight tasks of credit and runs while it has
+	 * at least one, so a guild with a thousand queued clicks gets the same turns as one with a single command.
+	 * must hold the lane's lock
+	 */
+	std::optional<task_t> next(lane& current) {
+		while (not current.active.empty()) {
+			dpp::snowflake id = current.active.front();
+			guild_queue& q = current.guilds[id];
+			if (q.deficit < 1.0) q.deficit += q.weight;
+			if (q.deficit < 1.0) { /* weights below 1 save up over several turns */
+				current.active.pop_front();
+				current.active.emplace_back(id);
+				continue;
+			}
+			task_t task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			q.deficit -= 1.0;
+			q.latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - task.queued).count());
+			if (q.tasks.empty()) {
+				current.active.pop_front();
+				q.active = false;
+				q.deficit = 0.0;
+				/* nothing left to remember, the next post starts it over */
+				if (q.weight == 1.0) {
+					current.retired[id].merge(q.latency);
+					current.guilds.erase(id);
+				}
+			}
+			else if (q.deficit < 1.0) {
+				current.active.pop_front();
+				current.active.emplace_back(id);
+			}
+			return task;
+		}
+		return std::nullopt;
+	}
+	void run(size_t l, size_t w) {
+		lane& current = *this->lane_list[l];
+		running = l;
+		for (size_t i = 0; i < batch; i++) {
+			std::optional<task_t> task{};
+			{
+				std::lock_guard<std::mutex> g(current.lock);
+				if (not (task = this->next(current))) break;
+			}
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			trace_scope scope(task->trace);
+			if (task->trace) trace_span("queue", task->trace, trace_time(task->queued), trace_time(start));
+			try {
+				span s("lane");
+				task->run();
+			}
+			catch (std::exception& e) {
+				std::cout << e.what() << std::endl;
+			}
+			{
+				std::lock_guard<std::mutex> g(this->workers[w]->lock);
+				this->workers[w]->handlers.add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			}
+			this->outstanding--;
+		}
+		running = -1;
+		{
+			std::lock_guard<std::mutex> g(current.lock);
+			if (current.active.empty()) {
+				current.scheduled = false;
+				return;
+			}
+		}
+		this->schedule(l, w); /* the stealer keeps the lane it took */
+	}
+	void loop(std::stop_token stop, size_t w) {
+		while (not stop.stop_requested()) {
+			if (std::optional<size_t> l = this->take(w)) {
+				this->run(*l, w);
+				continue;
+			}
+			std::unique_lock<std::mutex> g(this->idle_lock);
+			this->idle.wait(g, stop, [this] { return this->runnable > 0; });
+		}
+	}
+public:
+	/* tasks a guild may have queued before post() turns more away */
+	size_t limit = 256;
+
+	/* @param threads worker threads, one per core by default. @param per_thread lanes per worker */
+	lanes(size_t threads = std::thread::hardware_concurrency(), size_t per_thread = 4) {
+		threads = std::max<size_t>(threads, 1);
+		for (size_t i = 0; i < threads * per_thread; i++) this->lane_list.emplace_back(std::make_unique<lane>());
+		for (size_t i = 0; i < threads; i++) this->workers.emplace_back(std::make_unique<worker>());
+		for (size_t i = 0; i < threads; i++) this->threads.emplace_back([this, i](std::stop_token stop) { this->loop(stop, i); });
+	}
+	size_t size() const {
+		return this->lane_list.size();
+	}
+	size_t lane_of(dpp::snowflake guild) const {
+		return static_cast<size_t>((static_cast<uint64_t>(guild) * 0x9E3779B97F4A7C15ull) >> 32) % this->lane_list.size();
+	}
+	/* true when called from a task running on guild's lane */
+	bool on_lane(dpp::snowflake guild) const {
+		return running == this->lane_of(guild);
+	}
+	/* false when the guild already has limit tasks queued, the task is dropped */
+	bool post(dpp::snowflake guild, std::function<void()> task) {
+		size_t l = this->lane_of(guild);
+		lane& target = *this->lane_list[l];
+		{
+			std::lock_guard<std::mutex> g(target.lock);
+			guild_queue& q = target.guilds[guild];
+			if (q.tasks.size() >= this->limit) return false;
+			q.tasks.emplace_back(std::move(task), std::chrono::steady_clock::now(), trace_current);
+			this->outstanding++;
+			if (not std::exchange(q.active, true)) target.active.emplace_back(guild);
+			if (std::exchange(target.scheduled, true)) return true;
+		}
+		this->schedule(l, l % this->workers.size());
+		return true;
+	}
+	/*
+	 * posts task once to every lane, called with the lane's index, e.g. to visit guild_local state lane by lane.
+	 * each goes in under the smallest id hashing to that lane, real guild ids are far larger.
+	 * returns how many lanes turned it away (their queue for that id was full), those never run task
+	 */
+	size_t post_each(std::function<void(size_t lane)> task) {
+		size_t refused = 0;
+		for (size_t l = 0; l < this->lane_list.size(); l++) {
+			uint64_t key = 1;
+			while (this->lane_of(key) not_eq l) key++;
+			if (not this->post(key, [task, l] { task(l); })) refused++;
+		}
+		return refused;
+	}
+	/* share of its lane a guild gets relative to others, e.g. 2.0 for premium guilds. default 1.0 */
+	void set_weight(dpp::snowflake guild, double weight) {
+		lane& target = *this->lane_list[this->lane_of(guild)];
+		std::lock_guard<std::mutex> g(target.lock);
+		guild_queue& q = target.guilds[guild];
+		q.weight = std::max(weight, 0.01);
+		if (q.weight == 1.0 and not q.active) {
+			target.retired[guild].merge(q.latency);
+			target.guilds.erase(guild);
+		}
+	}
+	/* queue latency of every guild that ran tasks since the last call */
+	std::vector<std::pair<dpp::snowflake, queue_latency>> latency() {
+		std::vector<std::pair<dpp::snowflake, queue_latency>> out{};
+		for (std::unique_ptr<lane>& l : this->lane_list) {
+			std::unordered_map<dpp::snowflake, queue_latency> waits{};
+			{
+				std::lock_guard<std::mutex> g(l->lock);
+				waits.swap(l->retired);
+				for (auto& [guild, q] : l->guilds) {
+					waits[guild].merge(q.latency);
+					q.latency = {};
+				}
+			}
+			for (auto& [guild, wait] : waits)
+				if (wait.count) out.emplace_back(guild, wait);
+		}
+		return out;
+	}
+	/* time tasks took to run, across every worker */
+	queue_latency run_time() {
+		queue_latency out{};
+		for (std::unique_ptr<worker>& w : this->workers) {
+			std::lock_guard<std::mutex> g(w->lock);
+			out.merge(w->handlers);
+		}
+		return out;
+	}
+	/* guilds with a queue kept, the ones with tasks queued or a weight set */
+	size_t tracked() {
+		size_t out = 0;
+		for (std::unique_ptr<lane>& l : this->lane_list) {
+			std::lock_guard<std::mutex> g(l->lock);
+			out += l->guilds.size();
+		}
+		return out;
+	}
+	/* tasks posted and not finished yet, across every guild */
+	size_t queued() const {
+		return this->outstanding;
+	}
+	/* true once every posted task, including ones posted by other tasks, has finished */
+	bool drained() const {
+		return this->outstanding == 0;
+	}
+};
+
+/* per-guild state owned by lanes. a guild's entry may only be touched from a task running on that guild's lane */
+template<typename T> class guild_local {
+	const lanes& owner;
+	std::vector<std::unordered_map<dpp::snowflake, T>> by_lane{};
+public:
+	guild_local(const lanes& owner) : owner(owner), by_lane(owner.size()) {}
+	T& of(dpp::snowflake guild) {
+		return this->by_lane[this->owner.lane_of(guild)][guild];
+	}
+	void erase(dpp::snowflake guild) {
+		this->by_lane[this->owner.lane_of(guild)].erase(guild);
+	}
+	/* every guild on a lane, only from a task running on it (see lanes::post_each) */
+	template<typename F> void each(size_t lane, F fn) {
+		for (auto& [guild, state] : this->by_lane[lane]) fn(guild, state);
+	}
+};
@@ -0,0 +1,78 @@
+#pragma once
+/*
+ * guild lanes against a shared mutex, and how fair their turns are. e.g. neko.exe --bench lanes
+ */
+#include <bench_common.hpp>
+#include <lanes.hpp>
+
+/*
+ * guild lanes against one mutex around a shared map (the old _giveaway pattern), same zipf-skewed task stream.
+ * every task bumps its guild's counter and does a little unrelated work.
+ */
+inline int lanes_bench(size_t tasks, size_t guild_count, double s) {
+	std::vector<dpp::snowflake> stream = zipf_guilds(tasks, guild_count, s);
+	size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	std::atomic<uint64_t> sink{};
+
+	std::unordered_map<dpp::snowflake, uint64_t> shared{};
+	std::mutex shared_lock{};
+	std::atomic<size_t> next{};
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		std::vector<std::jthread> pool{};
+		for (size_t t = 0; t < threads; t++) pool.emplace_back([&] {
+			for (size_t i; (i = next++) < stream.size();) {
+				uint64_t v;
+				{
+					std::lock_guard<std::mutex> g(shared_lock);
+					v = ++shared[stream[i]];
+				}
+				sink += busy(v);
+			}
+		});
+	}
+	double mutex_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::atomic<size_t> done{};
+	start = std::chrono::steady_clock::now();
+	{
+		lanes pool(threads);
+		pool.limit = stream.size();
+		guild_local<uint64_t> state(pool);
+		for (dpp::snowflake guild : stream) pool.post(guild, [&state, &sink, &done, guild] {
+			sink += busy(++state.of(guild));
+			done++;
+		});
+		while (done < stream.size()) std::this_thread::yield();
+	}
+	double lanes_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << std::format("{0} tasks, {1} guilds, zipf s={2}, {3} threads\n", tasks, guild_count, s, threads)
+		<< std::format("mutex: {0:.0f} tasks/s\n", tasks / mutex_s)
+		<< std::format("lanes: {0:.0f} tasks/s\n", tasks / lanes_s);
+	return 0;
+}
+
+/*
+ * one guild floods its lane while small guilds hashed to the same lane send a task now and then.
+ * with fair turns the small guilds' p99 wait stays near one task's run time instead of the flood's backlog.
+ */
+inline int fairness_bench(size_t flood, size_t small_guilds) {
+	lanes pool(1, 1); /* one lane, so every guild competes for it */
+	pool.limit = flood;
+	std::atomic<size_t> done{};
+	std::atomic<uint64_t> sink{};
+	dpp::snowflake big = 1ull << 22;
+	for (size_t i = 0; i < flood; i++) {
+		pool.post(big, [&, i] { sink += busy(i, 2000); done++; });
+		if (i % (flood / small_guilds) == 0) pool.post((i + 2) << 22, [&, i] { sink += busy(i, 2000); done++; });
+	}
+	while (done < flood + small_guilds) std::this_thread::yield();
+	queue_latency others{};
+	for (const auto& [guild, wait] : pool.latency()) {
+		if (guild == big) std::cout << std::format("flooding guild: {0} tasks, p50 {1:.2f} ms, p99 {2:.2f} ms\n", wait.count, wait.percentile(0.5), wait.percentile(0.99));
+		else others.merge(wait);
+	}
+	std::cout << std::format("small guilds:   {0} tasks, p50 {1:.2f} ms, p99 {2:.2f} ms", others.count, others.percentile(0.5), others.percentile(0.99)) << std::endl;
+	return 0;
+}
@@ -0,0 +1,239 @@
+#pragma once
+/*
+ * loot and gacha drops. a weighted table is compiled into Vose's alias tables, so a drop costs two bounded draws
+ * however many items there are. weights stay integers all the way through, so every table and every pull comes out the
+ * same on any compiler. big tables are cut into blocks under a table of block totals; changing one rate rebuilds its
+ * block and the small top table, not the whole thing.
+ * a banner adds rarity tiers and pity on top. every pull draws from its own engine, seeded from the player's seed and
+ * the pull's number, so any single pull can be audited from its record without replaying everything before it, as long
+ * as the rates haven't changed since: every rate change starts a new epoch and a record from another one is refused.
+ * e.g. drop_table t(weights); size_t item = t.sample(rng); banner b(tiers); std::array<loot_pull, 10> ten{}; b.pull(player, ten);
+ */
+#include <random.hpp>
+#include <vector>
+#include <span>
+#include <array>
+#include <string>
+#include <numeric>
+#include <shared_mutex>
+#include <mutex>
+#include <stdexcept>
+#include <algorithm>
+#include <optional>
+
+/* Vose's alias method over integer weights, exact: column c keeps itself with odds prob[c] / total, otherwise alias[c] */
+class alias_table {
+	std::vector<uint64_t> prob{}; /* weight * size, compared against total */
+	std::vector<uint32_t> alias{};
+	uint64_t sum{};
+public:
+	alias_table() = default;
+	explicit alias_table(std::span<const uint64_t> weights) {
+		this->build(weights);
+	}
+	/* weights * size must fit 64 bits. a table of all zero weights is empty */
+	void build(std::span<const uint64_t> weights) {
+		size_t n = weights.size();
+		this->sum = std::accumulate(weights.begin(), weights.end(), uint64_t{});
+		this->prob.assign(n, 0);
+		this->alias.resize(n);
+		if (not this->sum) return;
+		std::vector<uint32_t> small{}, large{};
+		for (size_t i = 0; i < n; i++) {
+			this->prob[i] = weights[i] * n;
+			this->alias[i] = static_cast<uint32_t>(i);
+			((this->prob[i] < this->sum) ? small : large).push_back(static_cast<uint32_t>(i));
+		}
+		while (not small.empty() and not large.empty()) {
+			uint32_t s = small.back(), l = large.back();
+			small.pop_back();
+			this->alias[s] = l;
+			/* l gives s the rest of its column */
+			this->prob[l] -= this->sum - this->prob[s];
+			if (this->prob[l] < this->sum) {
+				large.pop_back();
+				small.push_back(l);
+			}
+		}
+		/* with exact arithmetic whatever is left is a full column already */
+		for (uint32_t i : large) this->prob[i] = this->sum;
+		for (uint32_t i : small) this->prob[i] = this->sum;
+	}
+	size_t size() const {
+		return this->prob.size();
+	}
+	uint64_t total() const {
+		return this->sum;
+	}
+	/* an index drawn with odds weight / total. the table must not be empty */
+	template<typename G> size_t sample(G& rng) const {
+		size_t column = bounded(rng, this->prob.size());
+		return (bounded(rng, this->sum) < this->prob[column]) ? column : this->alias[column];
+	}
+	/* each index's share of the columns, weight * size when the table is right */
+	std::vector<uint64_t> masses() const {
+		std::vector<uint64_t> out(this->prob.size());
+		for (size_t c = 0; c < this->prob.size(); c++) {
+			out[c] += this->prob[c];
+			out[this->alias[c]] += this->sum - this->prob[c];
+		}
+		return out;
+	}
+};
+
+/* items in blocks of an alias table each, under an alias table of block totals, so set() only rebuilds one block */
+class drop_table {
+	std::vector<uint64_t> weights{};
+	std::vector<alias_table> blocks{};
+	std::vector<uint64_t> totals{};
+	alias_table top{};
+	size_t block;
+public:
+	explicit drop_table(std::vector<uint64_t> weights = {}, size_t block = 256) : weights(std::move(weights)), block(block) {
+		for (size_t begin = 0; begin < this->weights.size(); begin += this->block) {
+			this->blocks.emplace_back(std::span(this->weights).subspan(begin, std::min(this->block, this->weights.size() - begin)));
+			this->totals.push_back(this->blocks.back().total());
+		}
+		this->top.build(this->totals);
+	}
+	/* changes one item's weight, rebuilding its block and the top table */
+	void set(size_t item, uint64_t weight) {
+		size_t b = item / this->block, begin = b * this->block;
+		this->weights.at(item) = weight;
+		this->blocks[b].build(std::span(this->weights).subspan(begin, std::min(this->block, this->weights.size() - begin)));
+		this->totals[b] = this->blocks[b].total();
+		this->top.build(this->totals);
+	}
+	size_t size() const {
+		return this->weights.size();
+	}
+	uint64_t weight(size_t item) const {
+		return this->weights[item];
+	}
+	uint64_t total() const {
+		return this->top.total();
+	}
+	/* an item drawn with odds weight / total. the table must have some weight */
+	template<typename G> size_t sample(G& rng) const {
+		size_t b = this->top.sample(rng);
+		return b * this->block + this->blocks[b].sample(rng);
+	}
+	/* the alias tables, top first, for checking them */
+	template<typename F> void each_table(F fn) const {
+		fn(this->top, std::span<const uint64_t>(this->totals));
+		for (size_t b = 0; b < this->blocks.size(); b++)
+			fn(this->blocks[b], std::span<const uint64_t>(this->weights).subspan(b * this->block, this->blocks[b].size()));
+	}
+};
+
+/* a rarity tier of a banner, the rarest first */
+struct loot_tier {
+	std::string name{};
+	uint64_t weight{};
+	drop_table items{};
+	uint32_t hard_pity{}; /* guaranteed by this many pulls without it (or anything rarer), 0 for never */
+	uint32_t soft_pity{}; /* for the rarest tier with a hard pity: from this many pulls on, its weight grows by soft_step each pull */
+	uint64_t soft_step{};
+};
+
+/* what a player carries between pulls */
+struct loot_player {
+	static constexpr size_t max_tiers = 8;
+	uint64_t seed{}, pulls{};
+	std::array<uint32_t, max_tiers> since{}; /* pulls since each tier or a rarer one dropped */
+};
+
+/* one pull, enough to audit it on its own with banner::replay */
+struct loot_pull {
+	uint64_t number{}, epoch{}; /* the banner's rates when it was made, see banner::epoch() */
+	std::array<uint32_t, loot_player::max_tiers> since{}; /* before the pull */
+	uint32_t tier{}, item{};
+};
+
+/* tiers and pity. pulls from any thread, rates changed with set() in between */
+class banner {
+	mutable std::shared_mutex lock{};
+	std::vector<loot_tier> tiers{};
+	std::vector<alias_table> by_step{}; /* tier tables, one per step of soft pity */
+	uint64_t rates{}; /* epoch, bumped by every rate change */
+
+	void build_tiers() {
+		const loot_tier& rarest = this->tiers[0];
+		uint32_t steps = (rarest.hard_pity and rarest.soft_pity and rarest.soft_pity < rarest.hard_pity) ? rarest.hard_pity - rarest.soft_pity : 0;
+		this->by_step.clear();
+		std::vector<uint64_t> weights{};
+		for (const loot_tier& t : this->tiers) weights.push_back(t.weight);
+		for (uint32_t step = 0; step <= steps; step++) {
+			weights[0] = rarest.weight + rarest.soft_step * step;
+			this->by_step.emplace_back(weights);
+		}
+	}
+	/* must hold lock. one pull with its own engine */
+	loot_pull draw(uint64_t seed, uint64_t number, const std::array<uint32_t, loot_player::max_tiers>& since) const {
+		uint64_t key = number;
+		xoshiro256 rng(seed ^ splitmix64(key));
+		loot_pull p{ number, this->rates, since };
+		p.tier = static_cast<uint32_t>(this->tiers.size());
+		for (uint32_t t = 0; t < this->tiers.size(); t++)
+			if (this->tiers[t].hard_pity and since[t] + 1 >= this->tiers[t].hard_pity) {
+				p.tier = t;
+				break;
+			}
+		if (p.tier == this->tiers.size()) {
+			const loot_tier& rarest = this->tiers[0];
+			size_t step = (rarest.soft_pity and since[0] + 1 > rarest.soft_pity) ? since[0] + 1 - rarest.soft_pity : 0;
+			p.tier = static_cast<uint32_t>(this->by_step[std::min(step, this->by_step.size() - 1)].sample(rng));
+		}
+		p.item = static_cast<uint32_t>(this->tiers[p.tier].items.sample(rng));
+		return p;
+	}
+public:
+	/* every tier needs an item with weight, the rarest comes first */
+	explicit banner(std::vector<loot_tier> tiers) : tiers(std::move(tiers)) {
+		if (this->tiers.empty() or this->tiers.size() > loot_player::max_tiers) throw std::invalid_argument("a banner has 1 to 8 tiers");
+		this->build_tiers();
+	}
+	/*
+	 * out.size() pulls in one pass, e.g. 10 for a 10-pull, carrying player's pity from one to the next.
+	 * player.seed is theirs for good (random_seed() on their first pull), the pulls are numbered from it
+	 */
+	void pull(loot_player& player, std::span<loot_pull> out) const {
+		std::shared_lock<std::shared_mutex> g(this->lock);
+		for (loot_pull& p : out) {
+			p = this->draw(player.seed, player.pulls++, player.since);
+			for (uint32_t t = 0; t < this->tiers.size(); t++) player.since[t] = (t < p.tier) ? player.since[t] + 1 : 0;
+		}
+	}
+	/*
+	 * the pull a record says happened, drawn again from the record alone. nullopt if the rates changed since it was
+	 * made, it would draw under the wrong ones; audit those against a banner built with the rates of their epoch
+	 */
+	std::optional<loot_pull> replay(uint64_t seed, const loot_pull& record) const {
+		std::shared_lock<std::shared_mutex> g(this->lock);
+		if (record.epoch not_eq this->rates) return std::nullopt;
+		return this->draw(seed, record.number, record.since);
+	}
+	/* changes one item's rate and starts a new epoch. keep each epoch's rates with the records made under them */
+	void set(uint32_t tier, size_t item, uint64_t weight) {
+		std::unique_lock<std::shared_mutex> g(this->lock);
+		this->tiers.at(tier).items.set(item, weight);
+		this->rates++;
+	}
+	void set_tier(uint32_t tier, uint64_t weight) {
+		std::unique_lock<std::shared_mutex> g(this->lock);
+		this->tiers.at(tier).weight = weight;
+		this->build_tiers();
+		this->rates++;
+	}
+	/* how many times the rates have changed, pulls carry it */
+	uint64_t epoch() const {
+		std::shared_lock<std::shared_mutex> g(this->lock);
+		return this->rates;
+	}
+	size_t size() const {
+		return this->tiers.size();
+	}
+	const loot_tier& tier(uint32_t t) const {
+		return this->tiers[t];
+	}
+};
@@ -0,0 +1,89 @@
+#pragma once
+/*
+ * drop tables and banners. e.g. neko.exe --bench loot
+ */
+#include <bench_common.hpp>
+#include <loot.hpp>
+#include <random.hpp>
+
+/*
+ * a drop table of thousands of items against discrete_distribution and a linear scan, then a banner's 10-pulls. fails if
+ * any alias table doesn't hold exactly its weights (before and after changing rates), if the drops are off their odds,
+ * if pity is ever overrun, if a pull's record doesn't replay to the same drop or still replays after a rate change
+ */
+inline int loot_bench(size_t items, size_t rounds) {
+	xoshiro256 rng(1);
+	std::vector<uint64_t> weights(items);
+	for (uint64_t& w : weights) w = 1 + bounded(rng, 1000);
+	bench_checks checks{};
+	auto exact = [&checks](const drop_table& t)
+		{
+			t.each_table([&checks](const alias_table& a, std::span<const uint64_t> w)
+				{
+					std::vector<uint64_t> m = a.masses();
+					for (size_t i = 0; i < w.size(); i++) checks.expect(not a.total() or m[i] == w[i] * w.size(), "alias table holds its weights");
+				});
+		};
+	std::vector<int> calls(1024);
+	uint64_t sink = 0;
+	std::mt19937_64 engine(1);
+	std::discrete_distribution<size_t> discrete(weights.begin(), weights.end());
+	double standard = cpu_per_item(calls, [&](int) { sink += discrete(engine); });
+	uint64_t sum = std::accumulate(weights.begin(), weights.end(), uint64_t{});
+	double scan = cpu_per_item(calls, [&](int)
+		{
+			uint64_t x = bounded(rng, sum);
+			size_t i = 0;
+			while (x >= weights[i]) x -= weights[i++];
+			sink += i;
+		});
+	alias_table flat(weights);
+	double single = cpu_per_item(calls, [&](int) { sink += flat.sample(rng); });
+	drop_table table(weights);
+	double blocked = cpu_per_item(calls, [&](int) { sink += table.sample(rng); });
+	exact(table);
+	double rebuild = cpu_per_item(std::vector<int>(1), [&](int) { flat.build(weights); });
+	double update = cpu_per_item(calls, [&](int) { size_t i = bounded(rng, items); table.set(i, weights[i] = 1 + bounded(rng, 1000)); });
+	exact(table);
+	/* chi-square of 1000 draws per item on average, allowing six standard deviations */
+	std::vector<uint64_t> seen(items);
+	for (size_t i = 0; i < items * 1000; i++) seen[table.sample(rng)]++;
+	double chi = 0.0, expected_total = static_cast<double>(table.total());
+	for (size_t i = 0; i < items; i++) {
+		double expected = items * 1000.0 * weights[i] / expected_total;
+		chi += (seen[i] - expected) * (seen[i] - expected) / expected;
+	}
+	double dof = items - 1.0, limit = dof + 6.0 * std::sqrt(2.0 * dof);
+	checks.expect(chi <= limit, "drops on their odds");
+	std::cout << std::format("{0} items: discrete_distribution {1:.1f} ns, linear scan {2:.1f} ns, alias {3:.1f} ns, blocked alias {4:.1f} ns per drop\n",
+		items, standard, scan, single, blocked);
+	std::cout << std::format("rate change: full rebuild {0:.1f} us, blocked {1:.1f} us. chi-square {2:.0f} for {3:.0f} degrees of freedom (limit {4:.0f})\n",
+		rebuild / 1e3, update / 1e3, chi, dof, limit);
+	/* 6 + 51 + 943 per mille, the rarest guaranteed by 90 with rising odds from 74, the middle one by 10 */
+	std::vector<uint64_t> five(10, 1), four(30, 1), three(items, 1);
+	banner b({ { "5", 6, drop_table(five), 90, 74, 60 }, { "4", 51, drop_table(four), 10 }, { "3", 943, drop_table(three) } });
+	loot_player player{ 42 };
+	std::vector<std::array<loot_pull, 10>> history(rounds);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (std::array<loot_pull, 10>& ten : history) b.pull(player, ten);
+	double per_ten = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+	std::array<size_t, 3> drops{};
+	size_t overrun = 0, differ = 0;
+	for (const std::array<loot_pull, 10>& ten : history)
+		for (const loot_pull& p : ten) {
+			drops[p.tier]++;
+			if (p.since[0] >= 90 or p.since[1] >= 10) overrun++;
+			std::optional<loot_pull> again = b.replay(player.seed, p);
+			if (not again or again->tier not_eq p.tier or again->item not_eq p.item) differ++;
+		}
+	/* once a rate changes, every earlier record must be refused rather than drawn under the new rates */
+	b.set(0, 0, 2);
+	size_t stale = std::ranges::count_if(history, [&](const std::array<loot_pull, 10>& ten) { return b.replay(player.seed, ten[0]).has_value(); });
+	std::cout << std::format("banner: {0:.0f} ns per 10-pull, {1:.2f}% / {2:.2f}% / {3:.2f}% by tier, {4} pity overruns, {5} pulls replay differently, "
+		"{6} replayed after a rate change\n", per_ten, 100.0 * drops[0] / (rounds * 10), 100.0 * drops[1] / (rounds * 10), 100.0 * drops[2] / (rounds * 10), overrun, differ, stale);
+	checks.add(overrun, "pity overruns");
+	checks.add(differ, "pulls replay differently");
+	checks.add(stale, "pulls replayed after a rate change");
+	std::cout << std::format("(sink {0})\n", sink & 1);
+	return checks.report();
+}
@@ -0,0 +1,425 @@
+#pragma once
+/*
+ * the player market. every item has an order book of limit orders matched by price, then time: a new order trades with
+ * the best opposite price first and the oldest order first within a price, at the resting order's price, and whatever
+ * is left of it rests, unless matching reached one of the same user's orders: nobody trades with themselves, so the
+ * rest of the order is dropped instead of crossing their own. prices are ordered maps of levels and a level is a queue of orders linked through a slab, so
+ * placing and cancelling cost O(log levels) and every fill after the first is O(1).
+ * a guild's market is part of its state and only touched from its lane, the lane is its one writer so nothing is locked.
+ * every item, order, cancel and fill is appended to the guild's journal and flushed before the reply goes out. after a
+ * restart the first use replays the journal's orders and cancels; matching is deterministic, so the fills come out the
+ * same and are checked against the journaled ones. a record cut short at the end is trimmed, one failing its checksum
+ * anywhere else is skipped and counted (see corrupted()), never cut off with everything after it. a file that isn't a journal is never
+ * touched, the market stays closed instead. a write that fails makes place() and cancel() return nothing and closes the
+ * market (opened() is false) until open() replays the journal again, so memory never runs ahead of the file. the journal
+ * is only held open while it's used, see close_idle().
+ * a market holds at most max_items books; once it's full, a new name takes over a book nobody has an order in.
+ * e.g. market& m = guilds->of(guild).trades; std::vector<fill> fills{}; m.place(user, "sword", os_sell, 120, 3, fills);
+ *
+ * journal: "NEKOMKT2", then a 64 byte market_record per record, little endian, each ending in a crc32 of the rest. an
+ * mr_item record holds its name in place of the order fields, so every record is the same size and a bad one, its name
+ * length included, can't throw the records after it out of line
+ */
+#include <unordered_map>
+#include <map>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <cstring>
+#include <cstddef>
+#include <array>
+#include <optional>
+#include <chrono>
+
+enum order_side : uint8_t { os_buy, os_sell };
+
+/* one trade between a buy and a sell order */
+struct fill {
+	uint64_t buy{}, sell{}; /* order ids */
+	uint64_t buyer{}, seller{};
+	int64_t price{};
+	uint64_t quantity{};
+	order_side taker{}; /* the side of the order that came in and matched */
+};
+
+/* one item's resting orders. not thread safe */
+class order_book {
+	static constexpr uint32_t none = ~0u;
+	struct node {
+		uint64_t id{}, user{}, quantity{};
+		int64_t price{};
+		uint32_t prev = none, next = none;
+		order_side side{};
+	};
+	/* the orders at one price, oldest at head */
+	struct level {
+		uint32_t head = none, tail = none, orders{};
+		uint64_t quantity{};
+	};
+	std::vector<node> nodes{};
+	std::vector<uint32_t> free_nodes{};
+	std::unordered_map<uint64_t, uint32_t> by_id{};
+	std::map<int64_t, level, std::greater<>> bids{}; /* best, the highest, first */
+	std::map<int64_t, level, std::less<>> asks{}; /* best, the lowest, first */
+
+	void unlink(level& l, uint32_t i) {
+		node& n = this->nodes[i];
+		((n.prev == none) ? l.head : this->nodes[n.prev].next) = n.next;
+		((n.next == none) ? l.tail : this->nodes[n.next].prev) = n.prev;
+		l.quantity -= n.quantity;
+		l.orders--;
+		this->by_id.erase(n.id);
+		this->free_nodes.push_back(i);
+	}
+	/* fills quantity against the opposite levels up to price, returns what's left. stops with self set at user's own order */
+	template<typename M> uint64_t take(M& levels, order_side side, uint64_t id, uint64_t user, int64_t price, uint64_t quantity, std::vector<fill>& out, bool& self) {
+		while (quantity and not levels.empty()) {
+			auto it = levels.begin();
+			if ((side == os_buy) ? it->first > price : it->first < price) break;
+			level& l = it->second;
+			while (quantity and l.head not_eq none) {
+				uint32_t i = l.head;
+				node& n = this->nodes[i];
+				if (n.user == user) {
+					self = true;
+					return quantity;
+				}
+				uint64_t q = std::min(quantity, n.quantity);
+				out.push_back((side == os_buy) ? fill{ id, n.id, user, n.user, it->first, q, side } : fill{ n.id, id, n.user, user, it->first, q, side });
+				quantity -= q;
+				n.quantity -= q;
+				l.quantity -= q;
+				if (not n.quantity) this->unlink(l, i);
+			}
+			if (l.head == none) levels.erase(it);
+		}
+		return quantity;
+	}
+	template<typename M> void rest(M& levels, order_side side, uint64_t id, uint64_t user, int64_t price, uint64_t quantity) {
+		uint32_t i{};
+		if (this->free_nodes.empty()) {
+			i = static_cast<uint32_t>(this->nodes.size());
+			this->nodes.emplace_back();
+		}
+		else {
+			i = this->free_nodes.back();
+			this->free_nodes.pop_back();
+		}
+		level& l = levels[price];
+		this->nodes[i] = { id, user, quantity, price, l.tail, none, side };
+		((l.tail == none) ? l.head : this->nodes[l.tail].next) = i;
+		l.tail = i;
+		l.orders++;
+		l.quantity += quantity;
+		this->by_id.emplace(id, i);
+	}
+	template<typename M> static std::vector<std::pair<int64_t, uint64_t>> top(const M& levels, size_t n) {
+		std::vector<std::pair<int64_t, uint64_t>> out{};
+		for (auto it = levels.begin(); it not_eq levels.end() and out.size() < n; ++it) out.emplace_back(it->first, it->second.quantity);
+		return out;
+	}
+public:
+	/*
+	 * matches order id (unique, ids only grow) and rests what's left, or drops it if matching reached one of user's own
+	 * orders. fills are appended to out, returns the quantity resting
+	 */
+	uint64_t place(uint64_t id, uint64_t user, order_side side, int64_t price, uint64_t quantity, std::vector<fill>& out) {
+		bool self = false;
+		uint64_t left = (side == os_buy) ? this->take(this->asks, side, id, user, price, quantity, out, self) : this->take(this->bids, side, id, user, price, quantity, out, self);
+		if (self) return 0;
+		if (left) (side == os_buy) ? this->rest(this->bids, side, id, user, price, left) : this->rest(this->asks, side, id, user, price, left);
+		return left;
+	}
+	/* takes user's order id off the book, returns the quantity it still had, 0 if it isn't resting or isn't theirs */
+	uint64_t cancel(uint64_t id, uint64_t user) {
+		auto found = this->by_id.find(id);
+		if (found == this->by_id.end() or this->nodes[found->second].user not_eq user) return 0;
+		uint32_t i = found->second;
+		node& n = this->nodes[i];
+		uint64_t left = n.quantity;
+		auto remove = [this, i, &n](auto& levels)
+			{
+				auto it = levels.find(n.price);
+				this->unlink(it->second, i);
+				if (it->second.head == none) levels.erase(it);
+			};
+		(n.side == os_buy) ? remove(this->bids) : remove(this->asks);
+		return left;
+	}
+	/* the best n prices of a side with the quantity at each */
+	std::vector<std::pair<int64_t, uint64_t>> depth(order_side side, size_t n) const {
+		return (side == os_buy) ? top(this->bids, n) : top(this->asks, n);
+	}
+	/* the best price of a side, 0 if it's empty */
+	int64_t best(order_side side) const {
+		if (side == os_buy) return this->bids.empty() ? 0 : this->bids.begin()->first;
+		return this->asks.empty() ? 0 : this->asks.begin()->first;
+	}
+	size_t orders() const {
+		return this->by_id.size();
+	}
+	size_t levels() const {
+		return this->bids.size() + this->asks.size();
+	}
+};
+
+namespace market_detail {
+	/* crc32 as zlib has it: polynomial 0xedb88320 reflected, starting from and finished with all ones */
+	inline constexpr std::array<uint32_t, 256> crc_table = []
+		{
+			std::array<uint32_t, 256> t{};
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0xedb88320u : c >> 1;
+				t[i] = c;
+			}
+			return t;
+		}();
+	inline uint32_t crc32(const void* data, size_t size) {
+		uint32_t c = ~0u;
+		for (const uint8_t* b = static_cast<const uint8_t*>(data); size--; b++) c = (c >> 8) ^ crc_table[(c ^ *b) & 0xff];
+		return ~c;
+	}
+}
+
+enum market_record_kind : uint8_t { mr_item, mr_order, mr_cancel, mr_fill };
+
+struct market_record {
+	static constexpr size_t max_text = 32;
+
+	market_record_kind kind{};
+	order_side side{};
+	uint16_t name{}; /* mr_item: bytes of its name, kept in order through other_user (see text()) */
+	uint32_t item{};
+	uint64_t order{}, other{}; /* mr_fill: the buy and the sell order */
+	uint64_t user{}, other_user{}; /* mr_fill: buyer and seller */
+	int64_t price{};
+	uint64_t quantity{};
+	uint32_t at{}; /* unix time */
+	uint32_t crc{}; /* of every byte before it */
+
+	/* mr_item's name, cut to what fits if its length is garbled */
+	std::string_view text() const {
+		return { reinterpret_cast<const char*>(&this->order), std::min<size_t>(this->name, max_text) };
+	}
+	void set_text(std::string_view s) {
+		this->name = static_cast<uint16_t>(std::min(s.size(), max_text));
+		std::memcpy(&this->order, s.data(), this->name);
+	}
+	uint32_t checksum() const {
+		return market_detail::crc32(this, offsetof(market_record, crc));
+	}
+};
+static_assert(sizeof(market_record) == 64 and offsetof(market_record, crc) == 60);
+static_assert(offsetof(market_record, price) - offsetof(market_record, order) == market_record::max_text);
+
+inline constexpr std::string_view market_magic = "NEKOMKT2";
+
+/* a guild's books and its journal */
+class market {
+	std::unordered_map<std::string, uint32_t> ids{};
+	std::vector<std::string> names{};
+	std::vector<order_book> books{};
+	std::ofstream journal{};
+	std::filesystem::path file{};
+	std::chrono::steady_clock::time_point used{};
+	uint64_t next_order = 1, mismatches{}, corrupt{};
+	bool replaying = false, lost = false;
+
+	void append(market_record r) {
+		if (this->replaying or not this->journal.is_open()) return;
+		r.crc = r.checksum();
+		this->journal.write(reinterpret_cast<const char*>(&r), sizeof(r));
+	}
+	/* the journal ready for a write, reopened if close_idle() closed it. always for a market that was never opened */
+	bool writable() {
+		if (this->lost) return false;
+		if (this->file.empty()) return true;
+		if (not this->journal.is_open()) this->journal.open(this->file, std::ios::binary | std::ios::app);
+		this->used = std::chrono::steady_clock::now();
+		if (this->journal.good()) return true;
+		this->lost = true;
+		this->journal = std::ofstream{};
+		return false;
+	}
+	/* flushes what was appended. if it didn't all reach the file, memory is ahead of it and the market is lost */
+	bool saved() {
+		if (this->file.empty() or this->journal.flush().good()) return true;
+		this->lost = true;
+		this->journal = std::ofstream{};
+		return false;
+	}
+	/* book i goes to item, a new book at the end or an empty one taken from the name it had */
+	void bind(uint32_t i, std::string_view item) {
+		if (i == this->names.size()) {
+			this->names.emplace_back(item);
+			this->books.emplace_back();
+		}
+		else {
+			this->ids.erase(this->names[i]);
+			this->names[i] = item;
+		}
+		this->ids.emplace(item, i);
+	}
+	/*
+	 * item's index, added (and journaled) if it's new. with max_items books already, the first one without orders
+	 * goes to item, so names nobody trades can't fill the market. none if every book has orders
+	 */
+	uint32_t item_of(std::string_view item) {
+		if (auto it = this->ids.find(std::string(item)); it not_eq this->ids.end()) return it->second;
+		uint32_t i = static_cast<uint32_t>(this->names.size());
+		if (i >= max_items) {
+			auto empty = std::ranges::find_if(this->books, [](const order_book& b) { return b.orders() == 0; });
+			if (empty == this->books.end()) return ~0u;
+			i = static_cast<uint32_t>(empty - this->books.begin());
+		}
+		this->bind(i, item);
+		market_record r{ mr_item, os_buy, 0, i };
+		r.set_text(item);
+		r.at = static_cast<uint32_t>(time(0));
+		this->append(r);
+		return i;
+	}
+	const order_book* find(std::string_view item) const {
+		auto it = this->ids.find(std::string(item));
+		return (it == this->ids.end()) ? nullptr : &this->books[it->second];
+	}
+public:
+	static constexpr size_t max_items = 1024, max_name = market_record::max_text;
+
+	/* lowercase, trimmed and cut to max_name, so "Sword " and "sword" are one book */
+	static std::string normalize(std::string_view item) {
+		size_t first = item.find_first_not_of(' '), last = item.find_last_not_of(' ');
+		std::string out = (first == std::string_view::npos) ? std::string() : std::string(item.substr(first, std::min(last - first + 1, max_name)));
+		for (char& c : out) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		return out;
+	}
+	/* open() replayed the journal and every write since reached it */
+	bool opened() const {
+		return not this->file.empty() and not this->lost;
+	}
+	/*
+	 * replays the journal at path, then keeps appending to it, or starts one if there's no file or an empty one. a last
+	 * record cut short by a crash is trimmed, a record that makes no sense is skipped and counted in corrupted(). a file
+	 * that can't be read or doesn't start with market_magic is left as it is and nothing is opened. returns the records
+	 * replayed, none if the journal couldn't be opened
+	 */
+	std::optional<size_t> open(const std::filesystem::path& path) {
+		*this = market{};
+		std::error_code error{};
+		std::filesystem::file_status status = std::filesystem::status(path, error);
+		bool fresh = status.type() == std::filesystem::file_type::not_found;
+		if (not fresh and not std::filesystem::is_regular_file(status)) return std::nullopt;
+		uintmax_t size = fresh ? 0 : std::filesystem::file_size(path, error);
+		if (error and not fresh) return std::nullopt;
+		size_t records = 0;
+		if (size) {
+			std::ifstream in{ path, std::ios::binary };
+			std::string magic(market_magic.size(), '\0');
+			if (not in.read(magic.data(), magic.size()) or magic not_eq market_magic) return std::nullopt;
+			std::vector<fill> fills{};
+			size_t checked = 0;
+			std::streamoff good = in.tellg();
+			this->replaying = true;
+			for (market_record r{}; in.read(reinterpret_cast<char*>(&r), sizeof(r)); good = in.tellg()) {
+				/* every record is the same size, so skipping one that fails its checksum keeps the rest in line */
+				if (r.crc not_eq r.checksum() or r.kind > mr_fill or (r.kind == mr_item and (r.name > max_name or r.item > this->books.size())) or
+					(r.kind not_eq mr_item and r.item >= this->books.size())) {
+					this->corrupt++;
+					continue;
+				}
+				records++;
+				if (r.kind == mr_item) {
+					std::string name(r.text());
+					if (this->ids.contains(name)) this->corrupt++;
+					else this->bind(r.item, name);
+				}
+				else if (r.kind == mr_order) {
+					fills.clear();
+					checked = 0;
+					this->books[r.item].place(r.order, r.user, r.side, r.price, r.quantity, fills);
+					this->next_order = std::max(this->next_order, r.order + 1);
+				}
+				else if (r.kind == mr_cancel) this->books[r.item].cancel(r.order, r.user);
+				else if (r.kind == mr_fill) {
+					/* the fills an order makes are journaled right after it, in order */
+					const fill* f = (checked < fills.size()) ? &fills[checked++] : nullptr;
+					if (not f or f->buy not_eq r.order or f->sell not_eq r.other or f->price not_eq r.price or f->quantity not_eq r.quantity) this->mismatches++;
+				}
+			}
+			this->replaying = false;
+			/* a read that failed before the end, or more left than a torn last record, isn't trimmed */
+			if (in.bad() or size - good >= sizeof(market_record)) return std::nullopt;
+			in.close();
+			/* only a torn last record is left after good, it's cut off so what's appended next lines up */
+			if (std::filesystem::resize_file(path, good, error); error) return std::nullopt;
+		}
+		this->journal = std::ofstream{ path, std::ios::binary | std::ios::app };
+		if (not size) this->journal.write(market_magic.data(), market_magic.size()).flush();
+		if (not this->journal.good()) return std::nullopt;
+		this->file = path;
+		this->used = std::chrono::steady_clock::now();
+		return records;
+	}
+	/* closes the journal if it wasn't written since before, the next write opens it again */
+	void close_idle(std::chrono::steady_clock::time_point before) {
+		if (this->journal.is_open() and this->used < before) this->journal.close();
+	}
+	/*
+	 * user's order for quantity of item at price or better, matched then journaled with its fills. fills are appended
+	 * to out, returns the order's id and what of it rests (what's neither is dropped, it met user's own order).
+	 * id 0 if the market is full, every one of max_items books has orders. nothing if the journal couldn't be written
+	 */
+	std::optional<std::pair<uint64_t, uint64_t>> place(uint64_t user, std::string_view item, order_side side, int64_t price, uint64_t quantity, std::vector<fill>& out) {
+		if (not this->writable()) return std::nullopt;
+		uint32_t i = this->item_of(item);
+		if (i == ~0u) return std::pair<uint64_t, uint64_t>{ 0, 0 };
+		uint64_t id = this->next_order++;
+		size_t first = out.size();
+		uint32_t now = static_cast<uint32_t>(time(0));
+		uint64_t resting = this->books[i].place(id, user, side, price, quantity, out);
+		this->append({ mr_order, side, 0, i, id, 0, user, 0, price, quantity, now });
+		for (size_t f = first; f < out.size(); f++) this->append({ mr_fill, out[f].taker, 0, i, out[f].buy, out[f].sell, out[f].buyer, out[f].seller, out[f].price, out[f].quantity, now });
+		if (not this->saved()) return std::nullopt;
+		return std::pair<uint64_t, uint64_t>{ id, resting };
+	}
+	/*
+	 * takes user's order off item's book, returns the quantity it still had, 0 if it isn't resting or isn't theirs.
+	 * nothing if the journal couldn't be written
+	 */
+	std::optional<uint64_t> cancel(uint64_t user, std::string_view item, uint64_t order) {
+		if (not this->writable()) return std::nullopt;
+		auto it = this->ids.find(std::string(item));
+		if (it == this->ids.end()) return 0;
+		uint64_t left = this->books[it->second].cancel(order, user);
+		if (left) this->append({ mr_cancel, os_buy, 0, it->second, order, 0, user, 0, 0, left, static_cast<uint32_t>(time(0)) });
+		if (not this->saved()) return std::nullopt;
+		return left;
+	}
+	/* the best n prices on each side of item's book, bids then asks */
+	std::pair<std::vector<std::pair<int64_t, uint64_t>>, std::vector<std::pair<int64_t, uint64_t>>> depth(std::string_view item, size_t n) const {
+		const order_book* b = this->find(item);
+		if (not b) return {};
+		return { b->depth(os_buy, n), b->depth(os_sell, n) };
+	}
+	/* every book with its item's name */
+	template<typename F> void each(F fn) const {
+		for (size_t i = 0; i < this->books.size(); i++) fn(this->names[i], this->books[i]);
+	}
+	size_t items() const {
+		return this->books.size();
+	}
+	/* replayed fills that didn't match the journaled ones, 0 unless the matching rules changed under an old journal */
+	uint64_t diverged() const {
+		return this->mismatches;
+	}
+	/* journal records skipped on replay because they failed their checksum or made no sense, e.g. an order for an item never named */
+	uint64_t corrupted() const {
+		return this->corrupt;
+	}
+};
@@ -0,0 +1,209 @@
+#pragma once
+/*
+ * order matching, in memory and journaled. e.g. neko.exe --bench market
+ */
+#include <bench_common.hpp>
+#include <market.hpp>
+#include <random.hpp>
+
+/*
+ * a copy of the journal at file with one byte of a record in the middle changed, at within: the record fails its checksum
+ * and is skipped, the ones after it still replay and the file isn't cut
+ */
+inline void market_corrupt_check(bench_checks& checks, const std::filesystem::path& file, size_t records, size_t within, std::string_view what) {
+	std::filesystem::path copy = file;
+	copy += ".corrupt";
+	std::filesystem::copy_file(file, copy, std::filesystem::copy_options::overwrite_existing);
+	uintmax_t size = std::filesystem::file_size(copy);
+	{
+		std::fstream patch{ copy, std::ios::binary | std::ios::in | std::ios::out };
+		std::streamoff at = static_cast<std::streamoff>(market_magic.size() + (size - market_magic.size()) / sizeof(market_record) / 2 * sizeof(market_record) + within);
+		patch.seekg(at);
+		char garbled = static_cast<char>(patch.get() ^ 0x5a);
+		patch.seekp(at);
+		patch.put(garbled);
+	}
+	market patched{};
+	size_t kept = patched.open(copy).value_or(0);
+	bool lost = patched.corrupted() not_eq 1 or kept + 1 not_eq records or std::filesystem::file_size(copy) not_eq size;
+	checks.expect(not lost, what);
+	std::cout << std::format("{0}: {1} skipped, {2} of {3} records replayed, journal {4}\n", what, patched.corrupted(), kept, records, lost ? "CUT OR MISREAD" : "kept whole");
+	std::filesystem::remove(copy);
+}
+
+/* an item record with a garbled name length is skipped with the orders on it, the records after it still line up */
+inline void market_name_check(bench_checks& checks, const std::filesystem::path& scratch) {
+	std::filesystem::path file = scratch / "names.bin";
+	std::vector<fill> ignored{};
+	market m{};
+	m.open(file);
+	m.place(1, "sword", os_sell, 10, 1, ignored); /* records 0 and 1, the item then the order */
+	m.place(2, "shield", os_sell, 20, 1, ignored); /* 2 and 3 */
+	m.place(3, "sword", os_sell, 11, 1, ignored); /* 4 */
+	{
+		std::fstream patch{ file, std::ios::binary | std::ios::in | std::ios::out };
+		patch.seekp(static_cast<std::streamoff>(market_magic.size() + 2 * sizeof(market_record) + offsetof(market_record, name)));
+		patch.put(static_cast<char>(0xff)).put(static_cast<char>(0xff));
+	}
+	market again{};
+	again.open(file);
+	bool kept = again.corrupted() == 2 and again.items() == 1 and again.depth("sword", 2) == m.depth("sword", 2);
+	checks.expect(kept, "bad name length");
+	std::cout << std::format("bad name length: {0} skipped, {1}\n", again.corrupted(), kept ? "the records after it line up" : "MISALIGNED");
+}
+
+/* a file that isn't a journal is refused and left as it was, not truncated into a new one */
+inline void market_foreign_check(bench_checks& checks, const std::filesystem::path& scratch) {
+	std::filesystem::path file = scratch / "foreign.bin";
+	std::string text = "not a market journal, but somebody's data all the same";
+	std::ofstream{ file, std::ios::binary } << text;
+	market m{};
+	bool refused = not m.open(file) and not m.opened() and std::filesystem::file_size(file) == text.size();
+	checks.expect(refused, "a foreign file is left alone");
+	std::cout << std::format("foreign file: {0}\n", refused ? "refused, left as it was" : "OPENED OR CHANGED");
+}
+
+/* a journal closed while idle is opened again by the next order, and what's written after replays */
+inline void market_idle_check(bench_checks& checks, const std::filesystem::path& scratch) {
+	std::filesystem::path file = scratch / "idle.bin";
+	std::vector<fill> ignored{};
+	market m{};
+	m.open(file);
+	m.place(1, "sword", os_sell, 10, 1, ignored);
+	m.close_idle(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+	bool written = m.place(2, "sword", os_sell, 11, 1, ignored).has_value() and m.opened();
+	market again{};
+	std::optional<size_t> records = again.open(file);
+	bool kept = written and records == 3u and again.depth("sword", 2).second.size() == 2;
+	checks.expect(kept, "an idle journal reopens");
+	std::cout << std::format("idle journal: {0}\n", kept ? "reopened by the next order" : "LOST WRITES");
+}
+
+/* max_items names placed and cancelled, then one more that must still get a book */
+inline void market_full_check(bench_checks& checks) {
+	market full{};
+	std::vector<fill> ignored{};
+	for (size_t i = 0; i < market::max_items; i++) {
+		std::string junk = std::format("junk {0}", i);
+		full.cancel(1, junk, full.place(1, junk, os_sell, 1, 1, ignored)->first);
+	}
+	bool refused = full.place(1, "sword", os_sell, 1, 1, ignored)->first == 0;
+	checks.expect(not refused, "full market takes a new name");
+	std::cout << std::format("full market: a new name after {0} empty books {1}\n", market::max_items, refused ? "REFUSED" : "gets one");
+}
+
+/*
+ * a stream of orders around a drifting price, a fifth of them cancels, matched in memory and then through the journal,
+ * with orders/s and per-order latency percentiles. fails if a book is ever crossed, an order fills past its price or
+ * against its own user, quantity isn't conserved, the journal replays to different books, a garbled record in the middle
+ * of it (its kind, a field, an item's name length) is replayed or loses the ones after, a file that isn't a journal is
+ * opened, or names nobody trades keep a full market from taking a new one
+ */
+inline int market_bench(size_t orders, size_t items) {
+	struct op {
+		uint64_t user, order; /* order: the one to cancel, 0 to place */
+		uint32_t item;
+		order_side side;
+		int64_t price;
+		uint64_t quantity;
+	};
+	xoshiro256 rng(1);
+	std::vector<std::string> names(items);
+	for (size_t i = 0; i < items; i++) names[i] = std::format("item {0}", i);
+	/* generated up front so it isn't timed, ids are handed out in order from 1 */
+	std::vector<op> ops{};
+	std::vector<std::tuple<uint64_t, uint64_t, uint32_t>> placed{}; /* id, user, item */
+	std::vector<int64_t> mid(items, 1000);
+	for (size_t i = 0; i < orders; i++) {
+		uint32_t item = static_cast<uint32_t>(bounded(rng, items));
+		if (i % 100 == 0) mid[item] += static_cast<int64_t>(bounded(rng, 21)) - 10;
+		if (bounded(rng, 5) == 0 and not placed.empty()) {
+			auto [id, user, on] = placed[placed.size() - 1 - bounded(rng, std::min<uint64_t>(placed.size(), 1000))];
+			ops.push_back({ user, id, on });
+			continue;
+		}
+		order_side side = bounded(rng, 2) ? os_buy : os_sell;
+		/* mostly resting a little off the mid, some crossing it */
+		int64_t off = static_cast<int64_t>(bounded(rng, 20)) - 4;
+		ops.push_back({ 1 + bounded(rng, 10'000), 0, item, side, (side == os_buy) ? mid[item] - off : mid[item] + off, 1 + bounded(rng, 50) });
+		placed.emplace_back(placed.size() + 1, ops.back().user, item);
+	}
+	std::filesystem::path scratch = std::filesystem::temp_directory_path() / "neko-market-bench";
+	std::filesystem::remove_all(scratch);
+	std::filesystem::create_directories(scratch);
+	bench_checks checks{};
+	auto run = [&](market& m, std::string_view what)
+		{
+			std::vector<uint32_t> took(ops.size());
+			std::vector<fill> fills{};
+			uint64_t in = 0, filled = 0, cancelled = 0, dropped = 0, count = 0;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < ops.size(); i++) {
+				const op& o = ops[i];
+				std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+				fills.clear();
+				uint64_t resting = 0;
+				if (o.order) {
+					std::optional<uint64_t> left = m.cancel(o.user, names[o.item], o.order);
+					checks.expect(left.has_value(), "cancel journaled");
+					cancelled += left.value_or(0);
+				}
+				else {
+					std::optional<std::pair<uint64_t, uint64_t>> placed = m.place(o.user, names[o.item], o.side, o.price, o.quantity, fills);
+					checks.expect(placed.has_value(), "order journaled");
+					resting = placed ? placed->second : 0;
+				}
+				took[i] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count());
+				if (o.order) continue;
+				in += o.quantity;
+				uint64_t mine = 0;
+				for (const fill& f : fills) {
+					mine += f.quantity;
+					checks.expect((o.side == os_buy) ? f.price <= o.price : f.price >= o.price, "fill within its price");
+					checks.expect(f.buyer not_eq f.seller, "fill against its own user");
+				}
+				filled += mine;
+				dropped += o.quantity - mine - resting;
+				count += fills.size();
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			uint64_t resting = 0;
+			m.each([&](const std::string&, const order_book& b)
+				{
+					for (const auto& [p, q] : b.depth(os_buy, -1)) resting += q;
+					for (const auto& [p, q] : b.depth(os_sell, -1)) resting += q;
+					checks.expect(not b.best(os_buy) or not b.best(os_sell) or b.best(os_buy) < b.best(os_sell), "uncrossed book");
+				});
+			checks.expect(in == 2 * filled + resting + cancelled + dropped, "quantity conserved");
+			std::ranges::sort(took);
+			auto at = [&took](double p) { return took[std::min(static_cast<size_t>(p * took.size()), took.size() - 1)]; };
+			std::cout << std::format("{0}: {1:.2f} M orders/s, p50 {2} ns, p99 {3} ns, p99.9 {4} ns, max {5} ns, {6} fills, {7} dropped as self-trades\n",
+				what, ops.size() / seconds / 1e6, at(0.5), at(0.99), at(0.999), took.back(), count, dropped);
+		};
+	{
+		market memory{};
+		run(memory, "in memory");
+	}
+	std::filesystem::path file = scratch / "bench.bin";
+	market journaled{};
+	checks.expect(journaled.open(file).has_value(), "a new journal opens");
+	run(journaled, "journaled");
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	market again{};
+	size_t records = again.open(file).value_or(0);
+	double replay_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	size_t differ = again.diverged() + (again.items() not_eq journaled.items());
+	for (const std::string& item : names)
+		if (journaled.depth(item, -1) not_eq again.depth(item, -1)) differ++;
+	checks.add(differ, "books or fills differ after replay");
+	std::cout << std::format("journal: {0} MiB, {1} records replayed in {2:.0f} ms, {3} books or fills differ\n",
+		std::filesystem::file_size(file) / (1024 * 1024), records, replay_ms, differ);
+	market_corrupt_check(checks, file, records, offsetof(market_record, kind), "bad kind");
+	market_corrupt_check(checks, file, records, offsetof(market_record, quantity), "garbled quantity");
+	market_name_check(checks, scratch);
+	market_foreign_check(checks, scratch);
+	market_idle_check(checks, scratch);
+	market_full_check(checks);
+	std::filesystem::remove_all(scratch);
+	return checks.report();
+}
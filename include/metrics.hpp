@@ -0,0 +1,252 @@
+#pragma once
+/*
+ * metrics in prometheus text format, scraped from http://127.0.0.1:<port>/metrics.
+ * every thread records into its own slice of a series with relaxed atomics, so recording takes no lock and
+ * costs a few uncontended adds; a scrape sums the slices. look series up once and keep the reference,
+ * with() takes a lock.
+ * e.g. static histogram& h = handlers.with("lvl"); timed t(h);
+ */
+#include <winsock2.h>
+#include <ws2tcpip.h> // inet_pton()
+#include <atomic>
+#include <array>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <bit>
+#include <cmath>
+#include <format>
+#include <iostream>
+
+namespace metrics_detail {
+	/* threads past the last slot share it, which the atomics keep correct */
+	inline constexpr size_t max_threads = 256;
+	inline std::atomic<size_t> threads{};
+	inline thread_local size_t slot = static_cast<size_t>(-1);
+	inline size_t thread_slot() {
+		if (slot == static_cast<size_t>(-1)) slot = std::min(threads.fetch_add(1, std::memory_order_relaxed), max_threads - 1);
+		return slot;
+	}
+	/* one slice per thread, allocated the first time that thread records */
+	template<typename T> class per_thread {
+		std::array<std::atomic<T*>, max_threads> slices{};
+	public:
+		~per_thread() {
+			for (std::atomic<T*>& s : this->slices) delete s.load();
+		}
+		T& mine() {
+			std::atomic<T*>& s = this->slices[thread_slot()];
+			if (T* p = s.load(std::memory_order_acquire)) return *p;
+			T* fresh = new T{};
+			T* expected = nullptr;
+			if (s.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) return *fresh;
+			delete fresh;
+			return *expected;
+		}
+		template<typename F> void each(F fn) const {
+			for (const std::atomic<T*>& s : this->slices)
+				if (const T* p = s.load(std::memory_order_acquire)) fn(*p);
+		}
+	};
+}
+
+class counter {
+	struct alignas(64) slice {
+		std::atomic<uint64_t> value{};
+	};
+	metrics_detail::per_thread<slice> slices{};
+public:
+	void add(uint64_t n = 1) {
+		this->slices.mine().value.fetch_add(n, std::memory_order_relaxed);
+	}
+	uint64_t value() const {
+		uint64_t total = 0;
+		this->slices.each([&total](const slice& s) { total += s.value.load(std::memory_order_relaxed); });
+		return total;
+	}
+};
+
+/*
+ * log-linear buckets of nanoseconds, HDR style: exact below 8, then 8 buckets per power of two (within 12.5%),
+ * up to 2^40 ns (18 minutes), anything longer lands in the last bucket
+ */
+class histogram {
+public:
+	static constexpr size_t sub = 8, max_power = 40, size = (max_power - 2) * sub + sub;
+private:
+	struct alignas(64) slice {
+		std::atomic<uint64_t> count{}, sum{};
+		std::array<std::atomic<uint64_t>, size> buckets{};
+	};
+	metrics_detail::per_thread<slice> slices{};
+public:
+	static constexpr size_t bucket_of(uint64_t ns) {
+		if (ns < sub) return static_cast<size_t>(ns);
+		size_t power = std::min<size_t>(std::bit_width(ns) - 1, max_power);
+		if (power == max_power) return size - 1;
+		return (power - 2) * sub + static_cast<size_t>((ns >> (power - 3)) & (sub - 1));
+	}
+	/* largest value bucket i holds */
+	static constexpr uint64_t upper_of(size_t i) {
+		if (i < sub) return i;
+		size_t power = i / sub + 2;
+		return ((sub + i % sub + 1) << (power - 3)) - 1;
+	}
+	/* upper bound of the bucket holding the p-th percentile (0..1) of buckets, in nanoseconds */
+	static uint64_t percentile(const std::array<uint64_t, size>& buckets, double p) {
+		uint64_t count = 0, seen = 0;
+		for (uint64_t b : buckets) count += b;
+		uint64_t want = static_cast<uint64_t>(std::ceil(p * count));
+		for (size_t i = 0; i < size; i++)
+			if ((seen += buckets[i]) >= want and seen) return upper_of(i);
+		return 0;
+	}
+	void record(uint64_t ns) {
+		slice& s = this->slices.mine();
+		s.count.fetch_add(1, std::memory_order_relaxed);
+		s.sum.fetch_add(ns, std::memory_order_relaxed);
+		s.buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+	}
+	void record(std::chrono::steady_clock::duration d) {
+		this->record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()));
+	}
+	/* count, sum in ns and the buckets, summed over every thread */
+	std::tuple<uint64_t, uint64_t, std::array<uint64_t, size>> snapshot() const {
+		std::tuple<uint64_t, uint64_t, std::array<uint64_t, size>> out{};
+		auto& [count, sum, buckets] = out;
+		this->slices.each([&](const slice& s)
+			{
+				count += s.count.load(std::memory_order_relaxed);
+				sum += s.sum.load(std::memory_order_relaxed);
+				for (size_t i = 0; i < size; i++) buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+			});
+		return out;
+	}
+};
+
+/* records the time from construction to destruction */
+class timed {
+	histogram& into;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+public:
+	timed(histogram& into) : into(into) {}
+	~timed() {
+		this->into.record(std::chrono::steady_clock::now() - this->start);
+	}
+};
+
+/* one metric name and its series, one per value of a single label */
+template<typename M> class family {
+	std::mutex lock{};
+	std::map<std::string, std::unique_ptr<M>, std::less<>> series{};
+public:
+	const std::string name, help, label;
+
+	family(std::string name, std::string help, std::string label = {}) : name(std::move(name)), help(std::move(help)), label(std::move(label)) {}
+	/* the series for a label value, created on first use. the reference stays valid */
+	M& with(std::string_view value = {}) {
+		std::lock_guard<std::mutex> g(this->lock);
+		auto it = this->series.find(value);
+		if (it == this->series.end()) it = this->series.emplace(std::string(value), std::make_unique<M>()).first;
+		return *it->second;
+	}
+	template<typename F> void each(F fn) {
+		std::lock_guard<std::mutex> g(this->lock);
+		for (const auto& [value, m] : this->series) fn(value, *m);
+	}
+};
+
+class registry {
+	std::mutex lock{};
+	std::vector<std::unique_ptr<family<counter>>> counters{};
+	std::vector<std::unique_ptr<family<histogram>>> histograms{};
+	std::vector<std::function<void(std::string&)>> collectors{};
+
+	template<typename M> static std::string labels(const family<M>& f, std::string_view value, std::string_view extra = {}) {
+		std::string out = f.label.empty() ? std::string() : std::format("{0}=\"{1}\"", f.label, value);
+		if (not extra.empty()) out += (out.empty() ? "" : ",") + std::string(extra);
+		return out.empty() ? out : "{" + out + "}";
+	}
+public:
+	/* bucket bounds exported per histogram, in seconds. the finer buckets stay inside */
+	std::vector<double> bounds = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0 };
+
+	family<counter>& add_counter(std::string name, std::string help, std::string label = {}) {
+		std::lock_guard<std::mutex> g(this->lock);
+		return *this->counters.emplace_back(std::make_unique<family<counter>>(std::move(name), std::move(help), std::move(label)));
+	}
+	family<histogram>& add_histogram(std::string name, std::string help, std::string label = {}) {
+		std::lock_guard<std::mutex> g(this->lock);
+		return *this->histograms.emplace_back(std::make_unique<family<histogram>>(std::move(name), std::move(help), std::move(label)));
+	}
+	/* appends lines computed at scrape time, e.g. gauges read from elsewhere */
+	void add_collector(std::function<void(std::string&)> collector) {
+		std::lock_guard<std::mutex> g(this->lock);
+		this->collectors.emplace_back(std::move(collector));
+	}
+	std::string text() {
+		std::lock_guard<std::mutex> g(this->lock);
+		std::string out{};
+		for (std::unique_ptr<family<counter>>& f : this->counters) {
+			out += std::format("# HELP {0} {1}\n# TYPE {0} counter\n", f->name, f->help);
+			f->each([&](std::string_view value, const counter& c) { out += std::format("{0}{1} {2}\n", f->name, labels(*f, value), c.value()); });
+		}
+		for (std::unique_ptr<family<histogram>>& f : this->histograms) {
+			out += std::format("# HELP {0} {1}\n# TYPE {0} histogram\n", f->name, f->help);
+			f->each([&](std::string_view value, const histogram& h)
+				{
+					auto [count, sum, buckets] = h.snapshot();
+					size_t i = 0;
+					uint64_t below = 0;
+					for (double bound : this->bounds) {
+						/* whole buckets only, so a bound never claims values above it */
+						for (uint64_t ns = static_cast<uint64_t>(bound * 1e9); i < histogram::size and histogram::upper_of(i) <= ns; i++) below += buckets[i];
+						out += std::format("{0}_bucket{1} {2}\n", f->name, labels(*f, value, std::format("le=\"{0}\"", bound)), below);
+					}
+					out += std::format("{0}_bucket{1} {2}\n{0}_sum{3} {4}\n{0}_count{3} {2}\n",
+						f->name, labels(*f, value, "le=\"+Inf\""), count, labels(*f, value), sum / 1e9);
+				});
+		}
+		for (std::function<void(std::string&)>& collect : this->collectors) collect(out);
+		return out;
+	}
+};
+
+/* answers every request on 127.0.0.1:port with registry's text. one connection at a time, scrapes are rare */
+class metrics_server {
+	registry& source;
+	SOCKET listener = INVALID_SOCKET;
+	std::jthread thread{};
+
+	void serve() {
+		for (SOCKET connection; (connection = accept(this->listener, nullptr, nullptr)) not_eq INVALID_SOCKET;) {
+			char request[1024];
+			recv(connection, request, sizeof(request), 0); /* any path, any method */
+			std::string body = this->source.text();
+			std::string response = std::format("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {0}\r\nConnection: close\r\n\r\n{1}", body.size(), body);
+			send(connection, response.data(), static_cast<int>(response.size()), 0);
+			closesocket(connection);
+		}
+	}
+public:
+	metrics_server(registry& source, uint16_t port) : source(source) {
+		WSADATA wsa{};
+		WSAStartup(MAKEWORD(2, 2), &wsa);
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr); /* never exposed beyond this machine */
+		this->listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (this->listener == INVALID_SOCKET or bind(this->listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR or listen(this->listener, SOMAXCONN) == SOCKET_ERROR) {
+			std::cout << std::format("metrics: cannot listen on 127.0.0.1:{0} ({1})", port, WSAGetLastError()) << std::endl;
+			return;
+		}
+		this->thread = std::jthread([this] { this->serve(); });
+	}
+	~metrics_server() {
+		closesocket(this->listener); /* unblocks accept() */
+	}
+};
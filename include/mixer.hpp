@@ -0,0 +1,173 @@
+#pragma once
+/*
+ * PCM mixing for voice. dpp ships one audio_mixer per instruction set under dpp/isa/, all with the same name, and
+ * picks one at compile time; here each is wrapped in its own namespace so the one that runs fastest on this CPU is
+ * picked at startup instead. a mix is 20 ms of 48 kHz stereo, summed from any number of sources with a gain ramp each, and
+ * encoded once with the opus.dll dpp already ships.
+ * e.g. pcm_mixer mixer{}; mixer.mix(inputs, out); opus_encoder().encode(out)
+ */
+#include <windows.h>
+#include <immintrin.h> // before the dpp/isa headers, which include it inside our namespaces
+#include <numeric>
+#include <limits>
+#include <cpu.hpp>
+#include <array>
+#include <span>
+#include <vector>
+#include <string_view>
+#include <algorithm>
+#include <chrono>
+
+namespace isa_fallback {
+#include <dpp/isa/fallback.h>
+}
+namespace isa_avx {
+#include <dpp/isa/avx.h>
+}
+namespace isa_avx2 {
+#include <dpp/isa/avx2.h>
+}
+/* dpp/isa/avx512.h isn't usable, its static store_values() writes a 256-bit register through a non-static member */
+
+/* samples in one 20 ms frame, both channels */
+inline constexpr size_t mix_samples = 960 * 2;
+
+enum mix_isa : uint8_t {
+	mi_fallback, mi_avx, mi_avx2
+};
+inline constexpr std::string_view mix_isa_names[] = { "fallback", "avx", "avx2" };
+
+/* the widest instruction set both the CPU and the OS (saved register state) support */
+inline mix_isa detect_isa() {
+	cpu_features cpu = detect_cpu();
+	return cpu.avx2 ? mi_avx2 : cpu.avx ? mi_avx : mi_fallback;
+}
+
+/* one source's frame and its gain, ramped from gain_from to gain_to across the frame. gains are at most 1 */
+struct mix_input {
+	const int16_t* pcm{};
+	float gain_from{}, gain_to{};
+};
+
+namespace mixer_detail {
+	/* sums inputs into out a register at a time with mixer M: each source is scaled on its own, then the scaled sources are added */
+	template<typename M> void mix(std::span<const mix_input> inputs, int16_t* out) {
+		constexpr size_t width = M::byte_blocks_per_register, blocks = mix_samples / width;
+		static_assert(mix_samples % width == 0);
+		M m{};
+		for (size_t b = 0; b < blocks; b++) {
+			size_t at = b * width;
+			alignas(64) int32_t sum[width]{}, wide[width];
+			alignas(64) int16_t scaled[width];
+			for (const mix_input& in : inputs) {
+				std::fill_n(wide, width, 0);
+				m.combine_samples(wide, in.pcm + at);
+				m.collect_single_register(wide, scaled, in.gain_from + (in.gain_to - in.gain_from) * b / blocks, 0.0f);
+				m.combine_samples(sum, scaled);
+			}
+			/* clamped here rather than trusting each ISA's collect to saturate */
+			for (size_t i = 0; i < width; i++) sum[i] = std::clamp<int32_t>(sum[i], std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max());
+			m.collect_single_register(sum, out + at, 1.0f, 0.0f);
+		}
+	}
+}
+
+class pcm_mixer {
+	using kernel = void(*)(std::span<const mix_input>, int16_t*);
+	static kernel of(mix_isa isa) {
+		switch (isa) {
+		case mi_avx2: return &mixer_detail::mix<isa_avx2::dpp::audio_mixer>;
+		case mi_avx: return &mixer_detail::mix<isa_avx::dpp::audio_mixer>;
+		default: return &mixer_detail::mix<isa_fallback::dpp::audio_mixer>;
+		}
+	}
+	/*
+	 * the supported kernel that mixes four sources fastest here. wider isn't always faster: dpp's avx paths gather and
+	 * scatter a lane at a time, which on some CPUs loses to the plain loop
+	 */
+	static mix_isa fastest() {
+		std::vector<int16_t> pcm(mix_samples, 1000), out(mix_samples);
+		std::array<mix_input, 4> inputs{};
+		inputs.fill({ pcm.data(), 0.5f, 0.25f });
+		mix_isa best = mi_fallback;
+		std::chrono::nanoseconds best_time = std::chrono::nanoseconds::max();
+		for (mix_isa isa = mi_fallback; isa <= detect_isa(); isa = static_cast<mix_isa>(isa + 1)) {
+			kernel k = of(isa);
+			k(inputs, out.data()); /* warm */
+			/* best of a few rounds, so a preemption doesn't decide it */
+			for (int round = 0; round < 5; round++) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int i = 0; i < 20; i++) k(inputs, out.data());
+				std::chrono::nanoseconds took = std::chrono::steady_clock::now() - start;
+				if (took < best_time) {
+					best = isa;
+					best_time = took;
+				}
+			}
+		}
+		return best;
+	}
+	kernel fn;
+public:
+	const mix_isa isa;
+
+	/* @param isa kernel to use, by default the fastest one the CPU supports, measured once per process */
+	pcm_mixer(mix_isa isa = chosen()) : fn(of(isa)), isa(isa) {}
+	static mix_isa chosen() {
+		static const mix_isa once = fastest();
+		return once;
+	}
+	/* out holds mix_samples, silence when there are no inputs */
+	void mix(std::span<const mix_input> inputs, int16_t* out) const {
+		this->fn(inputs, out);
+	}
+};
+
+/*
+ * an opus encoder from the opus.dll next to dpp.dll. the tree has no opus headers or import library,
+ * so the three calls needed are looked up at runtime against opus's stable C ABI
+ */
+class opus_encoder {
+	struct api {
+		void* (*create)(int32_t rate, int channels, int application, int* error) = nullptr;
+		int32_t(*encode)(void* encoder, const int16_t* pcm, int frame_size, uint8_t* data, int32_t max_bytes) = nullptr;
+		void (*destroy)(void* encoder) = nullptr;
+	};
+	static const api& library() {
+		static const api loaded = []
+			{
+				api a{};
+				if (HMODULE opus = LoadLibraryA("opus.dll")) {
+					a.create = reinterpret_cast<decltype(a.create)>(GetProcAddress(opus, "opus_encoder_create"));
+					a.encode = reinterpret_cast<decltype(a.encode)>(GetProcAddress(opus, "opus_encode"));
+					a.destroy = reinterpret_cast<decltype(a.destroy)>(GetProcAddress(opus, "opus_encoder_destroy"));
+				}
+				return a;
+			}();
+		return loaded;
+	}
+	static constexpr int application_audio = 2049; /* OPUS_APPLICATION_AUDIO */
+	void* state = nullptr;
+	std::array<uint8_t, 4000> packet{}; /* opus's recommended maximum */
+public:
+	opus_encoder() {
+		const api& a = library();
+		int error = 0;
+		if (a.create and a.encode and a.destroy) this->state = a.create(48000, 2, application_audio, &error);
+	}
+	opus_encoder(const opus_encoder&) = delete;
+	opus_encoder& operator=(const opus_encoder&) = delete;
+	~opus_encoder() {
+		if (this->state) library().destroy(this->state);
+	}
+	/* false when opus.dll couldn't be loaded */
+	bool ready() const {
+		return this->state;
+	}
+	/* one 20 ms frame of mix_samples, the packet stays valid until the next call. empty on failure */
+	std::span<const uint8_t> encode(const int16_t* pcm) {
+		if (not this->state) return {};
+		int32_t size = library().encode(this->state, pcm, static_cast<int>(mix_samples / 2), this->packet.data(), static_cast<int32_t>(this->packet.size()));
+		return (size > 0) ? std::span<const uint8_t>(this->packet.data(), size) : std::span<const uint8_t>();
+	}
+};
@@ -0,0 +1,372 @@
+#pragma once
+/*
+ * offline stand-in for discord. dpp always speaks TLS to discord.com and gateway.discord.gg with no way to point it elsewhere,
+ * so rather than listening on a socket the mock plugs into the two seams the bot owns: interactions go in through the
+ * cluster's routers (inject() in replay.hpp) and REST calls come out through rest_scheduler::transport.
+ * replies arrive after a simulated round trip with discord's rate limit headers, 429s and the global limit included.
+ * e.g. neko.exe --mock 60 --rate 500 --guilds 200 --mix gcreate:1,click:90,purge:4,lvl:5
+ * soak() keeps a storm going for hours and watches memory, threads, handles and container sizes for growth.
+ * e.g. neko.exe --soak 4 --speedup 60 --rate 200
+ */
+#include <replay.hpp> // inject()
+#include <bench_common.hpp> // zipf_guilds()
+#include <random>
+#include <queue>
+#include <map>
+#include <ranges>
+#include <span>
+#include <functional>
+
+/* what a storm sends, weights per interaction kind */
+struct storm_script {
+	double seconds = 30.0, rate = 100.0;
+	/* how much faster the bot's timers run than the wall clock, so hour-long giveaways end within a soak */
+	double speedup = 1.0;
+	size_t guilds = 100, users = 100'000;
+	std::array<double, 4> mix = { 1.0, 90.0, 4.0, 5.0 }; /* gcreate, click, purge, lvl */
+
+	/* e.g. "gcreate:1,click:90,purge:4,lvl:5", kinds left out get no weight */
+	void set_mix(std::string_view text) {
+		static constexpr std::string_view kinds[] = { "gcreate", "click", "purge", "lvl" };
+		if (text.empty()) return;
+		this->mix.fill(0.0);
+		for (const auto& range : text | std::views::split(',')) {
+			std::string_view part(range.begin(), range.end());
+			size_t colon = part.find(':');
+			auto kind = std::ranges::find(kinds, part.substr(0, colon));
+			if (kind not_eq std::end(kinds) and colon not_eq std::string_view::npos) this->mix[kind - std::begin(kinds)] = std::stod(std::string(part.substr(colon + 1)));
+		}
+	}
+};
+
+/* one value sampled during a soak, growth below floor (in the gauge's unit) is never reported */
+struct soak_gauge {
+	std::string name{};
+	double value{}, floor{};
+};
+
+struct soak_series {
+	std::string name{};
+	double floor{};
+	std::vector<std::pair<double, double>> samples{}; /* hours since start, value */
+
+	struct trend {
+		double first{}, last{}, min{}, max{}, slope{};
+		bool enough{}, growing{};
+	};
+	/*
+	 * the first quarter is warm-up and dropped. the rest is cut into four windows: a series grows without bound when
+	 * every window's mean is above the one before and the last is above the first by floor and 5%. the slope is a
+	 * least squares fit over the same samples
+	 */
+	trend analyse() const {
+		trend t{};
+		std::span<const std::pair<double, double>> kept = std::span(this->samples).subspan(this->samples.size() / 4);
+		if (kept.empty()) return t;
+		t.first = kept.front().second;
+		t.last = kept.back().second;
+		auto [low, high] = std::ranges::minmax(kept | std::views::values);
+		t.min = low;
+		t.max = high;
+		double n = static_cast<double>(kept.size()), sx = 0, sy = 0, sxx = 0, sxy = 0;
+		for (const auto& [x, y] : kept) {
+			sx += x;
+			sy += y;
+			sxx += x * x;
+			sxy += x * y;
+		}
+		if (double d = n * sxx - sx * sx; d > 0) t.slope = (n * sxy - sx * sy) / d;
+		if (not (t.enough = kept.size() >= 8)) return t;
+		std::array<double, 4> means{};
+		for (size_t w = 0; w < 4; w++) {
+			std::span<const std::pair<double, double>> part = kept.subspan(w * kept.size() / 4, (w + 1) * kept.size() / 4 - w * kept.size() / 4);
+			for (const auto& [x, y] : part) means[w] += y / part.size();
+		}
+		t.growing = std::ranges::adjacent_find(means, std::ranges::greater_equal{}) == means.end() and means[3] - means[0] > std::max(this->floor, means[0] * 0.05);
+		return t;
+	}
+};
+
+class mock_discord {
+	using clock = std::chrono::steady_clock;
+	struct route_limit {
+		std::string_view route;
+		uint64_t limit;
+		std::chrono::milliseconds window;
+	};
+	/* roughly what discord hands out per major parameter. interaction callbacks have no limit and don't count towards the global one */
+	static constexpr route_limit limits[] = {
+		{ "messages.create", 5, std::chrono::milliseconds(5000) },
+		{ "messages.edit", 5, std::chrono::milliseconds(5000) },
+		{ "messages.get", 5, std::chrono::milliseconds(5000) },
+		{ "messages.bulk", 1, std::chrono::milliseconds(1000) },
+		{ "message.get", 5, std::chrono::milliseconds(5000) },
+		{ "commands", 2, std::chrono::milliseconds(60000) }
+	};
+	static constexpr uint64_t global_limit = 50; /* per second */
+	struct window {
+		uint64_t used{};
+		clock::time_point reset{};
+	};
+	struct reply {
+		clock::time_point due{};
+		dpp::command_completion_event_t done{};
+		dpp::confirmation_callback_t result{};
+		bool operator>(const reply& other) const {
+			return this->due > other.due;
+		}
+	};
+	struct route_stats {
+		uint64_t calls{}, limited{};
+	};
+	std::mutex lock{};
+	std::priority_queue<reply, std::vector<reply>, std::greater<>> replies{};
+	/* the bot's timers (after()), kept apart so settle() doesn't wait an hour-long giveaway out */
+	std::priority_queue<reply, std::vector<reply>, std::greater<>> timers{};
+	std::condition_variable_any arrived{};
+	std::unordered_map<std::string, window> windows{};
+	window global{};
+	std::map<std::string, route_stats, std::less<>> routes{};
+	std::mt19937_64 random{ 1 };
+	/* interactions sent and not answered yet, by id */
+	std::unordered_map<uint64_t, clock::time_point> open{};
+	queue_latency answered{};
+	/* messages the bot created, clicked on by the storm until their giveaway ends */
+	struct created_message {
+		uint64_t guild{}, message{};
+		clock::time_point at{};
+	};
+	std::vector<created_message> created{};
+	/* storm giveaways run for an hour, divided by speedup */
+	static constexpr std::chrono::seconds giveaway_length{ 3600 };
+	double speedup = 1.0;
+	uint64_t next_id = 1'000'000;
+	std::jthread worker{};
+
+	/* must hold lock. fills in the rate limit headers, false if the call is answered with a 429 */
+	bool limit(const std::string& bucket, std::string_view route, dpp::http_request_completion_t& http, clock::time_point now) {
+		auto rule = std::ranges::find(limits, route, &route_limit::route);
+		if (rule == std::end(limits)) return true;
+		if (this->global.reset <= now) this->global = { 0, now + std::chrono::seconds(1) };
+		window& w = this->windows[bucket];
+		if (w.reset <= now) w = { 0, now + rule->window };
+		bool global = this->global.used >= global_limit;
+		if (global or w.used >= rule->limit) {
+			http.status = 429;
+			http.ratelimit_global = global;
+			http.ratelimit_retry_after = std::chrono::ceil<std::chrono::seconds>((global ? this->global.reset : w.reset) - now).count();
+			http.body = std::format("{{\"message\": \"You are being rate limited.\", \"retry_after\": {0}, \"global\": {1}}}", http.ratelimit_retry_after, global);
+			return false;
+		}
+		this->global.used++;
+		http.ratelimit_limit = rule->limit;
+		http.ratelimit_remaining = rule->limit - ++w.used;
+		http.ratelimit_reset_after = std::chrono::ceil<std::chrono::seconds>(w.reset - now).count();
+		return true;
+	}
+	void deliver(std::stop_token stop) {
+		while (not stop.stop_requested()) {
+			reply r{};
+			{
+				std::unique_lock<std::mutex> g(this->lock);
+				if (this->replies.empty() and this->timers.empty()) {
+					this->arrived.wait(g, stop, [this] { return not this->replies.empty() or not this->timers.empty(); });
+					continue;
+				}
+				/* whichever queue is due first */
+				auto& queue = (this->timers.empty() or (not this->replies.empty() and this->replies.top().due <= this->timers.top().due)) ? this->replies : this->timers;
+				if (clock::time_point due = queue.top().due; due > clock::now()) {
+					this->arrived.wait_until(g, stop, due, [this, due] {
+						return (not this->replies.empty() and this->replies.top().due < due) or (not this->timers.empty() and this->timers.top().due < due);
+					});
+					continue;
+				}
+				r = std::move(const_cast<reply&>(queue.top()));
+				queue.pop();
+			}
+			try {
+				r.done(r.result);
+			}
+			catch (std::exception& e) {
+				std::cout << e.what() << std::endl;
+			}
+		}
+	}
+	/* must hold lock. an INTERACTION_CREATE dispatch as the gateway sends it */
+	nlohmann::json interaction(uint64_t guild, uint64_t user, uint8_t type, nlohmann::json data) {
+		uint64_t id = this->next_id++;
+		this->open.emplace(id, clock::now());
+		return { { "op", 0 }, { "t", "INTERACTION_CREATE" }, { "d", {
+			{ "id", std::to_string(id) }, { "application_id", "1" }, { "type", type }, { "data", std::move(data) }, { "version", 1 },
+			{ "token", std::format("mock.{0}", id) }, { "guild_id", std::to_string(guild) }, { "channel_id", std::to_string(guild + 1) },
+			{ "channel", { { "id", std::to_string(guild + 1) }, { "guild_id", std::to_string(guild) }, { "type", 0 }, { "name", "mock" } } },
+			{ "member", { { "roles", nlohmann::json::array() }, { "joined_at", "2024-01-01T00:00:00.000000+00:00" },
+				{ "user", { { "id", std::to_string(user) }, { "username", std::format("user{0}", user) }, { "discriminator", "0" } } } } } } } };
+	}
+	static nlohmann::json command(std::string_view name, nlohmann::json options) {
+		return { { "id", "2" }, { "name", name }, { "type", 1 }, { "options", std::move(options) } };
+	}
+	static nlohmann::json option(std::string_view name, uint8_t type, nlohmann::json value) {
+		return { { "name", name }, { "type", type }, { "value", std::move(value) } };
+	}
+public:
+	/* simulated round trip, base plus up to jitter */
+	std::chrono::milliseconds round_trip{ 40 }, jitter{ 20 };
+
+	mock_discord() : worker([this](std::stop_token stop) { this->deliver(stop); }) {}
+	/* rest_scheduler::transport. answers the call the bucket names after round_trip, or with a 429 */
+	void call(const std::string& bucket, dpp::command_completion_event_t done) {
+		std::string_view route = std::string_view(bucket).substr(0, bucket.find('/'));
+		uint64_t major = (route.size() < bucket.size()) ? std::stoull(bucket.substr(route.size() + 1)) : 0;
+		clock::time_point now = clock::now();
+		std::lock_guard<std::mutex> g(this->lock);
+		dpp::confirmation_callback_t result = canned_reply(bucket, [this](uint64_t) { return this->next_id++; });
+		route_stats& stats = this->routes.try_emplace(std::string(route)).first->second;
+		stats.calls++;
+		if (route == "interaction") {
+			if (auto it = this->open.find(major); it not_eq this->open.end()) {
+				this->answered.add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->second).count());
+				this->open.erase(it);
+			}
+		}
+		else if (not this->limit(bucket, route, result.http_info, now)) {
+			stats.limited++;
+			result.value = dpp::confirmation{ true };
+		}
+		else if (route == "messages.create") {
+			/* channels in the storm are their guild's id + 1 */
+			dpp::message& m = std::get<dpp::message>(result.value);
+			m.guild_id = major - 1;
+			this->created.emplace_back(m.guild_id, m.id, now);
+		}
+		std::chrono::milliseconds delay = this->round_trip + std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(0, this->jitter.count())(this->random));
+		this->replies.push({ now + delay, std::move(done), std::move(result) });
+		this->arrived.notify_one();
+	}
+	/* sends count interactions of script, the i-th at start + i / rate */
+	void send(dpp::cluster& cluster, const storm_script& script, const std::vector<dpp::snowflake>& guilds, dpp::etf_parser& etf, clock::time_point start, size_t count) {
+		std::discrete_distribution<int> kinds(script.mix.begin(), script.mix.end());
+		std::uniform_int_distribution<uint64_t> users(1, script.users);
+		for (size_t i = 0; i < count; i++) {
+			std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<uint64_t>(i * 1e9 / script.rate)));
+			nlohmann::json event{};
+			{
+				std::lock_guard<std::mutex> g(this->lock);
+				uint64_t guild = guilds[i % guilds.size()], user = users(this->random) << 22 | 2;
+				int kind = kinds(this->random);
+				/* ended giveaways drop out, their button is gone */
+				clock::time_point ended = clock::now() - std::chrono::duration_cast<clock::duration>(giveaway_length / this->speedup);
+				std::erase_if(this->created, [ended](const created_message& m) { return m.at < ended; });
+				if (kind == 1 and this->created.empty()) kind = 0; /* nothing to click on yet */
+				if (kind == 0)
+					event = this->interaction(guild, user, dpp::it_application_command, command("gcreate", {
+						option("title", dpp::co_string, "mock"), option("description", dpp::co_string, "storm"),
+						option("duration", dpp::co_string, "1h"), option("winners", dpp::co_integer, 1) }));
+				else if (kind == 1) {
+					const created_message& m = this->created[std::uniform_int_distribution<size_t>(0, this->created.size() - 1)(this->random)];
+					event = this->interaction(m.guild, user, dpp::it_component_button, { { "custom_id", std::format(".giveaway.{0}", m.message) }, { "component_type", dpp::cot_button } });
+				}
+				else if (kind == 2) event = this->interaction(guild, user, dpp::it_application_command, command("purge", { option("amount", dpp::co_integer, 10) }));
+				else event = this->interaction(guild, user, dpp::it_application_command, command("lvl", nlohmann::json::array()));
+			}
+			try {
+				inject(cluster, event.dump(), etf);
+			}
+			catch (std::exception& e) {
+				std::cout << e.what() << std::endl;
+			}
+		}
+	}
+	/* waits until nothing is queued anywhere for three looks in a row, replies post more work and that work makes more calls */
+	void settle(lanes& pool, rest_scheduler& rest, clock::time_point deadline) {
+		for (int quiet = 0; quiet < 3 and clock::now() < deadline;) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			bool empty;
+			{
+				std::lock_guard<std::mutex> g(this->lock);
+				empty = this->replies.empty();
+			}
+			quiet = (empty and pool.drained() and rest.idle()) ? quiet + 1 : 0;
+		}
+	}
+	/*
+	 * sends script's interactions through cluster's routers at script.rate per second over zipf-skewed guilds,
+	 * waits for the bot to go quiet and prints end to end latency (interaction in, first response out), per-route 429s
+	 * and allocations per command, failing if a handler run went over its budget
+	 */
+	int storm(dpp::cluster& cluster, lanes& pool, rest_scheduler& rest, allocation_ledger& ledger, const storm_script& script) {
+		size_t total = static_cast<size_t>(script.seconds * script.rate);
+		dpp::etf_parser etf{};
+		this->speedup = script.speedup;
+		clock::time_point start = clock::now();
+		this->send(cluster, script, zipf_guilds(total, script.guilds, 1.1), etf, start, total);
+		double sent = std::chrono::duration<double>(clock::now() - start).count();
+		this->settle(pool, rest, start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(script.seconds)) + std::chrono::minutes(2));
+		double seconds = std::chrono::duration<double>(clock::now() - start).count();
+		std::lock_guard<std::mutex> g(this->lock);
+		std::cout << std::format("{0} interactions over {1:.2f} s ({2:.0f}/s), done after {3:.2f} s, {4} answered, {5} unanswered (cooldowns)\n",
+			total, sent, total / sent, seconds, this->answered.count, this->open.size())
+			<< std::format("end to end: mean {0:.2f} ms, p50 {1:.2f} ms, p99 {2:.2f} ms, max {3:.2f} ms\n",
+				this->answered.mean(), this->answered.percentile(0.5), this->answered.percentile(0.99), this->answered.max_ns / 1e6);
+		for (const auto& [route, stats] : this->routes) std::cout << std::format("{0}: {1} calls, {2} 429s\n", route, stats.calls, stats.limited);
+		for (const std::string& line : rest.report()) std::cout << "rest: " << line << "\n";
+		for (const std::string& line : ledger.report()) std::cout << "allocations: " << line << "\n";
+		std::cout << std::flush;
+		return ledger.over() ? 1 : 0;
+	}
+	/*
+	 * keeps script's storm going for hours, sampling the process and gauges() every interval, then fails with a trend
+	 * report if any series grew without bound. script.seconds is ignored
+	 */
+	int soak(dpp::cluster& cluster, lanes& pool, rest_scheduler& rest, const storm_script& script, double hours,
+		std::function<std::vector<soak_gauge>()> gauges, std::chrono::seconds interval = std::chrono::seconds(60)) {
+		size_t per_round = std::max<size_t>(static_cast<size_t>(interval.count() * script.rate), 1);
+		std::vector<dpp::snowflake> guilds = zipf_guilds(per_round, script.guilds, 1.1);
+		dpp::etf_parser etf{};
+		this->speedup = script.speedup;
+		std::vector<soak_series> series{};
+		clock::time_point start = clock::now(), end = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::ratio<3600>>(hours));
+		std::cout << std::format("soak: {0:.2f} h at {1}/s, timers {2}x, sampling every {3} s", hours, script.rate, script.speedup, interval.count()) << std::endl;
+		while (clock::now() < end) {
+			this->send(cluster, script, guilds, etf, clock::now(), per_round);
+			std::vector<soak_gauge> now = {
+				{ "rss bytes", static_cast<double>(rss()), 16.0 * 1024 * 1024 },
+				{ "threads", static_cast<double>(thread_count()), 2 },
+				{ "handles", static_cast<double>(handle_count()), 32 },
+				{ "lane guild queues", static_cast<double>(pool.tracked()), 16 },
+				{ "rest buckets", static_cast<double>(rest.bucket_count()), 16 }
+			};
+			std::ranges::move(gauges(), std::back_inserter(now));
+			{
+				/* answers that never come (cooldowns) would otherwise pile up here and not in the bot */
+				std::lock_guard<std::mutex> g(this->lock);
+				std::erase_if(this->open, [limit = clock::now() - std::chrono::minutes(1)](const auto& o) { return o.second < limit; });
+			}
+			double at = std::chrono::duration<double, std::ratio<3600>>(clock::now() - start).count();
+			for (const soak_gauge& gauge : now) {
+				auto it = std::ranges::find(series, gauge.name, &soak_series::name);
+				if (it == series.end()) it = series.insert(series.end(), { gauge.name, gauge.floor });
+				it->samples.emplace_back(at, gauge.value);
+			}
+			std::cout << std::format("soak: {0:.2f} h, rss {1} MiB, {2} threads, {3} handles", at, rss() / (1024 * 1024), thread_count(), handle_count()) << std::endl;
+		}
+		this->settle(pool, rest, clock::now() + std::chrono::minutes(2));
+		bool grew = false;
+		std::cout << "soak: series, first, last, min, max, slope per hour, verdict\n";
+		for (const soak_series& s : series) {
+			soak_series::trend t = s.analyse();
+			grew |= t.growing;
+			std::cout << std::format("{0}: {1:.0f}, {2:.0f}, {3:.0f}, {4:.0f}, {5:+.1f}/h, {6}\n", s.name, t.first, t.last, t.min, t.max, t.slope,
+				t.growing ? "GROWING" : t.enough ? "bounded" : "too few samples");
+		}
+		std::cout << std::flush;
+		return grew ? 1 : 0;
+	}
+	/* runs fn after seconds of bot time, speedup times faster on the wall clock. swapped in for dpp's timers, which only tick on a started cluster */
+	void after(double seconds, std::function<void()> fn) {
+		std::lock_guard<std::mutex> g(this->lock);
+		clock::time_point due = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds / this->speedup));
+		this->timers.push({ due, [fn = std::move(fn)](const dpp::confirmation_callback_t&) { fn(); }, {} });
+		this->arrived.notify_one();
+	}
+};
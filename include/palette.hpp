@@ -1,3 +1,4 @@
+#pragma once
 /*
  * color palette. made by LeeEndl
  * goal is to make color blending legible by english readers.
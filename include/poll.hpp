@@ -0,0 +1,217 @@
+#pragma once
+/*
+ * /poll, sized for server-wide votes. a click is a few atomics on whichever thread it arrived on: no lane hop, no copy
+ * of the poll and no edit. every thread counts into its own slice of the option counters, like the metrics counters,
+ * and a voter's choice sits in an open addressed table of user id -> option, so changing a vote is one exchange that
+ * moves one count from the old option to the new one. the chart is redrawn by a timer, only for polls that changed
+ * and at most once per redraw, however many votes came in between.
+ * e.g. poll p("lunch?", { "pizza", "sushi" }, ends); p.vote(user, 1); p.counts();
+ */
+#include <dpp/message.h>
+#include <palette.hpp>
+#include <image.hpp>
+#include <metrics.hpp> // metrics_detail::per_thread
+#include <shared_mutex>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+
+/* user id -> option, 9 bytes a slot at a load between 1/4 and 1/2. it only grows, a vote can be changed but not taken back */
+class voter_table {
+	std::shared_mutex lock{}; /* shared to vote, exclusive to grow */
+	std::unique_ptr<std::atomic<uint64_t>[]> voters{}; /* 0 is a free slot, no user has id 0 */
+	std::unique_ptr<std::atomic<uint8_t>[]> choices{}; /* option + 1, 0 until the first vote lands */
+	size_t bits{}, mask{};
+	std::atomic<size_t> used{};
+
+	/* snowflakes' low bits hardly vary between users, the top of the product mixes in all of them */
+	size_t home(uint64_t voter) const {
+		return static_cast<size_t>((voter * 0x9e3779b97f4a7c15ull) >> (64 - this->bits));
+	}
+	void allocate(size_t bits) {
+		this->bits = bits;
+		this->mask = (size_t{ 1 } << bits) - 1;
+		this->voters = std::make_unique<std::atomic<uint64_t>[]>(this->mask + 1);
+		this->choices = std::make_unique<std::atomic<uint8_t>[]>(this->mask + 1);
+	}
+	void grow() {
+		std::unique_lock<std::shared_mutex> g(this->lock);
+		if (this->used.load(std::memory_order_relaxed) * 2 < this->mask + 1) return; /* another voter grew it first */
+		std::unique_ptr<std::atomic<uint64_t>[]> voters = std::move(this->voters);
+		std::unique_ptr<std::atomic<uint8_t>[]> choices = std::move(this->choices);
+		size_t slots = this->mask + 1;
+		this->allocate(this->bits + 1);
+		for (size_t i = 0; i < slots; i++) {
+			uint64_t voter = voters[i].load(std::memory_order_relaxed);
+			if (not voter) continue;
+			size_t j = this->home(voter);
+			while (this->voters[j].load(std::memory_order_relaxed)) j = (j + 1) & this->mask;
+			this->voters[j].store(voter, std::memory_order_relaxed);
+			this->choices[j].store(choices[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+public:
+	explicit voter_table(size_t bits = 10) {
+		this->allocate(bits);
+	}
+	/*
+	 * records voter's choice and returns the one it replaced, -1 on their first vote. two clicks of the same voter
+	 * racing each other each see the other's choice or none, so exactly one of them counts as the first vote
+	 */
+	int set(uint64_t voter, uint8_t choice) {
+		for (;;) {
+			std::shared_lock<std::shared_mutex> g(this->lock);
+			if (this->used.load(std::memory_order_relaxed) * 2 >= this->mask + 1) {
+				g.unlock();
+				this->grow();
+				continue;
+			}
+			for (size_t i = this->home(voter);; i = (i + 1) & this->mask) {
+				uint64_t v = this->voters[i].load(std::memory_order_acquire);
+				if (v == 0 and this->voters[i].compare_exchange_strong(v, voter, std::memory_order_acq_rel)) this->used.fetch_add(1, std::memory_order_relaxed);
+				else if (v not_eq voter) continue;
+				return static_cast<int>(this->choices[i].exchange(choice + 1, std::memory_order_acq_rel)) - 1;
+			}
+		}
+	}
+	/* voter's choice, -1 if they haven't voted */
+	int get(uint64_t voter) {
+		std::shared_lock<std::shared_mutex> g(this->lock);
+		for (size_t i = this->home(voter);; i = (i + 1) & this->mask) {
+			uint64_t v = this->voters[i].load(std::memory_order_acquire);
+			if (v == 0) return -1;
+			if (v == voter) return static_cast<int>(this->choices[i].load(std::memory_order_acquire)) - 1;
+		}
+	}
+	size_t size() const {
+		return this->used.load(std::memory_order_relaxed);
+	}
+	/* bytes held by the slots */
+	size_t bytes() {
+		std::shared_lock<std::shared_mutex> g(this->lock);
+		return (this->mask + 1) * (sizeof(uint64_t) + sizeof(uint8_t));
+	}
+};
+
+class poll {
+public:
+	static constexpr size_t max_options = 25; /* five rows of five buttons */
+private:
+	struct alignas(64) slice {
+		std::array<std::atomic<int64_t>, max_options> counts{};
+	};
+	metrics_detail::per_thread<slice> slices{};
+	voter_table voters{};
+	std::atomic<uint64_t> changes{}, drawn{};
+
+	/* hershey fonts have no glyphs past ascii, those come out as '?' */
+	static std::string fit(std::string_view text, size_t length) {
+		return (text.size() <= length) ? std::string(text) : std::string(text.substr(0, length - 2)) + "..";
+	}
+public:
+	const std::string question;
+	const std::vector<std::string> options;
+	const time_t ends;
+	dpp::message message{}; /* set once it's posted, before the poll can be found. only touched from its guild's lane */
+	std::atomic<bool> closed{};
+
+	poll(std::string question, std::vector<std::string> options, time_t ends) : question(std::move(question)), options(std::move(options)), ends(ends) {}
+	/* counts user for option (< options.size()) and returns what they voted for before, -1 if nothing */
+	int vote(uint64_t user, size_t option) {
+		int previous = this->voters.set(user, static_cast<uint8_t>(option));
+		if (previous == static_cast<int>(option)) return previous;
+		slice& mine = this->slices.mine();
+		if (previous >= 0) mine.counts[previous].fetch_sub(1, std::memory_order_relaxed);
+		mine.counts[option].fetch_add(1, std::memory_order_relaxed);
+		this->changes.fetch_add(1, std::memory_order_release);
+		return previous;
+	}
+	/* user's vote, -1 if they haven't */
+	int voted(uint64_t user) {
+		return this->voters.get(user);
+	}
+	/* votes per option. read while votes come in, a changed vote can be missing from one option for a moment */
+	std::vector<int64_t> counts() const {
+		std::vector<int64_t> total(this->options.size());
+		this->slices.each([&total](const slice& s)
+			{
+				for (size_t i = 0; i < total.size(); i++) total[i] += s.counts[i].load(std::memory_order_relaxed);
+			});
+		for (int64_t& t : total) t = std::max<int64_t>(t, 0);
+		return total;
+	}
+	size_t turnout() const {
+		return this->voters.size();
+	}
+	size_t voter_bytes() {
+		return this->voters.bytes();
+	}
+	/* true if anyone voted since the last call */
+	bool changed() {
+		uint64_t now = this->changes.load(std::memory_order_acquire);
+		return this->drawn.exchange(now, std::memory_order_acq_rel) not_eq now;
+	}
+	/* the bar chart as png */
+	std::string draw() const {
+		constexpr int width = 600, top = 50, row = 30, label = 180, right = 120;
+		palette text{ blue(), green(), red() }, muted{ blue(150), green(150), red(150) }, bar{ blue(242), green(101), red(88) }, lead{ blue(60), green(170), red(250) };
+		std::vector<int64_t> c = this->counts();
+		int64_t total = 0, peak = 1;
+		for (int64_t n : c) {
+			total += n;
+			peak = std::max(peak, n);
+		}
+		image img({ top + row * static_cast<int>(c.size()) + 15, width }, { blue(43), green(45), red(49) });
+		img.add_text(fit(this->question, 40), { 15, 32 }, cv::FONT_HERSHEY_DUPLEX, text);
+		for (size_t i = 0; i < c.size(); i++) {
+			int y = top + static_cast<int>(i) * row;
+			img.add_text(fit(this->options[i], 13), { 15, y + 20 }, cv::FONT_HERSHEY_PLAIN, muted);
+			int length = static_cast<int>((width - label - right) * c[i] / peak);
+			img.add_rectangle({ label, y + 6 }, { label + std::max(length, 1), y + row - 6 }, (c[i] == peak) ? lead : bar);
+			img.add_text(std::format("{0} ({1:.0f}%)", c[i], (total) ? 100.0 * c[i] / total : 0.0), { width - right + 10, y + 20 }, cv::FONT_HERSHEY_PLAIN, muted);
+		}
+		return img.encoded(".png");
+	}
+};
+
+/* the open polls by message id, looked up from any thread */
+class poll_board {
+	mutable std::shared_mutex lock{};
+	std::unordered_map<dpp::snowflake, std::shared_ptr<poll>> polls{};
+public:
+	/* a chart is redrawn at most this often */
+	std::chrono::seconds redraw{ 5 };
+
+	void add(std::shared_ptr<poll> p) {
+		std::unique_lock<std::shared_mutex> g(this->lock);
+		this->polls.emplace(p->message.id, std::move(p));
+	}
+	std::shared_ptr<poll> find(dpp::snowflake id) const {
+		std::shared_lock<std::shared_mutex> g(this->lock);
+		auto it = this->polls.find(id);
+		return (it == this->polls.end()) ? nullptr : it->second;
+	}
+	std::shared_ptr<poll> remove(dpp::snowflake id) {
+		std::unique_lock<std::shared_mutex> g(this->lock);
+		auto it = this->polls.find(id);
+		if (it == this->polls.end()) return nullptr;
+		std::shared_ptr<poll> p = std::move(it->second);
+		this->polls.erase(it);
+		return p;
+	}
+	/* the polls voted on since the last call, for the redraw timer */
+	std::vector<std::shared_ptr<poll>> changed() const {
+		std::vector<std::shared_ptr<poll>> out{};
+		std::shared_lock<std::shared_mutex> g(this->lock);
+		for (const auto& [id, p] : this->polls)
+			if (p->changed()) out.emplace_back(p);
+		return out;
+	}
+	size_t size() const {
+		std::shared_lock<std::shared_mutex> g(this->lock);
+		return this->polls.size();
+	}
+};
@@ -0,0 +1,53 @@
+#pragma once
+/*
+ * concurrent votes. e.g. neko.exe --bench poll
+ */
+#include <bench_common.hpp>
+#include <poll.hpp>
+#include <random.hpp>
+
+/*
+ * votes from several threads at once, a third of them changing an earlier vote, against one mutex around an unordered_map
+ * (the giveaway's vector search doesn't finish at this size). fails if the counts don't add up to each voter's last choice
+ */
+inline int poll_bench(std::vector<size_t> threads, size_t voters) {
+	constexpr size_t options = 5;
+	bench_checks checks{};
+	for (size_t n : threads) {
+		poll p("bench", std::vector<std::string>(options, "option"), 0);
+		std::mutex lock{};
+		std::unordered_map<uint64_t, uint8_t> map{};
+		std::vector<int64_t> map_counts(options);
+		auto run = [&](auto vote)
+			{
+				std::vector<std::thread> workers{};
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (size_t t = 0; t < n; t++) workers.emplace_back([&, t]
+					{
+						xoshiro256 rng(t + 1);
+						for (size_t i = t; i < voters; i += n) {
+							uint64_t user = (uint64_t{ 1 } << 60) + (i << 22); /* snowflake shaped, only the timestamp bits differ */
+							vote(user, bounded(rng, options));
+							if (i % 3 == 0) vote(user, bounded(rng, options));
+						}
+					});
+				for (std::thread& w : workers) w.join();
+				return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (voters + (voters + 2) / 3);
+			};
+		double table = run([&p](uint64_t user, size_t option) { p.vote(user, option); });
+		double mutex = run([&](uint64_t user, size_t option)
+			{
+				std::lock_guard<std::mutex> g(lock);
+				auto [it, fresh] = map.try_emplace(user, static_cast<uint8_t>(option));
+				if (not fresh) map_counts[it->second]--;
+				it->second = static_cast<uint8_t>(option);
+				map_counts[option]++;
+			});
+		std::vector<int64_t> expected(options), counts = p.counts();
+		for (size_t i = 0; i < voters; i++) expected[p.voted((uint64_t{ 1 } << 60) + (i << 22))]++;
+		checks.expect(counts == expected and p.turnout() == voters, "poll counts");
+		std::cout << std::format("{0} threads: poll {1:.1f} ns/vote, mutex + unordered_map {2:.1f} ns/vote, {3} voters in {4} KiB{5}\n",
+			n, table, mutex, p.turnout(), p.voter_bytes() / 1024, (counts == expected) ? "" : ", COUNTS DIFFER");
+	}
+	return checks.report();
+}
@@ -0,0 +1,122 @@
+#pragma once
+/*
+ * random numbers for draws and game mechanics. xoshiro256** is small, fast and the same on every compiler, so a
+ * seed reproduces a draw anywhere; bounded integers use Lemire's multiply-shift with rejection, unbiased and almost
+ * never dividing. thread_rng() is the per-thread engine for anything that doesn't need replaying.
+ * e.g. xoshiro256 rng(seed); size_t i = bounded(rng, entries.size());
+ */
+#include <random>
+#include <span>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h> // _umul128()
+#endif
+
+/* a 64 bit seed from the OS */
+inline uint64_t random_seed() {
+	std::random_device device{};
+	return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+/* splitmix64, spreads one seed over xoshiro's state so nearby seeds give unrelated streams */
+inline uint64_t splitmix64(uint64_t& x) {
+	uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* xoshiro256** 1.0 (Blackman and Vigna), a UniformRandomBitGenerator so it also works with <random> and std::shuffle */
+class xoshiro256 {
+	std::array<uint64_t, 4> s{};
+public:
+	using result_type = uint64_t;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type{}; }
+
+	explicit xoshiro256(uint64_t seed) {
+		for (uint64_t& word : this->s) word = splitmix64(seed);
+	}
+	result_type operator()() {
+		uint64_t result = std::rotl(this->s[1] * 5, 7) * 9, t = this->s[1] << 17;
+		this->s[2] ^= this->s[0];
+		this->s[3] ^= this->s[1];
+		this->s[1] ^= this->s[2];
+		this->s[0] ^= this->s[3];
+		this->s[2] ^= t;
+		this->s[3] = std::rotl(this->s[3], 45);
+		return result;
+	}
+	/* the same numbers as calling it out.size() times, with the state kept in registers */
+	void fill(std::span<uint64_t> out) {
+		uint64_t s0 = this->s[0], s1 = this->s[1], s2 = this->s[2], s3 = this->s[3];
+		for (uint64_t& o : out) {
+			o = std::rotl(s1 * 5, 7) * 9;
+			uint64_t t = s1 << 17;
+			s2 ^= s0;
+			s3 ^= s1;
+			s1 ^= s2;
+			s0 ^= s3;
+			s2 ^= t;
+			s3 = std::rotl(s3, 45);
+		}
+		this->s = { s0, s1, s2, s3 };
+	}
+};
+
+namespace random_detail {
+	/* the 128 bit product of a and b, high half returned */
+	inline uint64_t multiply(uint64_t a, uint64_t b, uint64_t& low) {
+#ifdef _MSC_VER
+		uint64_t high{};
+		low = _umul128(a, b, &high);
+		return high;
+#else
+		unsigned __int128 p = static_cast<unsigned __int128>(a) * b;
+		low = static_cast<uint64_t>(p);
+		return static_cast<uint64_t>(p >> 64);
+#endif
+	}
+}
+
+/* uniform in [0, range), range > 0. Lemire, "Fast Random Integer Generation in an Interval" (2019) */
+template<typename G> uint64_t bounded(G& rng, uint64_t range) {
+	uint64_t low{}, high = random_detail::multiply(rng(), range, low);
+	if (low < range) {
+		uint64_t threshold = (0 - range) % range; /* 2^64 mod range, the only division and only on the rare slow path */
+		while (low < threshold) high = random_detail::multiply(rng(), range, low);
+	}
+	return high;
+}
+
+/* uniform in [min, max] */
+template<std::integral T, typename G> T between(G& rng, T min, T max) {
+	uint64_t range = static_cast<uint64_t>(max) - static_cast<uint64_t>(min) + 1;
+	return static_cast<T>(static_cast<uint64_t>(min) + ((range == 0) ? rng() : bounded(rng, range)));
+}
+
+/* out.size() values uniform in [0, range), drawn from one bulk fill and redrawn one at a time only when rejected */
+inline void fill_bounded(xoshiro256& rng, std::span<uint64_t> out, uint64_t range) {
+	rng.fill(out);
+	uint64_t threshold = (0 - range) % range;
+	for (uint64_t& o : out) {
+		uint64_t low{};
+		o = random_detail::multiply(o, range, low);
+		while (low < threshold) o = random_detail::multiply(rng(), range, low);
+	}
+}
+
+/* moves k items picked uniformly without replacement to the front of items, in the order they were picked (partial Fisher-Yates) */
+template<typename T, typename G> void sample(G& rng, std::span<T> items, size_t k) {
+	k = std::min(k, items.size());
+	for (size_t i = 0; i < k; i++) std::swap(items[i], items[i + bounded(rng, items.size() - i)]);
+}
+
+/* this thread's engine, seeded from the OS */
+inline xoshiro256& thread_rng() {
+	static thread_local xoshiro256 rng(random_seed());
+	return rng;
+}
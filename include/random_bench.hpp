@@ -0,0 +1,29 @@
+#pragma once
+/*
+ * bounded random integers, old and new. e.g. neko.exe --bench random
+ */
+#include <bench_common.hpp>
+#include <random.hpp>
+
+/*
+ * ns per bounded integer: the old per-call std::uniform_int_distribution over a thread_local default_random_engine,
+ * then xoshiro256** with Lemire's method one at a time through thread_rng() and in bulk
+ */
+inline int random_bench(std::vector<uint64_t> ranges) {
+	std::vector<int> calls(1024);
+	std::vector<uint64_t> out(1024);
+	uint64_t sink = 0;
+	for (uint64_t range : ranges) {
+		double old = cpu_per_item(calls, [&](int)
+			{
+				static thread_local std::default_random_engine random(std::random_device{}());
+				sink += std::uniform_int_distribution<uint64_t>(0, range - 1)(random);
+			});
+		double single = cpu_per_item(calls, [&](int) { sink += bounded(thread_rng(), range); });
+		xoshiro256 rng(1);
+		double bulk = cpu_per_item(std::vector<int>(1), [&](int) { fill_bounded(rng, out, range); sink += out[0]; }) / out.size();
+		std::cout << std::format("range {0}: default_random_engine {1:.2f} ns, xoshiro256** {2:.2f} ns, bulk {3:.2f} ns\n", range, old, single, bulk);
+	}
+	std::cout << std::format("(sink {0})", sink & 1) << std::endl;
+	return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+/*
+ * recorder cost per channel. e.g. neko.exe --bench record
+ */
+#include <bench_common.hpp>
+#include <recording.hpp>
+
+/*
+ * recorder cost with n channels of four speakers each, every speaker sending a minute of 20 ms packets as fast as the
+ * recorder takes them. packets are encrypted up front with libsodium like Discord's, so the decryption is measured too.
+ * files go to a scratch folder that's removed afterwards
+ */
+inline int record_bench(std::vector<size_t> counts) {
+	constexpr size_t speakers = 4, packets = 3000;
+	using seal_t = int (*)(uint8_t* c, const uint8_t* m, unsigned long long mlen, const uint8_t* n, const uint8_t* k);
+	HMODULE sodium = LoadLibraryA("libsodium.dll");
+	seal_t seal = sodium ? reinterpret_cast<seal_t>(GetProcAddress(sodium, "crypto_secretbox_easy")) : nullptr;
+	if (not seal) {
+		std::cout << "record: libsodium.dll not found" << std::endl;
+		return 1;
+	}
+	std::array<uint8_t, 32> key{};
+	std::mt19937 random{ 1 };
+	std::ranges::generate(key, [&random] { return static_cast<uint8_t>(random()); });
+	std::vector<std::string> rtp(packets);
+	for (size_t i = 0; i < packets; i++) {
+		std::array<uint8_t, 24> nonce{ 0x80, 120 };
+		uint32_t timestamp = static_cast<uint32_t>(i * 960);
+		for (int b = 0; b < 2; b++) nonce[2 + b] = static_cast<uint8_t>(i >> (8 * (1 - b)));
+		for (int b = 0; b < 4; b++) nonce[4 + b] = static_cast<uint8_t>(timestamp >> (8 * (3 - b)));
+		std::vector<uint8_t> opus(120, static_cast<uint8_t>(i)), sealed(opus.size() + 16);
+		opus[0] = 0xfc; /* CELT fullband 20 ms, one frame */
+		seal(sealed.data(), opus.data(), opus.size(), nonce.data(), key.data());
+		rtp[i].assign(reinterpret_cast<const char*>(nonce.data()), 12).append(reinterpret_cast<const char*>(sealed.data()), sealed.size());
+	}
+	std::filesystem::path scratch = std::filesystem::temp_directory_path() / "neko-record-bench";
+	bench_checks checks{};
+	for (size_t n : counts) {
+		voice_recorder::totals_t t{};
+		size_t least_free = -1;
+		uint64_t start = thread_cpu();
+		std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+		{
+			voice_recorder recorder{};
+			recorder.root = scratch;
+			for (size_t g = 1; g <= n; g++) recorder.start(g, g);
+			for (size_t i = 0; i < packets; i++) {
+				for (size_t g = 1; g <= n; g++)
+					for (size_t s = 1; s <= speakers; s++) recorder.receive(g, s, rtp[i], key.data());
+				if (i % 50 == 0) least_free = std::min(least_free, recorder.totals().free_blocks);
+			}
+			t = recorder.totals();
+		}
+		double cpu = static_cast<double>(thread_cpu() - start), wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+		std::cout << std::format("{0} channels: {1:.0f} ns cpu per packet, {2:.0f}x realtime, {3} MiB written, {4} pages dropped, at most {5} blocks in use, "
+			"{6} files not opened, {7} blocks not written\n", n, cpu / std::max<uint64_t>(t.packets, 1), packets * 0.02 / wall, t.bytes / (1024 * 1024), t.dropped,
+			2048 - least_free, t.open_failures, t.write_failures);
+		checks.add(t.open_failures, "files not opened");
+		checks.add(t.write_failures, "blocks not written");
+		std::filesystem::remove_all(scratch);
+	}
+	return checks.report();
+}
@@ -0,0 +1,429 @@
+#pragma once
+/*
+ * voice recording for moderators. every speaker in a recorded channel gets an Ogg/Opus file, and the Opus packets
+ * Discord sends are copied into Ogg pages as they are, never decoded or encoded again: the recorder decrypts the raw
+ * RTP packet dpp hands to on_voice_receive itself, with the libsodium.dll dpp already loaded.
+ * pages are built in a fixed pool of blocks allocated up front, and one writer thread writes whole blocks, so memory
+ * stays bounded with hundreds of channels recording and a slow disk drops pages instead of growing.
+ * gaps while someone is quiet are filled with Opus silence frames, so every file of a recording starts at the same
+ * moment and files can be laid over each other, e.g. ffmpeg -i a.opus -i b.opus -filter_complex amix=inputs=2 mixed.ogg
+ * e.g. /record on:true channel:#general, then /record on:false. files land in .\recordings\<guild>\<start>\<user>.opus
+ */
+#include <dpp/cluster.h>
+#include <dpp/discordvoiceclient.h>
+#include <windows.h>
+#include <array>
+#include <span>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <cstring>
+#include <cstdio> // _setmaxstdio
+
+namespace ogg_detail {
+	/* the Ogg page checksum: crc32 with polynomial 0x04c11db7, not reflected, no final xor */
+	inline constexpr std::array<uint32_t, 256> crc_table = []
+		{
+			std::array<uint32_t, 256> t{};
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t r = i << 24;
+				for (int b = 0; b < 8; b++) r = (r & 0x80000000u) ? (r << 1) ^ 0x04c11db7u : (r << 1);
+				t[i] = r;
+			}
+			return t;
+		}();
+	inline uint32_t crc(uint32_t c, std::span<const uint8_t> bytes) {
+		for (uint8_t b : bytes) c = (c << 8) ^ crc_table[((c >> 24) ^ b) & 0xff];
+		return c;
+	}
+	inline void put32(uint8_t* at, uint32_t v) {
+		for (int i = 0; i < 4; i++) at[i] = static_cast<uint8_t>(v >> (8 * i));
+	}
+	inline void put64(uint8_t* at, uint64_t v) {
+		for (int i = 0; i < 8; i++) at[i] = static_cast<uint8_t>(v >> (8 * i));
+	}
+}
+
+namespace recording_detail {
+	/*
+	 * dpp keeps the voice session key private and has no accessor for it. names in an explicit instantiation skip
+	 * access checks, so instantiating expose with the member hands out a pointer to it through secret_key()
+	 */
+	using key_member = uint8_t* dpp::discord_voice_client::*;
+	key_member secret_key();
+	template<key_member M> struct expose {
+		friend key_member secret_key() {
+			return M;
+		}
+	};
+	template struct expose<&dpp::discord_voice_client::secret_key>;
+}
+
+/* 48 kHz samples in an opus packet, from its TOC byte (RFC 6716 3.1). 0 if it's malformed */
+inline uint32_t opus_samples(std::span<const uint8_t> packet) {
+	if (packet.empty()) return 0;
+	uint8_t config = packet[0] >> 3;
+	/* per frame, in 1/400 s: SILK 10/20/40/60 ms, hybrid 10/20 ms, CELT 2.5/5/10/20 ms */
+	static constexpr uint32_t silk[] = { 4, 8, 16, 24 }, hybrid[] = { 4, 8 }, celt[] = { 1, 2, 4, 8 };
+	uint32_t frame = (config < 12) ? silk[config % 4] : (config < 16) ? hybrid[config % 2] : celt[config % 4];
+	uint32_t frames = 1;
+	switch (packet[0] & 3) {
+	case 0: frames = 1; break;
+	case 1: case 2: frames = 2; break;
+	default:
+		if (packet.size() < 2) return 0;
+		frames = packet[1] & 0x3f;
+	}
+	return frames * frame * 120;
+}
+
+/* a fixed set of equal blocks taken from one allocation, handed out and back by index. left uninitialised so the OS only backs blocks once used */
+class page_pool {
+	std::unique_ptr<uint8_t[]> memory{};
+	std::mutex lock{};
+	std::vector<uint32_t> free{};
+public:
+	const size_t block;
+
+	page_pool(size_t blocks, size_t block) : memory(std::make_unique_for_overwrite<uint8_t[]>(blocks * block)), block(block) {
+		this->free.reserve(blocks);
+		for (size_t i = blocks; i-- > 0;) this->free.emplace_back(static_cast<uint32_t>(i));
+	}
+	/* nothing when every block is taken, the caller drops what it had */
+	std::optional<uint32_t> take() {
+		std::lock_guard<std::mutex> g(this->lock);
+		if (this->free.empty()) return std::nullopt;
+		uint32_t b = this->free.back();
+		this->free.pop_back();
+		return b;
+	}
+	void give(uint32_t b) {
+		std::lock_guard<std::mutex> g(this->lock);
+		this->free.emplace_back(b);
+	}
+	uint8_t* data(uint32_t b) {
+		return this->memory.get() + static_cast<size_t>(b) * this->block;
+	}
+	size_t available() {
+		std::lock_guard<std::mutex> g(this->lock);
+		return this->free.size();
+	}
+};
+
+class voice_recorder {
+	/* a filled block on its way to disk */
+	struct write_t {
+		std::shared_ptr<std::ofstream> file{};
+		uint32_t block{}, size{};
+	};
+	/*
+	 * one speaker's Ogg stream. packets are laced into a staged page, finished pages are appended to the stream's block,
+	 * and the block goes to the writer when the next page doesn't fit or the writer comes round to seal it
+	 */
+	struct stream {
+		static constexpr size_t body_cap = 4096, packets_per_page = 50; /* a page is at most a second of 20 ms packets */
+		std::shared_ptr<std::ofstream> file{};
+		uint32_t serial{}, sequence{};
+		uint64_t granule{}; /* samples written, 48 kHz */
+		uint32_t ssrc{}, next_timestamp{}; /* rtp timestamp the next packet should carry */
+		bool started = false;
+		std::array<uint8_t, 255> lacing{};
+		size_t segments = 0, packets = 0;
+		std::array<uint8_t, body_cap> body{};
+		size_t body_size = 0;
+		std::optional<uint32_t> block{};
+		size_t used = 0;
+	};
+	struct session {
+		std::mutex lock{};
+		dpp::snowflake channel{};
+		std::filesystem::path dir{};
+		std::chrono::steady_clock::time_point since{};
+		std::unordered_map<dpp::snowflake, std::unique_ptr<stream>> speakers{};
+		std::array<uint8_t, 4096> plain{}; /* decrypted payload, reused for every packet */
+	};
+	/* the few libsodium calls needed, found in the dll dpp already loaded */
+	struct sodium {
+		int (*open)(uint8_t* m, const uint8_t* c, unsigned long long clen, const uint8_t* n, const uint8_t* k) = nullptr;
+		static const sodium& library() {
+			static const sodium loaded = []
+				{
+					sodium s{};
+					if (HMODULE dll = LoadLibraryA("libsodium.dll"))
+						s.open = reinterpret_cast<decltype(s.open)>(GetProcAddress(dll, "crypto_secretbox_open_easy"));
+					return s;
+				}();
+			return loaded;
+		}
+	};
+	static constexpr std::array<uint8_t, 3> silence = { 0xf8, 0xff, 0xfe }; /* one 20 ms CELT frame of nothing */
+	static constexpr uint32_t silence_samples = 960;
+	/* a gap in one speaker's rtp timestamps longer than this is taken from the clock instead, e.g. after a reconnect */
+	static constexpr uint32_t max_gap = 48000 * 600;
+
+	const std::chrono::milliseconds flush; /* how long a page may wait in a half-filled block */
+	page_pool pool;
+	std::shared_mutex sessions_lock{};
+	std::unordered_map<dpp::snowflake, std::shared_ptr<session>> sessions{};
+	std::mutex queue_lock{};
+	std::condition_variable_any queue_ready{};
+	std::vector<write_t> queue{};
+	std::atomic<uint64_t> packets{}, bytes{}, dropped{}, rejected{}, open_failures{}, write_failures{};
+
+	void seal(stream& s) {
+		if (not s.block) return;
+		if (s.used == 0) this->pool.give(*s.block);
+		else {
+			std::lock_guard<std::mutex> g(this->queue_lock);
+			this->queue.emplace_back(s.file, *s.block, static_cast<uint32_t>(s.used));
+		}
+		s.block.reset();
+		s.used = 0;
+		this->queue_ready.notify_one();
+	}
+	/* finishes the staged page into the stream's block. a page that finds no block is dropped, the sequence number shows the gap */
+	void close_page(stream& s, bool last = false) {
+		if (s.packets == 0 and not last) return;
+		size_t header = 27 + s.segments, size = header + s.body_size;
+		if (s.block and s.used + size > this->pool.block) this->seal(s);
+		if (not s.block) s.block = this->pool.take();
+		if (s.block) {
+			uint8_t* page = this->pool.data(*s.block) + s.used;
+			std::memcpy(page, "OggS", 4);
+			page[4] = 0;
+			page[5] = (s.sequence == 0 ? 0x02 : 0x00) | (last ? 0x04 : 0x00);
+			ogg_detail::put64(page + 6, s.granule);
+			ogg_detail::put32(page + 14, s.serial);
+			ogg_detail::put32(page + 18, s.sequence);
+			ogg_detail::put32(page + 22, 0);
+			page[26] = static_cast<uint8_t>(s.segments);
+			std::memcpy(page + 27, s.lacing.data(), s.segments);
+			std::memcpy(page + header, s.body.data(), s.body_size);
+			ogg_detail::put32(page + 22, ogg_detail::crc(0, { page, size }));
+			s.used += size;
+		}
+		else this->dropped++;
+		s.sequence++;
+		s.segments = s.packets = s.body_size = 0;
+	}
+	void add(stream& s, std::span<const uint8_t> packet, uint32_t samples) {
+		size_t segments = packet.size() / 255 + 1;
+		if (s.segments + segments > s.lacing.size() or s.body_size + packet.size() > s.body.size() or s.packets == stream::packets_per_page) this->close_page(s);
+		for (size_t i = 0; i < segments; i++) s.lacing[s.segments++] = static_cast<uint8_t>((i + 1 < segments) ? 255 : packet.size() % 255);
+		std::memcpy(s.body.data() + s.body_size, packet.data(), packet.size());
+		s.body_size += packet.size();
+		s.packets++;
+		s.granule += samples;
+	}
+	/* OpusHead and OpusTags (RFC 7845), each on a page of its own with granule 0 */
+	void headers(stream& s, dpp::snowflake guild, dpp::snowflake channel, dpp::snowflake user) {
+		std::array<uint8_t, 19> head{ 'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, 2 };
+		ogg_detail::put32(head.data() + 12, 48000);
+		this->add(s, head, 0);
+		this->close_page(s);
+		std::string vendor = "neko";
+		std::vector<std::string> comments = { std::format("GUILD={0}", static_cast<uint64_t>(guild)), std::format("CHANNEL={0}", static_cast<uint64_t>(channel)),
+			std::format("USER={0}", static_cast<uint64_t>(user)), std::format("STARTED={0}", time(0)) };
+		std::vector<uint8_t> tags(8 + 4 + vendor.size() + 4);
+		std::memcpy(tags.data(), "OpusTags", 8);
+		ogg_detail::put32(tags.data() + 8, static_cast<uint32_t>(vendor.size()));
+		std::memcpy(tags.data() + 12, vendor.data(), vendor.size());
+		ogg_detail::put32(tags.data() + 12 + vendor.size(), static_cast<uint32_t>(comments.size()));
+		for (const std::string& c : comments) {
+			size_t at = tags.size();
+			tags.resize(at + 4 + c.size());
+			ogg_detail::put32(tags.data() + at, static_cast<uint32_t>(c.size()));
+			std::memcpy(tags.data() + at + 4, c.data(), c.size());
+		}
+		this->add(s, tags, 0);
+		this->close_page(s);
+	}
+	/* silence until the stream reaches samples */
+	void pad(stream& s, uint64_t samples) {
+		while (s.granule + silence_samples <= samples) this->add(s, silence, silence_samples);
+	}
+	/* the opus payload of an rtp packet (xsalsa20_poly1305, the mode this dpp negotiates), decrypted into plain */
+	static std::span<const uint8_t> payload(std::string_view raw, const uint8_t* key, std::span<uint8_t> plain) {
+		constexpr size_t rtp_header = 12, mac = 16;
+		const uint8_t* packet = reinterpret_cast<const uint8_t*>(raw.data());
+		const sodium& s = sodium::library();
+		if (not key or not s.open or raw.size() <= rtp_header + mac or raw.size() - rtp_header - mac > plain.size()) return {};
+		if ((packet[0] & 0xc0) not_eq 0x80 or (packet[1] & 0x7f) not_eq 120) return {}; /* rtp version 2, opus */
+		std::array<uint8_t, 24> nonce{};
+		std::memcpy(nonce.data(), packet, rtp_header);
+		if (s.open(plain.data(), packet + rtp_header, raw.size() - rtp_header, nonce.data(), key) not_eq 0) return {};
+		size_t size = raw.size() - rtp_header - mac, at = (packet[0] & 0x0f) * 4; /* csrcs */
+		if (at < size and (packet[0] & 0x10) and size >= at + 4) at += 4 + 4 * ((plain[at + 2] << 8) | plain[at + 3]); /* header extension */
+		if (at < size and (packet[0] & 0x20)) size -= std::min<size_t>(plain[size - 1], size - at); /* padding */
+		return (at < size) ? plain.subspan(at, size - at) : std::span<const uint8_t>();
+	}
+	void writes(std::stop_token stop) {
+		std::vector<write_t> batch{};
+		std::chrono::steady_clock::time_point sealed = std::chrono::steady_clock::now();
+		while (not stop.stop_requested()) {
+			{
+				std::unique_lock<std::mutex> g(this->queue_lock);
+				this->queue_ready.wait_for(g, stop, this->flush, [this] { return this->queue.size() >= 16; });
+				batch.swap(this->queue);
+			}
+			for (write_t& w : batch) {
+				if (not w.file->write(reinterpret_cast<const char*>(this->pool.data(w.block)), w.size)) {
+					this->write_failures++;
+					w.file->clear(); /* e.g. a full disk, the next block tries again */
+				}
+				this->pool.give(w.block);
+			}
+			batch.clear(); /* drops the last reference to a stopped speaker's file, closing it */
+			/* quiet speakers' half-filled blocks go out at least once per flush */
+			if (std::chrono::steady_clock::now() - sealed >= this->flush) {
+				sealed = std::chrono::steady_clock::now();
+				std::shared_lock<std::shared_mutex> g(this->sessions_lock);
+				for (auto& [guild, rec] : this->sessions) {
+					std::lock_guard<std::mutex> l(rec->lock);
+					for (auto& [user, s] : rec->speakers) this->seal(*s);
+				}
+			}
+		}
+	}
+	void finish(session& rec) {
+		std::lock_guard<std::mutex> g(rec.lock);
+		for (auto& [user, s] : rec.speakers) {
+			this->close_page(*s, true);
+			this->seal(*s);
+		}
+		rec.speakers.clear();
+	}
+	std::jthread writer; /* last, so it stops before the pool and queue go away */
+public:
+	/* where recordings go, a folder per guild and start time under it */
+	std::filesystem::path root = ".\\recordings\\";
+
+	/* @param blocks @param block bytes each, together the most memory recordings may hold before they drop pages */
+	voice_recorder(size_t blocks = 2048, size_t block = 16 * 1024, std::chrono::milliseconds flush = std::chrono::seconds(5))
+		: flush(flush), pool(blocks, block), writer([this](std::stop_token stop) { this->writes(stop); }) {
+		/* every speaker holds a file open, the crt allows 512 by default and 8192 at most */
+		_setmaxstdio(8192);
+	}
+	~voice_recorder() {
+		std::vector<std::shared_ptr<session>> left{};
+		{
+			std::unique_lock<std::shared_mutex> g(this->sessions_lock);
+			for (auto& [guild, rec] : this->sessions) left.emplace_back(rec);
+			this->sessions.clear();
+		}
+		for (std::shared_ptr<session>& rec : left) this->finish(*rec);
+		this->writer.request_stop();
+		this->writer.join();
+		for (write_t& w : this->queue)
+			if (not w.file->write(reinterpret_cast<const char*>(this->pool.data(w.block)), w.size)) this->write_failures++;
+	}
+	/* starts recording guild's voice channel, returns the folder the files go to. empty if it's already recording */
+	std::string start(dpp::snowflake guild, dpp::snowflake channel) {
+		std::shared_ptr<session> rec = std::make_shared<session>();
+		rec->channel = channel;
+		rec->since = std::chrono::steady_clock::now();
+		rec->dir = this->root / std::format("{0}", static_cast<uint64_t>(guild)) / std::format("{0}", time(0));
+		std::unique_lock<std::shared_mutex> g(this->sessions_lock);
+		if (not this->sessions.try_emplace(guild, rec).second) return {};
+		std::filesystem::create_directories(rec->dir);
+		return rec->dir.string();
+	}
+	/* false if guild wasn't recording. closes every speaker's file once its last block is written */
+	bool stop(dpp::snowflake guild) {
+		std::shared_ptr<session> rec{};
+		{
+			std::unique_lock<std::shared_mutex> g(this->sessions_lock);
+			auto it = this->sessions.find(guild);
+			if (it == this->sessions.end()) return false;
+			rec = std::move(it->second);
+			this->sessions.erase(it);
+		}
+		this->finish(*rec);
+		return true;
+	}
+	bool recording(dpp::snowflake guild) {
+		std::shared_lock<std::shared_mutex> g(this->sessions_lock);
+		return this->sessions.contains(guild);
+	}
+	/* called from dpp's voice threads for every packet heard, one speaker at a time. costs one map lookup while not recording */
+	void receive(const dpp::voice_receive_t& event) {
+		if (event.voice_client) this->receive(event.voice_client->server_id, event.user_id, event.raw_event, (*event.voice_client).*recording_detail::secret_key());
+	}
+	/* one encrypted rtp packet from user, key is the voice connection's 32 byte session key */
+	void receive(dpp::snowflake guild, dpp::snowflake user, std::string_view raw, const uint8_t* key) {
+		if (not user) return;
+		std::shared_ptr<session> rec{};
+		{
+			std::shared_lock<std::shared_mutex> g(this->sessions_lock);
+			auto it = this->sessions.find(guild);
+			if (it == this->sessions.end()) return;
+			rec = it->second;
+		}
+		std::lock_guard<std::mutex> g(rec->lock);
+		std::span<const uint8_t> opus = payload(raw, key, rec->plain);
+		uint32_t samples = opus_samples(opus);
+		if (not samples) {
+			this->rejected++;
+			return;
+		}
+		const uint8_t* rtp = reinterpret_cast<const uint8_t*>(raw.data());
+		uint32_t timestamp = (rtp[4] << 24) | (rtp[5] << 16) | (rtp[6] << 8) | rtp[7], ssrc = (rtp[8] << 24) | (rtp[9] << 16) | (rtp[10] << 8) | rtp[11];
+		std::unique_ptr<stream>& slot = rec->speakers[user];
+		if (not slot) {
+			slot = std::make_unique<stream>();
+			slot->serial = static_cast<uint32_t>(user) ^ static_cast<uint32_t>(time(0));
+			slot->file = std::make_shared<std::ofstream>(rec->dir / std::format("{0}.opus", static_cast<uint64_t>(user)), std::ios::binary | std::ios::trunc);
+			if (slot->file->is_open()) {
+				slot->file->rdbuf()->pubsetbuf(nullptr, 0); /* blocks are the buffering */
+				this->headers(*slot, guild, rec->channel, user);
+			}
+			else {
+				/* the speaker stays in the session without a file, so it's counted once and not retried per packet */
+				this->open_failures++;
+				slot->file.reset();
+			}
+		}
+		stream& s = *slot;
+		if (not s.file) return;
+		/* rtp timestamps place a packet within one connection, the clock places the first one and anything after a reconnect */
+		uint32_t gap = timestamp - s.next_timestamp;
+		if (s.started and s.ssrc == ssrc and gap < max_gap) this->pad(s, s.granule + gap);
+		else if (not s.started or s.ssrc not_eq ssrc or gap < 0x80000000u)
+			this->pad(s, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - rec->since).count() * 48);
+		else return; /* older than what's written */
+		s.started = true;
+		s.ssrc = ssrc;
+		s.next_timestamp = timestamp + samples;
+		this->add(s, opus, samples);
+		this->packets++;
+		this->bytes += opus.size();
+	}
+	struct totals_t {
+		size_t recording{}, speakers{};
+		uint64_t packets{}, bytes{}; /* opus payload written */
+		uint64_t dropped{}; /* pages that found no free block */
+		uint64_t open_failures{}, write_failures{}; /* speakers whose file didn't open, blocks that didn't reach disk */
+		uint64_t rejected{}; /* packets that weren't opus or didn't decrypt */
+		size_t free_blocks{};
+	};
+	totals_t totals() {
+		totals_t t{ 0, 0, this->packets, this->bytes, this->dropped, this->open_failures, this->write_failures, this->rejected, this->pool.available() };
+		std::shared_lock<std::shared_mutex> g(this->sessions_lock);
+		t.recording = this->sessions.size();
+		for (auto& [guild, rec] : this->sessions) {
+			std::lock_guard<std::mutex> l(rec->lock);
+			t.speakers += rec->speakers.size();
+		}
+		return t;
+	}
+};
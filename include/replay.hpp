@@ -0,0 +1,228 @@
+#pragma once
+/*
+ * gateway capture and replay. the recorder appends the raw payload of every interaction the bot is dispatched
+ * (JSON or ETF, whichever the shard speaks) to a binary log; replay() decodes the log and calls the cluster's
+ * routers with it, so the real handlers, lanes and REST scheduler run offline against a sink instead of Discord.
+ * e.g. /capture on:true, then neko.exe --replay .\captures\1700000000.bin --speed 10
+ *
+ * file: "NEKOCAP1", then per event [uint64 ns since the capture started][uint32 size][payload], little endian
+ */
+#include <dpp/cluster.h>
+#include <dpp/etf.h>
+#include <dpp/nlohmann/json.hpp>
+#include <lanes.hpp>
+#include <rest.hpp>
+#include <alloc.hpp>
+#include <fstream>
+#include <filesystem>
+#include <unordered_set>
+#include <deque>
+#include <iostream>
+#include <format>
+
+inline constexpr std::string_view capture_magic = "NEKOCAP1";
+
+class gateway_recorder {
+	std::mutex lock{};
+	std::ofstream out{};
+	std::chrono::steady_clock::time_point since{};
+	std::atomic<bool> on{};
+public:
+	/* starts a new capture in .\captures\, returns its path */
+	std::string start() {
+		std::lock_guard<std::mutex> g(this->lock);
+		std::filesystem::create_directories(".\\captures\\");
+		std::string path = std::format(".\\captures\\{0}.bin", time(0));
+		this->out = std::ofstream{ path, std::ios::binary | std::ios::trunc };
+		this->out.write(capture_magic.data(), capture_magic.size());
+		this->since = std::chrono::steady_clock::now();
+		this->on = true;
+		return path;
+	}
+	void stop() {
+		std::lock_guard<std::mutex> g(this->lock);
+		this->on = false;
+		this->out.close();
+	}
+	bool recording() const {
+		return this->on;
+	}
+	/* called from the shard threads, costs one atomic load while not recording */
+	void record(const dpp::event_dispatch_t& event) {
+		if (not this->on) return;
+		uint64_t at = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->since).count();
+		uint32_t size = static_cast<uint32_t>(event.raw_event.size());
+		std::lock_guard<std::mutex> g(this->lock);
+		if (not this->on) return;
+		this->out.write(reinterpret_cast<const char*>(&at), sizeof(at));
+		this->out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		this->out.write(event.raw_event.data(), size);
+	}
+};
+
+/* every event of a capture with its offset from the first one, empty if file isn't a capture */
+inline std::vector<std::pair<uint64_t, std::string>> read_capture(const std::string& file) {
+	std::vector<std::pair<uint64_t, std::string>> events{};
+	std::ifstream in{ file, std::ios::binary };
+	std::string magic(capture_magic.size(), '\0');
+	if (not in.read(magic.data(), magic.size()) or magic not_eq capture_magic) return events;
+	for (uint64_t at; in.read(reinterpret_cast<char*>(&at), sizeof(at));) {
+		uint32_t size{};
+		std::string payload{};
+		if (not in.read(reinterpret_cast<char*>(&size), sizeof(size))) break;
+		payload.resize(size);
+		if (not in.read(payload.data(), size)) break; /* cut short while recording */
+		events.emplace_back(at, std::move(payload));
+	}
+	uint64_t first = events.empty() ? 0 : events.front().first;
+	for (auto& [at, payload] : events) at -= first;
+	return events;
+}
+
+/* a captured payload as json, whichever the shard spoke */
+inline nlohmann::json decode(const std::string& payload, dpp::etf_parser& etf) {
+	/* ETF starts with its version byte, 131 */
+	return (not payload.empty() and static_cast<uint8_t>(payload.front()) == 131) ? etf.parse(payload) : nlohmann::json::parse(payload);
+}
+
+/* decodes one captured payload and calls the router dpp would have called. false if no router takes it */
+inline bool inject(dpp::cluster& cluster, const std::string& payload, dpp::etf_parser& etf) {
+	nlohmann::json j = decode(payload, etf);
+	if (not j["t"].is_string() or j["t"] not_eq "INTERACTION_CREATE") return false;
+	dpp::interaction i{};
+	i.cache_policy = cluster.cache_policy;
+	i.fill_from_json(&j["d"]);
+	if (i.type == dpp::it_application_command) {
+		dpp::slashcommand_t event(nullptr, payload);
+		event.command = std::move(i);
+		cluster.on_slashcommand.call(event);
+		return true;
+	}
+	if (i.type == dpp::it_component_button) {
+		dpp::button_click_t event(nullptr, payload);
+		dpp::component_interaction data = i.get_component_interaction();
+		event.custom_id = data.custom_id;
+		event.component_type = data.component_type;
+		event.command = std::move(i);
+		cluster.on_button_click.call(event);
+		return true;
+	}
+	return false;
+}
+
+/* a message shaped like the ones the bot posts, an embed and one row with one button */
+inline dpp::message canned_message(uint64_t id, uint64_t channel) {
+	dpp::message m(channel, dpp::embed());
+	m.id = id;
+	m.add_component(dpp::component().add_component(dpp::component().set_id("nullptr")));
+	return m;
+}
+
+/*
+ * a successful answer to a call on bucket (see bucket() in rest.hpp), shaped like discord's. a message it creates gets
+ * id(channel) as its id, fetched ones get made up ids. used by the replay sink and the mock
+ */
+inline dpp::confirmation_callback_t canned_reply(std::string_view bucket, const std::function<uint64_t(uint64_t channel)>& id) {
+	std::string_view route = bucket.substr(0, bucket.find('/'));
+	uint64_t major = (route.size() < bucket.size()) ? std::stoull(std::string(bucket.substr(route.size() + 1))) : 0;
+	dpp::http_request_completion_t http{};
+	http.status = (route == "interaction") ? 204 : 200;
+	http.body = "{}";
+	dpp::confirmable_t value = dpp::confirmation{ true };
+	if (route == "messages.create") value = canned_message(id(major), major);
+	else if (route == "messages.edit" or route == "message.get") value = canned_message(1, major);
+	else if (route == "messages.get") {
+		dpp::message_map messages{};
+		for (uint64_t i = 1; i <= 10; i++) {
+			dpp::message m = canned_message(i, major);
+			messages.emplace(m.id, std::move(m));
+		}
+		value = std::move(messages);
+	}
+	else if (route == "commands") value = dpp::slashcommand_map{};
+	return dpp::confirmation_callback_t(nullptr, value, http);
+}
+
+/*
+ * the ids of the messages the capture's clicks are on, per channel in the order they were first clicked. the replay
+ * sink hands them out to the messages the bot creates in that channel, so replayed clicks find the giveaways and
+ * polls the replayed commands made instead of missing every time
+ */
+inline std::unordered_map<uint64_t, std::deque<uint64_t>> clicked_messages(const std::vector<std::pair<uint64_t, std::string>>& events, dpp::etf_parser& etf) {
+	std::unordered_map<uint64_t, std::deque<uint64_t>> out{};
+	std::unordered_set<uint64_t> seen{};
+	for (const auto& [at, payload] : events) {
+		try {
+			nlohmann::json j = decode(payload, etf);
+			if (not j["t"].is_string() or j["t"] not_eq "INTERACTION_CREATE") continue;
+			const nlohmann::json& d = j["d"];
+			if (d.value("type", 0) not_eq dpp::it_component_button or not d.contains("message") or not d.contains("channel_id")) continue;
+			uint64_t message = dpp::snowflake_not_null(&d["message"], "id"), channel = dpp::snowflake_not_null(&d, "channel_id");
+			if (seen.insert(message).second) out[channel].push_back(message);
+		}
+		catch (std::exception&) {} /* counted as undecodable when it's replayed */
+	}
+	return out;
+}
+
+/*
+ * feeds a capture through cluster's routers at speed times the recorded pace (0 for as fast as possible),
+ * waits for the lanes to drain and prints throughput, latency and allocations. cluster is never started
+ * and rest must be a sink, so nothing touches the network. fails if a handler run went over its allocation budget
+ */
+inline int replay(dpp::cluster& cluster, lanes& pool, rest_scheduler& rest, allocation_ledger& ledger, const std::string& file, double speed) {
+	std::vector<std::pair<uint64_t, std::string>> events = read_capture(file); /* all in memory first, so disk isn't timed */
+	if (events.empty()) {
+		std::cout << std::format("no events in {0}", file) << std::endl;
+		return 1;
+	}
+	dpp::etf_parser etf{};
+	struct ids_t {
+		std::mutex lock{};
+		std::unordered_map<uint64_t, std::deque<uint64_t>> clicked{};
+		uint64_t next = 1'000'000;
+	};
+	std::shared_ptr<ids_t> ids = std::make_shared<ids_t>();
+	ids->clicked = clicked_messages(events, etf);
+	rest.canned = [ids](const std::string& bucket)
+		{
+			std::lock_guard<std::mutex> g(ids->lock);
+			return canned_reply(bucket, [&ids](uint64_t channel)
+				{
+					auto it = ids->clicked.find(channel);
+					if (it == ids->clicked.end() or it->second.empty()) return ids->next++;
+					uint64_t id = it->second.front();
+					it->second.pop_front();
+					return id;
+				});
+		};
+	size_t routed = 0, failed = 0;
+	allocation_count before = allocations();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (const auto& [at, payload] : events) {
+		if (speed > 0.0) std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<uint64_t>(at / speed)));
+		try {
+			routed += inject(cluster, payload, etf);
+		}
+		catch (std::exception& e) {
+			failed++;
+			std::cout << e.what() << std::endl;
+		}
+	}
+	while (not pool.drained() or not rest.idle()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	allocation_count after = allocations();
+	queue_latency wait{}, run = pool.run_time();
+	for (const auto& [guild, latency] : pool.latency()) wait.merge(latency);
+	std::cout << std::format("{0} events, {1} routed, {2} undecodable, {3:.2f} s at {4}\n", events.size(), routed, failed, seconds,
+		(speed > 0.0) ? std::format("{0}x", speed) : std::string("max"))
+		<< std::format("throughput: {0:.0f} events/s\n", routed / seconds)
+		<< std::format("queue wait: mean {0:.3f} ms, p50 {1:.3f} ms, p99 {2:.3f} ms, max {3:.3f} ms\n", wait.mean(), wait.percentile(0.5), wait.percentile(0.99), wait.max_ns / 1e6)
+		<< std::format("handler:    mean {0:.3f} ms, p50 {1:.3f} ms, p99 {2:.3f} ms, max {3:.3f} ms\n", run.mean(), run.percentile(0.5), run.percentile(0.99), run.max_ns / 1e6)
+		<< std::format("allocations: {0:.1f}/event, {1:.0f} bytes/event (decoding included)\n",
+			static_cast<double>(after.count - before.count) / events.size(), static_cast<double>(after.bytes - before.bytes) / events.size())
+		<< std::format("rest: {0} calls sunk, answered with canned replies\n", rest.sunk_calls());
+	for (const std::string& line : ledger.report()) std::cout << "allocations: " << line << "\n";
+	std::cout << std::flush;
+	return ledger.over() ? 1 : 0;
+}
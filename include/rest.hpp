@@ -0,0 +1,318 @@
+#pragma once
+/*
+ * priority-aware outbound REST. every call the bot makes goes through submit() with a priority and a rate limit bucket:
+ * interaction responses are sent straight away, user-visible edits while a slot is free, and background work
+ * (bulk deletes, file uploads, message fetches) only when nothing more urgent is waiting.
+ * at most one call per bucket is handed to dpp at a time, so a rate limited bucket waits here instead of
+ * parking one of dpp's request threads and everything queued behind it.
+ *
+ * the rate limit headers of every reply are kept per bucket. a call whose bucket is known to be spent is held until
+ * it resets instead of being sent to collect a 429, calls sharing a merge key collapse into the newest one while
+ * they wait, and a run of global 429s opens a breaker that holds everything but interaction responses.
+ *
+ * e.g. rest->submit(rp_visible, bucket("messages.edit", channel_id), [m](auto done) { bot->message_edit(m, done); });
+ */
+#include <dpp/restresults.h>
+#include <lanes.hpp> // queue_latency
+#include <metrics.hpp>
+#include <trace.hpp>
+#include <unordered_set>
+#include <map>
+#include <format>
+
+enum rest_priority : uint8_t {
+	rp_interaction, /* acknowledgements and replies, discord drops the interaction after 3s */
+	rp_visible, /* edits users are looking at, e.g. giveaway entry counts */
+	rp_background /* bulk deletes, uploads, fetches */
+};
+
+/*
+ * rate limit bucket of a route and its major parameter, e.g. bucket("messages.create", channel_id).
+ * discord limits each route separately, so a route gets its own name even when it shares the major parameter
+ */
+inline std::string bucket(std::string_view route, dpp::snowflake major) {
+	return std::format("{0}/{1}", route, static_cast<uint64_t>(major));
+}
+
+class rest_scheduler {
+public:
+	/* issues one dpp REST call and passes it done as the completion callback */
+	using call_t = std::function<void(dpp::command_completion_event_t done)>;
+private:
+	using clock = std::chrono::steady_clock;
+	struct job {
+		call_t call{};
+		std::vector<dpp::command_completion_event_t> callbacks{}; /* one per submit merged into this job */
+		std::string bucket{}, merge{};
+		rest_priority priority{};
+		clock::time_point queued{};
+		uint8_t attempts{};
+		bool held{}; /* already counted as an avoided 429 */
+		uint64_t trace{}; /* interaction it was submitted for, see trace.hpp */
+		histogram* round_trip{}; /* its route's series, when there are metrics */
+	};
+	struct bucket_state {
+		uint64_t remaining = 1;
+		clock::time_point reset{};
+	};
+	std::mutex lock{};
+	std::array<std::deque<job>, 3> pending{};
+	std::array<size_t, 3> in_flight{};
+	std::unordered_set<std::string> busy{};
+	std::unordered_map<std::string, bucket_state> buckets{};
+	std::array<queue_latency, 3> waits{}, round_trips{};
+	/* global 429s inside the current window, and when the breaker closes again */
+	std::deque<clock::time_point> globals{};
+	clock::time_point breaker{};
+	std::chrono::seconds breaker_for{ 5 };
+	std::atomic<uint64_t> received{}, avoided{}, merged{}, trips{}, failed{}, sunk{};
+	/* wakes pump() when the earliest held bucket or the breaker resets */
+	std::condition_variable_any wake{};
+	clock::time_point wake_at = clock::time_point::max();
+	family<histogram>* by_route = nullptr;
+	std::map<std::string, histogram*, std::less<>> route_series{}; /* by_route's series, looked up once per route. guarded by lock */
+	std::jthread waker{};
+
+	/* must hold lock. false while the bucket is spent, remembering when to look again */
+	bool bucket_open(job& j, clock::time_point now) {
+		auto it = this->buckets.find(j.bucket);
+		if (it == this->buckets.end() or it->second.remaining > 0 or it->second.reset <= now) return true;
+		if (not std::exchange(j.held, true)) this->avoided++;
+		this->wake_at = std::min(this->wake_at, it->second.reset);
+		return false;
+	}
+	/* must hold lock. moves every job allowed to go now into out, oldest first per lane */
+	void pick(std::vector<job>& out) {
+		clock::time_point now = clock::now();
+		bool tripped = now < this->breaker;
+		if (tripped) this->wake_at = std::min(this->wake_at, this->breaker);
+		for (uint8_t p = rp_interaction; p <= rp_background; p++) {
+			if (tripped and p not_eq rp_interaction) break;
+			std::deque<job>& lane = this->pending[p];
+			for (auto it = lane.begin(); it not_eq lane.end();) {
+				size_t total = this->in_flight[0] + this->in_flight[1] + this->in_flight[2];
+				bool slot = (p == rp_interaction) or
+					(p == rp_visible and total < this->max_in_flight) or
+					(p == rp_background and total < this->max_in_flight and this->in_flight[rp_background] < this->max_background and
+						this->pending[rp_interaction].empty() and this->pending[rp_visible].empty());
+				if (not slot) break;
+				if (not it->bucket.empty() and (this->busy.contains(it->bucket) or not this->bucket_open(*it, now))) {
+					it++; /* its bucket is in flight or spent, later buckets may still go */
+					continue;
+				}
+				if (not it->bucket.empty()) {
+					this->busy.insert(it->bucket);
+					if (auto b = this->buckets.find(it->bucket); b not_eq this->buckets.end() and b->second.remaining > 0) b->second.remaining--;
+				}
+				this->in_flight[p]++;
+				this->waits[p].add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->queued).count());
+				out.emplace_back(std::move(*it));
+				it = lane.erase(it);
+			}
+		}
+		if (this->wake_at not_eq clock::time_point::max()) this->wake.notify_one();
+	}
+	/* must hold lock. learns the bucket's budget from the reply, true if the call should be sent again */
+	bool learn(const job& j, const dpp::http_request_completion_t& http, clock::time_point now) {
+		if (not j.bucket.empty() and (http.ratelimit_limit or http.status == 429)) {
+			/* buckets that have reset carry nothing worth keeping, one per interaction would otherwise pile up */
+			if (this->buckets.size() > 4096) std::erase_if(this->buckets, [now](const auto& b) { return b.second.reset <= now; });
+			bucket_state& b = this->buckets[j.bucket];
+			b.remaining = (http.status == 429) ? 0 : http.ratelimit_remaining;
+			b.reset = now + std::chrono::seconds(std::max(http.ratelimit_reset_after, http.ratelimit_retry_after));
+		}
+		if (http.status not_eq 429) return false;
+		this->received++;
+		if (http.ratelimit_global) {
+			this->globals.emplace_back(now);
+			while (not this->globals.empty() and this->globals.front() < now - std::chrono::seconds(10)) this->globals.pop_front();
+			if (this->globals.size() >= 3) {
+				/* consecutive trips back off further, a quiet minute resets it */
+				this->breaker_for = (now < this->breaker + std::chrono::minutes(1)) ? std::min(this->breaker_for * 2, std::chrono::seconds(60)) : std::chrono::seconds(5);
+				this->breaker = now + std::max<std::chrono::seconds>(this->breaker_for, std::chrono::seconds(http.ratelimit_retry_after));
+				this->globals.clear();
+				this->trips++;
+			}
+		}
+		/* the bucket is now known to be spent, so a resend waits for the reset instead of adding to the flood */
+		return j.priority not_eq rp_interaction and j.attempts < 3;
+	}
+	void dispatch(job j) {
+		if (this->sink) {
+			{
+				std::lock_guard<std::mutex> g(this->lock);
+				this->busy.erase(j.bucket);
+				this->in_flight[j.priority]--;
+				this->sunk++;
+			}
+			if (not this->canned or j.callbacks.empty()) return;
+			trace_scope scope(j.trace);
+			dpp::confirmation_callback_t result = this->canned(j.bucket);
+			for (dpp::command_completion_event_t& callback : j.callbacks) callback(result);
+			return;
+		}
+		clock::time_point sent = clock::now();
+		auto done = [this, j, sent](const dpp::confirmation_callback_t& result) mutable
+			{
+				clock::time_point now = clock::now();
+				bool again;
+				{
+					std::lock_guard<std::mutex> g(this->lock);
+					this->busy.erase(j.bucket);
+					this->in_flight[j.priority]--;
+					this->round_trips[j.priority].add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent).count());
+					if ((again = this->learn(j, result.http_info, now))) {
+						j.attempts++;
+						j.held = false;
+						this->pending[j.priority].emplace_front(std::move(j));
+					}
+				}
+				if (j.round_trip) j.round_trip->record(now - sent);
+				if (not again) {
+					static constexpr const char* spans[] = { "rest.interaction", "rest.visible", "rest.background" };
+					if (j.trace) trace_span(spans[j.priority], j.trace, trace_time(j.queued), trace_time(now));
+					trace_scope scope(j.trace); /* work the callbacks queue stays with the interaction */
+					if (result.is_error()) {
+						this->failed++;
+						if (j.callbacks.empty()) std::cout << std::format("rest: {0} failed: {1}", j.bucket, result.get_error().message) << std::endl;
+					}
+					for (dpp::command_completion_event_t& callback : j.callbacks) callback(result);
+				}
+				this->pump();
+			};
+		try {
+			if (this->transport) this->transport(j.bucket, std::move(done));
+			else j.call(std::move(done));
+		}
+		catch (std::exception& e) {
+			std::cout << e.what() << std::endl;
+			{
+				std::lock_guard<std::mutex> g(this->lock);
+				this->busy.erase(j.bucket);
+				this->in_flight[j.priority]--;
+			}
+			this->pump();
+		}
+	}
+	void pump() {
+		std::vector<job> ready{};
+		do {
+			ready.clear();
+			{
+				std::lock_guard<std::mutex> g(this->lock);
+				this->pick(ready);
+			}
+			for (job& j : ready) this->dispatch(std::move(j));
+		} while (this->sink and not ready.empty()); /* sunk calls complete inline, pick up whatever they made room for */
+	}
+	void sleep(std::stop_token stop) {
+		while (not stop.stop_requested()) {
+			{
+				std::unique_lock<std::mutex> g(this->lock);
+				clock::time_point at = this->wake_at;
+				auto earlier = [this, at] { return this->wake_at < at; }; /* a new, earlier deadline came in */
+				if (at == clock::time_point::max()) this->wake.wait(g, stop, earlier);
+				else if (this->wake.wait_until(g, stop, at, earlier)) continue;
+				if (stop.stop_requested()) return;
+				if (clock::now() < this->wake_at) continue;
+				this->wake_at = clock::time_point::max();
+			}
+			this->pump();
+		}
+	}
+public:
+	/* calls in flight outside rp_interaction, which is never held back */
+	size_t max_in_flight = 8;
+	/* of those, how many may be background work */
+	size_t max_background = 2;
+	/*
+	 * offline mode for replays: calls are scheduled as usual but never reach dpp. their callbacks are run inline with
+	 * canned(bucket) when that's set, so handlers carry on past their first call, and not at all otherwise.
+	 * set both before the first submit
+	 */
+	bool sink = false;
+	std::function<dpp::confirmation_callback_t(const std::string& bucket)> canned{};
+	/* stands in for dpp when set, given each call's bucket in place of the call itself. see mock.hpp */
+	std::function<void(const std::string& bucket, dpp::command_completion_event_t done)> transport{};
+
+	/* metrics, if given, gets round trips per route and the 429 counters */
+	rest_scheduler(registry* metrics = nullptr) : waker([this](std::stop_token stop) { this->sleep(stop); }) {
+		if (not metrics) return;
+		this->by_route = &metrics->add_histogram("neko_rest_round_trip_seconds", "REST round trip per route, 429s included", "route");
+		metrics->add_collector([this](std::string& out)
+			{
+				auto line = [&out](std::string_view name, std::string_view help, uint64_t value)
+					{
+						out += std::format("# HELP {0} {1}\n# TYPE {0} counter\n{0} {2}\n", name, help, value);
+					};
+				line("neko_rest_429_received_total", "429s discord answered with", this->received);
+				line("neko_rest_429_avoided_total", "calls held back because their bucket was known to be spent", this->avoided);
+				line("neko_rest_merged_total", "calls replaced by a newer one with the same merge key", this->merged);
+				line("neko_rest_breaker_trips_total", "times a run of global 429s opened the breaker", this->trips);
+				line("neko_rest_failed_total", "calls that failed for good", this->failed);
+			});
+	}
+	/*
+	 * an empty bucket means the call shares no rate limit with anything else.
+	 * a call with the same merge key as one still waiting replaces it; both callbacks get the newer call's result
+	 */
+	void submit(rest_priority priority, std::string bucket, call_t call, dpp::command_completion_event_t callback = {}, std::string merge = {}) {
+		{
+			std::lock_guard<std::mutex> g(this->lock);
+			std::deque<job>& lane = this->pending[priority];
+			auto same = merge.empty() ? lane.end() : std::ranges::find(lane, merge, &job::merge);
+			if (same not_eq lane.end()) {
+				same->call = std::move(call);
+				if (callback) same->callbacks.emplace_back(std::move(callback));
+				this->merged++;
+			}
+			else {
+				job j{ std::move(call), {}, std::move(bucket), std::move(merge), priority, clock::now() };
+				j.trace = trace_current;
+				if (this->by_route) {
+					/* family::with() takes its own lock, it's only called the first time a route is seen */
+					std::string_view route = std::string_view(j.bucket).substr(0, j.bucket.find('/'));
+					auto it = this->route_series.find(route);
+					if (it == this->route_series.end()) it = this->route_series.emplace(std::string(route), &this->by_route->with(route)).first;
+					j.round_trip = it->second;
+				}
+				if (callback) j.callbacks.emplace_back(std::move(callback));
+				lane.emplace_back(std::move(j));
+			}
+		}
+		this->pump();
+	}
+	struct totals_t {
+		uint64_t received{}, avoided{}, merged{}, trips{}, failed{};
+	};
+	/* the 429 counters since startup */
+	totals_t totals() const {
+		return { this->received, this->avoided, this->merged, this->trips, this->failed };
+	}
+	/* nothing queued or in flight */
+	bool idle() {
+		std::lock_guard<std::mutex> g(this->lock);
+		return std::ranges::all_of(this->pending, &std::deque<job>::empty) and std::ranges::all_of(this->in_flight, [](size_t n) { return n == 0; });
+	}
+	/* rate limit buckets remembered, trimmed past 4096 */
+	size_t bucket_count() {
+		std::lock_guard<std::mutex> g(this->lock);
+		return this->buckets.size();
+	}
+	/* calls swallowed by the sink */
+	uint64_t sunk_calls() const {
+		return this->sunk;
+	}
+	/* e.g. "interaction: 12 queued, 0 in flight, wait p99 0.01 ms, round trip p99 180.00 ms" per lane, then the 429 counters */
+	std::vector<std::string> report() {
+		static constexpr const char* names[] = { "interaction", "visible", "background" };
+		std::lock_guard<std::mutex> g(this->lock);
+		std::vector<std::string> out{};
+		for (uint8_t p = rp_interaction; p <= rp_background; p++)
+			out.emplace_back(std::format("{0}: {1} queued, {2} in flight, wait p99 {3:.2f} ms, round trip p99 {4:.2f} ms",
+				names[p], this->pending[p].size(), this->in_flight[p], this->waits[p].percentile(0.99), this->round_trips[p].percentile(0.99)));
+		out.emplace_back(std::format("429s: {0} received, {1} avoided, {2} merged, {3} breaker trips{4}, {5} failed",
+			this->received.load(), this->avoided.load(), this->merged.load(), this->trips.load(), (clock::now() < this->breaker) ? " (open)" : "", this->failed.load()));
+		return out;
+	}
+};
@@ -0,0 +1,162 @@
+#pragma once
+/*
+ * the game's clock. every guild has its own partition of the game (an ecs world and the step it's at), owned by the
+ * guild's lane like the rest of its state, so ticks run on the lanes' work-stealing workers and never race a command.
+ * one clock thread wakes every step and posts a tick for each guild whose players did something recently; guilds nobody
+ * is playing in aren't ticked at all and are fast-forwarded by every step they missed the next time they're touched.
+ * systems are handed the number of steps to apply and do it in closed form (hp + regen * steps, cooldown - steps), so
+ * catching up a week costs the same as one tick.
+ * a tick still queued or running when the next one is due isn't doubled up, the next covers both and counts as an overrun.
+ * e.g. sim.add("regen", [](world& w, uint64_t steps) { ... }); sim.played(guild); partition& p = sim.of(guild);
+ */
+#include <dpp/snowflake.h>
+#include <lanes.hpp>
+#include <metrics.hpp>
+#include <ecs.hpp>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+struct partition {
+	world entities{};
+	uint64_t step{}; /* steps applied so far, counted from the simulation's start */
+};
+
+class simulation {
+public:
+	using clock = std::chrono::steady_clock;
+	/* applies steps steps at once */
+	using system_fn = std::function<void(world& w, uint64_t steps)>;
+private:
+	struct activity {
+		clock::time_point until{}; /* ticked every step until then */
+		bool queued = false; /* a tick is posted and hasn't finished */
+	};
+	lanes& pool;
+	guild_local<partition> partitions;
+	std::vector<std::pair<std::string, system_fn>> systems{};
+	std::mutex lock{};
+	std::unordered_map<dpp::snowflake, activity> active{};
+	const clock::time_point epoch = clock::now();
+	histogram own_time{}, own_lag{};
+	histogram* tick_time = &own_time, * tick_lag = &own_lag;
+	std::atomic<uint64_t> ticks{}, overruns{}, forwarded{}, steps_applied{};
+	std::jthread waker{};
+
+	void tick(dpp::snowflake guild, clock::time_point due) {
+		clock::time_point start = clock::now();
+		this->tick_lag->record(start - due);
+		this->of(guild);
+		this->tick_time->record(clock::now() - start);
+		this->ticks.fetch_add(1, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> g(this->lock);
+		if (auto it = this->active.find(guild); it not_eq this->active.end()) it->second.queued = false;
+	}
+	void run(std::stop_token stop) {
+		std::mutex sleeping{};
+		std::condition_variable_any wake{};
+		for (uint64_t next = 1; not stop.stop_requested(); next++) {
+			clock::time_point due = this->epoch + this->step * next;
+			{
+				std::unique_lock<std::mutex> g(sleeping);
+				if (wake.wait_until(g, stop, due, [] { return false; }); stop.stop_requested()) return;
+			}
+			/* woke up steps late (a suspended machine, a debugger), the missed steps are caught up by the next ticks */
+			if (uint64_t now = this->now(); now > next) {
+				this->overruns.fetch_add(now - next, std::memory_order_relaxed);
+				next = now;
+			}
+			clock::time_point now = clock::now();
+			std::lock_guard<std::mutex> g(this->lock);
+			for (auto it = this->active.begin(); it not_eq this->active.end();) {
+				auto& [guild, a] = *it;
+				if (a.queued) this->overruns.fetch_add(1, std::memory_order_relaxed);
+				else if (a.until <= now) {
+					it = this->active.erase(it); /* idle now, the next of() catches it up */
+					continue;
+				}
+				else if (this->pool.post(guild, [this, guild = guild, due] { this->tick(guild, due); })) a.queued = true;
+				else this->overruns.fetch_add(1, std::memory_order_relaxed);
+				++it;
+			}
+		}
+	}
+public:
+	const std::chrono::milliseconds step;
+	/* a guild keeps being ticked this long after its players last did something */
+	std::chrono::seconds idle{ 60 };
+
+	/* systems are added before the first tick or of(). metrics, when given, get the tick series */
+	simulation(lanes& pool, std::chrono::milliseconds step = std::chrono::milliseconds(100), registry* metrics = nullptr) : pool(pool), partitions(pool), step(step) {
+		if (metrics) {
+			this->tick_time = &metrics->add_histogram("neko_tick_seconds", "time a guild's game tick ran").with();
+			this->tick_lag = &metrics->add_histogram("neko_tick_lag_seconds", "time from a game tick being due to it starting").with();
+			metrics->add_collector([this](std::string& out)
+				{
+					auto line = [&out](std::string_view name, std::string_view type, std::string_view help, uint64_t value)
+						{
+							out += std::format("# HELP {0} {1}\n# TYPE {0} {2}\n{0} {3}\n", name, help, type, value);
+						};
+					line("neko_tick_overruns_total", "counter", "game ticks not run on time, covered by a later one", this->overruns);
+					line("neko_tick_fast_forwards_total", "counter", "idle guilds caught up by more than one step at once", this->forwarded);
+					line("neko_tick_active_guilds", "gauge", "guilds ticked every step", this->playing());
+				});
+		}
+		this->waker = std::jthread([this](std::stop_token stop) { this->run(stop); });
+	}
+	simulation& add(std::string name, system_fn fn) {
+		this->systems.emplace_back(std::move(name), std::move(fn));
+		return *this;
+	}
+	/* steps since the start */
+	uint64_t now() const {
+		return static_cast<uint64_t>((clock::now() - this->epoch) / this->step);
+	}
+	/* the guild's partition, caught up to now. only from the guild's lane */
+	partition& of(dpp::snowflake guild) {
+		partition& p = this->partitions.of(guild);
+		if (uint64_t now = this->now(); now > p.step) {
+			uint64_t steps = now - p.step;
+			if (steps > 1) this->forwarded.fetch_add(1, std::memory_order_relaxed);
+			for (auto& [name, fn] : this->systems) fn(p.entities, steps);
+			p.step = now;
+			this->steps_applied.fetch_add(steps, std::memory_order_relaxed);
+		}
+		return p;
+	}
+	/* a player in guild did something, it's ticked every step for the next idle seconds. from any thread */
+	void played(dpp::snowflake guild) {
+		std::lock_guard<std::mutex> g(this->lock);
+		this->active[guild].until = clock::now() + this->idle;
+	}
+	size_t playing() {
+		std::lock_guard<std::mutex> g(this->lock);
+		return this->active.size();
+	}
+	struct totals_t {
+		uint64_t ticks{}, overruns{}, forwarded{}, steps{};
+	};
+	totals_t totals() const {
+		return { this->ticks.load(), this->overruns.load(), this->forwarded.load(), this->steps_applied.load() };
+	}
+	const histogram& tick_times() const {
+		return *this->tick_time;
+	}
+	/* stops the clock and waits for the ticks already posted, they point back here */
+	~simulation() {
+		this->waker.request_stop();
+		this->waker.join();
+		for (;;) {
+			{
+				std::lock_guard<std::mutex> g(this->lock);
+				if (std::ranges::none_of(this->active, [](const auto& a) { return a.second.queued; })) return;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+};
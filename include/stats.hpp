@@ -0,0 +1,58 @@
+#pragma once
+#include <dpp/cluster.h>
+#include <windows.h>
+#include <psapi.h> // GetProcessMemoryInfo()
+#include <tlhelp32.h> // CreateToolhelp32Snapshot()
+#pragma comment(lib, "psapi.lib")
+
+/* resident set (working set) of this process in bytes */
+inline size_t rss() {
+	PROCESS_MEMORY_COUNTERS pmc{};
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	return pmc.WorkingSetSize;
+}
+
+/* threads this process is running */
+inline size_t thread_count() {
+	size_t count = 0;
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (snapshot == INVALID_HANDLE_VALUE) return 0;
+	THREADENTRY32 entry{ sizeof(entry) };
+	for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry))
+		count += entry.th32OwnerProcessID == GetCurrentProcessId();
+	CloseHandle(snapshot);
+	return count;
+}
+
+/* kernel handles this process holds open: files, sockets, events, threads */
+inline size_t handle_count() {
+	DWORD count = 0;
+	GetProcessHandleCount(GetCurrentProcess(), &count);
+	return count;
+}
+
+/* gateway dispatch events per second, sampled from each shard's sequence number */
+class gateway_rate {
+	uint64_t last{};
+	std::chrono::steady_clock::time_point since = std::chrono::steady_clock::now();
+public:
+	double sample(dpp::cluster& cluster) {
+		uint64_t seq = 0;
+		for (const auto& [id, shard] : cluster.get_shards()) seq += shard->last_seq;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		/* sequence numbers restart from zero when a shard reconnects without resuming */
+		uint64_t events = (seq >= this->last) ? seq - this->last : seq;
+		double seconds = std::chrono::duration<double>(now - this->since).count();
+		this->last = seq;
+		this->since = now;
+		return (seconds > 0.0) ? events / seconds : 0.0;
+	}
+};
+
+/* cpu time consumed by the calling thread in nanoseconds */
+inline uint64_t thread_cpu() {
+	FILETIME creation{}, exit{}, kernel{}, user{};
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	return ((static_cast<uint64_t>(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime) +
+		(static_cast<uint64_t>(user.dwHighDateTime) << 32 | user.dwLowDateTime)) * 100;
+}
@@ -0,0 +1,77 @@
+#pragma once
+/*
+ * the game clock over idle and busy guilds. e.g. neko.exe --bench tick
+ */
+#include <bench_common.hpp>
+#include <simulation.hpp>
+#include <random.hpp>
+
+/*
+ * runs the game clock over many guilds for a while with only some of them played in, then with all of them, and
+ * compares the workers' time spent ticking. then catches every guild up and fails if any entity's state differs from
+ * applying every step since it was created, which the idle guilds only got in one go
+ */
+inline int tick_bench(size_t guilds, size_t per_guild, double share, std::chrono::seconds each) {
+	struct health { int32_t hp, max; };
+	struct regen { int32_t per_step; };
+	struct cooldown { uint32_t remaining; };
+	struct origin { int32_t hp; uint32_t cooldown; uint64_t step; };
+	lanes pool{};
+	simulation sim(pool, std::chrono::milliseconds(50));
+	sim.add("regen", [](world& w, uint64_t steps)
+		{
+			w.each<health, const regen>([steps](health& h, const regen& r) { h.hp = static_cast<int32_t>(std::min<int64_t>(h.hp + r.per_step * static_cast<int64_t>(steps), h.max)); });
+		});
+	sim.add("cooldowns", [](world& w, uint64_t steps)
+		{
+			w.each<cooldown>([steps](cooldown& c) { c.remaining = (c.remaining > steps) ? c.remaining - static_cast<uint32_t>(steps) : 0; });
+		});
+	auto on_every_guild = [&](auto fn)
+		{
+			std::atomic<size_t> left = guilds;
+			for (uint64_t g = 1; g <= guilds; g++) pool.post(g << 22, [&, g] { fn(g << 22, sim.of(g << 22)); left--; });
+			while (left) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		};
+	on_every_guild([&](dpp::snowflake guild, partition& p)
+		{
+			xoshiro256 rng(guild);
+			for (size_t i = 0; i < per_guild; i++) {
+				health h{ static_cast<int32_t>(bounded(rng, 100)), 100 };
+				cooldown c{ static_cast<uint32_t>(bounded(rng, 600)) };
+				p.entities.create(h, regen{ static_cast<int32_t>(bounded(rng, 3)) }, c, origin{ h.hp, c.remaining, p.step });
+			}
+		});
+	auto run = [&](size_t playing)
+		{
+			uint64_t busy = pool.run_time().total_ns;
+			simulation::totals_t before = sim.totals();
+			auto [count, sum, start_buckets] = sim.tick_times().snapshot();
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + each;
+			while (std::chrono::steady_clock::now() < end) {
+				for (uint64_t g = 1; g <= playing; g++) sim.played(g << 22);
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+			simulation::totals_t after = sim.totals();
+			auto [count2, sum2, buckets] = sim.tick_times().snapshot();
+			for (size_t i = 0; i < buckets.size(); i++) buckets[i] -= start_buckets[i];
+			std::cout << std::format("{0} of {1} guilds played: {2} ticks, p50 {3:.1f} us, p99 {4:.1f} us, {5} overruns, workers busy {6:.1f} ms/s\n",
+				playing, guilds, after.ticks - before.ticks, histogram::percentile(buckets, 0.5) / 1e3, histogram::percentile(buckets, 0.99) / 1e3,
+				after.overruns - before.overruns, (pool.run_time().total_ns - busy) / 1e6 / each.count());
+		};
+	sim.idle = std::chrono::seconds(1);
+	run(static_cast<size_t>(guilds * share));
+	run(guilds);
+	std::this_thread::sleep_for(std::chrono::milliseconds(1500)); /* everyone goes idle before the check */
+	bench_checks checks{};
+	on_every_guild([&](dpp::snowflake, partition& p)
+		{
+			p.entities.each<const health, const regen, const cooldown, const origin>([&](const health& h, const regen& r, const cooldown& c, const origin& o)
+				{
+					uint64_t steps = p.step - o.step;
+					checks.expect(h.hp == std::min<int64_t>(o.hp + r.per_step * static_cast<int64_t>(steps), h.max) and c.remaining == ((o.cooldown > steps) ? o.cooldown - steps : 0), "caught up state");
+				});
+		});
+	simulation::totals_t t = sim.totals();
+	std::cout << std::format("{0} steps applied in {1} ticks, {2} fast-forwards\n", t.steps, t.ticks, t.forwarded);
+	return checks.report();
+}
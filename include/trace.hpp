@@ -0,0 +1,131 @@
+#pragma once
+/*
+ * interaction tracing. spans carry the id of the interaction they work for and go into the recording thread's ring,
+ * which keeps the last few thousand and overwrites the oldest, so recording is always on and costs a few stores.
+ * the id follows the work on its own: lanes and the REST scheduler capture trace_current when work is queued and
+ * restore it while that work or its callbacks run.
+ * chrome_trace() turns the last seconds of every ring into JSON for chrome://tracing or ui.perfetto.dev.
+ * e.g. trace_scope scope(event.command.id); span s("receive");
+ */
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <format>
+
+/* interaction the calling thread is working for, 0 for none */
+inline thread_local uint64_t trace_current = 0;
+/* cleared with --trace off, spans are dropped before they touch a ring */
+inline std::atomic<bool> trace_enabled = true;
+
+namespace trace_detail {
+	inline const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	inline uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+	/* a span is valid while seq is its index + 1, checked before and after reading it */
+	struct entry {
+		std::atomic<uint64_t> seq{}, id{}, start{}, duration{};
+		std::atomic<const char*> name{};
+	};
+	struct ring {
+		static constexpr size_t capacity = 4096;
+		std::atomic<uint64_t> head{};
+		uint32_t thread{};
+		std::array<entry, capacity> entries{};
+	};
+	/* threads past the last ring share it, head is claimed atomically so that stays safe */
+	inline constexpr size_t max_threads = 256;
+	inline std::array<std::atomic<ring*>, max_threads> rings{};
+	inline std::atomic<uint32_t> threads{};
+	inline thread_local ring* mine = nullptr;
+
+	inline ring& local() {
+		if (mine) return *mine;
+		uint32_t t = threads.fetch_add(1, std::memory_order_relaxed);
+		std::atomic<ring*>& slot = rings[std::min<size_t>(t, max_threads - 1)];
+		ring* fresh = new ring{};
+		fresh->thread = t;
+		ring* expected = nullptr;
+		if (slot.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) return *(mine = fresh);
+		delete fresh;
+		return *(mine = expected);
+	}
+}
+
+/* records a finished span, name must outlive the process (a literal) */
+inline void trace_span(const char* name, uint64_t id, uint64_t start_ns, uint64_t end_ns) {
+	if (not trace_enabled.load(std::memory_order_relaxed)) return;
+	trace_detail::ring& r = trace_detail::local();
+	uint64_t index = r.head.fetch_add(1, std::memory_order_relaxed);
+	trace_detail::entry& e = r.entries[index % trace_detail::ring::capacity];
+	e.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	e.id.store(id, std::memory_order_relaxed);
+	e.start.store(start_ns, std::memory_order_relaxed);
+	e.duration.store(end_ns - start_ns, std::memory_order_relaxed);
+	e.name.store(name, std::memory_order_relaxed);
+	e.seq.store(index + 1, std::memory_order_release);
+}
+inline uint64_t trace_now() {
+	return trace_detail::now();
+}
+/* ns on the trace clock for a steady_clock time point, e.g. when a task was queued */
+inline uint64_t trace_time(std::chrono::steady_clock::time_point at) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(at - trace_detail::epoch).count();
+}
+
+/* sets trace_current for a scope, e.g. while a lane task or REST callback runs */
+class trace_scope {
+	uint64_t previous;
+public:
+	trace_scope(uint64_t id) : previous(std::exchange(trace_current, id)) {}
+	~trace_scope() {
+		trace_current = this->previous;
+	}
+};
+
+/* a span over a scope for the current interaction, nothing is kept outside one */
+class span {
+	const char* name;
+	uint64_t id = trace_current, start = (id) ? trace_detail::now() : 0;
+public:
+	span(const char* name) : name(name) {}
+	~span() {
+		if (this->id) trace_span(this->name, this->id, this->start, trace_detail::now());
+	}
+};
+
+/* every span that ended in the last seconds, as chrome trace event JSON */
+inline std::string chrome_trace(std::chrono::seconds last) {
+	struct copy {
+		uint64_t id, start, duration;
+		const char* name;
+		uint32_t thread;
+	};
+	std::vector<copy> spans{};
+	uint64_t until = trace_detail::now(), since = until - std::min<uint64_t>(until, std::chrono::duration_cast<std::chrono::nanoseconds>(last).count());
+	for (std::atomic<trace_detail::ring*>& slot : trace_detail::rings) {
+		trace_detail::ring* r = slot.load(std::memory_order_acquire);
+		if (not r) continue;
+		uint64_t head = r->head.load(std::memory_order_acquire);
+		for (uint64_t i = head - std::min<uint64_t>(head, trace_detail::ring::capacity); i < head; i++) {
+			trace_detail::entry& e = r->entries[i % trace_detail::ring::capacity];
+			if (e.seq.load(std::memory_order_acquire) not_eq i + 1) continue; /* being written or already overwritten */
+			copy c{ e.id.load(std::memory_order_relaxed), e.start.load(std::memory_order_relaxed), e.duration.load(std::memory_order_relaxed),
+				e.name.load(std::memory_order_relaxed), r->thread };
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (e.seq.load(std::memory_order_relaxed) not_eq i + 1) continue;
+			if (c.start + c.duration >= since) spans.emplace_back(c);
+		}
+	}
+	std::ranges::sort(spans, {}, &copy::start);
+	std::string out = "{\"traceEvents\":[";
+	for (const copy& c : spans)
+		out += std::format("{0}{{\"name\":\"{1}\",\"cat\":\"interaction\",\"ph\":\"X\",\"ts\":{2:.3f},\"dur\":{3:.3f},\"pid\":1,\"tid\":{4},\"args\":{{\"interaction\":\"{5}\"}}}}",
+			(&c == spans.data()) ? "" : ",", c.name, c.start / 1e3, c.duration / 1e3, c.thread, c.id);
+	return out + "],\"displayTimeUnit\":\"ms\"}";
+}
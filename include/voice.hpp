@@ -0,0 +1,439 @@
+#pragma once
+/*
+ * soundboard and music. a clip is transcoded once by ffmpeg into Ogg/Opus (48 kHz stereo, 20 ms frames) under
+ * .\sounds\cache\, then memory-mapped and indexed in place, so every guild playing it streams packets straight out of
+ * the one shared mapping into dpp, which copies each only to encrypt it.
+ * one pump thread keeps every stream a little ahead of its voice client instead of queueing whole clips into dpp,
+ * so memory per connection stays flat with hundreds of them.
+ * e.g. drop rain.mp3 into .\sounds\, then /play clip:rain channel:#music
+ */
+#include <dpp/cluster.h>
+#include <dpp/discordvoiceclient.h>
+#include <windows.h>
+#include <stats.hpp>
+#include <mixer.hpp>
+#include <span>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <filesystem>
+#include <functional>
+#include <format>
+#include <optional>
+
+/* a read-only view of a whole file, unmapped when the last user lets go */
+class mapped_file {
+	HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+	const uint8_t* view = nullptr;
+	size_t length = 0;
+public:
+	mapped_file(const std::string& path) {
+		this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER size{};
+		if (this->file == INVALID_HANDLE_VALUE or not GetFileSizeEx(this->file, &size) or size.QuadPart == 0) return;
+		this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (not this->mapping) return;
+		this->view = static_cast<const uint8_t*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+		if (this->view) this->length = static_cast<size_t>(size.QuadPart);
+	}
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+	~mapped_file() {
+		if (this->view) UnmapViewOfFile(this->view);
+		if (this->mapping) CloseHandle(this->mapping);
+		if (this->file not_eq INVALID_HANDLE_VALUE) CloseHandle(this->file);
+	}
+	std::span<const uint8_t> bytes() const {
+		return { this->view, this->length };
+	}
+};
+
+/* opus packets of one clip, 20 ms each. frames point into the mapping, or into joined for the rare packet split over two pages */
+struct clip {
+	std::string name{};
+	std::unique_ptr<mapped_file> file{};
+	std::vector<std::span<const uint8_t>> frames{};
+	std::deque<std::vector<uint8_t>> joined{};
+
+	double seconds() const {
+		return this->frames.size() * 0.02;
+	}
+	/* indexes an Ogg/Opus stream in place, skipping the OpusHead and OpusTags packets. empty frames if it isn't one */
+	void index(std::span<const uint8_t> ogg) {
+		std::vector<uint8_t> partial{};
+		size_t packets = 0;
+		for (size_t at = 0; at + 27 <= ogg.size();) {
+			if (std::memcmp(ogg.data() + at, "OggS", 4) not_eq 0) break;
+			size_t segments = ogg[at + 26], data = at + 27 + segments, body = 0;
+			if (data > ogg.size()) break;
+			for (size_t i = 0; i < segments; i++) body += ogg[at + 27 + i];
+			if (data + body > ogg.size()) break; /* cut short */
+			size_t start = data, run = 0;
+			for (size_t i = 0; i < segments; i++) {
+				uint8_t lace = ogg[at + 27 + i];
+				run += lace;
+				if (lace == 255) continue; /* packet goes on */
+				std::span<const uint8_t> piece = ogg.subspan(start, run);
+				if (packets++ >= 2) {
+					if (partial.empty()) this->frames.emplace_back(piece);
+					else {
+						partial.insert(partial.end(), piece.begin(), piece.end());
+						this->frames.emplace_back(this->joined.emplace_back(std::move(partial)));
+					}
+				}
+				partial.clear();
+				start += run;
+				run = 0;
+			}
+			if (run) partial.insert(partial.end(), ogg.begin() + start, ogg.begin() + start + run); /* continues on the next page */
+			at = data + body;
+		}
+	}
+};
+
+/* a clip as raw 48 kHz stereo samples, for mixing. samples point into the mapping */
+struct pcm_clip {
+	std::string name{};
+	std::unique_ptr<mapped_file> file{};
+	std::span<const int16_t> samples{};
+};
+
+/* clips by name, shared by every guild playing them and dropped once none is */
+class clip_cache {
+	/* loaded ones, and the ones a caller is transcoding right now that others for the same name wait on */
+	template<typename T> struct shelf {
+		std::map<std::string, std::weak_ptr<const T>, std::less<>> loaded{};
+		std::map<std::string, std::shared_future<std::shared_ptr<const T>>, std::less<>> loading{};
+	};
+	std::mutex lock{};
+	shelf<clip> clips{};
+	shelf<pcm_clip> pcms{};
+
+	/*
+	 * the T called name, loaded by make on first use. make runs without the lock so one guild's transcode doesn't
+	 * hold up every other guild's /play, the lock is only taken again to publish it
+	 */
+	template<typename T, typename F> std::shared_ptr<const T> load_once(shelf<T>& from, std::string_view name, F make) {
+		std::promise<std::shared_ptr<const T>> made{};
+		std::shared_future<std::shared_ptr<const T>> wait{};
+		{
+			std::lock_guard<std::mutex> g(this->lock);
+			if (auto it = from.loaded.find(name); it not_eq from.loaded.end())
+				if (std::shared_ptr<const T> shared = it->second.lock()) return shared;
+			if (auto it = from.loading.find(name); it not_eq from.loading.end()) wait = it->second;
+			else from.loading.emplace(std::string(name), made.get_future().share());
+		}
+		if (wait.valid()) return wait.get();
+		std::shared_ptr<const T> loaded{};
+		try {
+			loaded = make();
+		}
+		catch (std::exception& e) {
+			std::cout << e.what() << std::endl;
+		}
+		{
+			std::lock_guard<std::mutex> g(this->lock);
+			if (loaded) from.loaded.insert_or_assign(std::string(name), loaded);
+			from.loading.erase(from.loading.find(name));
+		}
+		made.set_value(loaded);
+		return loaded;
+	}
+
+	/*
+	 * name's transcode with ext, made from the source in sounds by ffmpeg with args when missing or stale. empty if
+	 * there's no such clip, or if it would need making and make is false
+	 */
+	std::filesystem::path transcoded(std::string_view name, std::string_view ext, std::string_view args, bool make = true) {
+		std::filesystem::path source{}, out = std::filesystem::path(this->cache) / std::format("{0}{1}", name, ext);
+		std::error_code ec{};
+		for (const auto& file : std::filesystem::directory_iterator(this->sounds, ec))
+			if (file.is_regular_file() and file.path().stem() == name) source = file.path();
+		if (source.empty()) return {};
+		if (not std::filesystem::exists(out) or std::filesystem::last_write_time(out) < std::filesystem::last_write_time(source)) {
+			if (not make) return {};
+			std::filesystem::create_directories(this->cache);
+			std::system(std::format("ffmpeg -y -loglevel error -i \"{0}\" {1} \"{2}\"", source.string(), args, out.string()).c_str());
+		}
+		return out;
+	}
+	/* names reach a command line, so only plain ones */
+	static bool plain(std::string_view name) {
+		return not name.empty() and name.size() <= 64 and std::ranges::all_of(name, [](char c) { return std::isalnum(static_cast<uint8_t>(c)) or c == '_' or c == '-'; });
+	}
+public:
+	/* where clips are looked up by file stem, and where their transcodes go */
+	std::string sounds = ".\\sounds\\", cache = ".\\sounds\\cache\\";
+	/* ffmpeg's arguments for the one transcode, discord's format: 48 kHz stereo opus in 20 ms frames */
+	std::string encoder = "-c:a libopus -b:a 96k -vbr on -application audio -frame_duration 20 -ar 48000 -ac 2";
+
+	/* the clip called name, transcoded on first use. nullptr if there's no such clip */
+	std::shared_ptr<const clip> get(std::string_view name) {
+		if (not plain(name)) return nullptr;
+		return this->load_once(this->clips, name, [this, name]() -> std::shared_ptr<const clip> {
+			std::filesystem::path opus = this->transcoded(name, ".opus", this->encoder);
+			if (opus.empty()) return nullptr;
+			std::shared_ptr<clip> loaded = std::make_shared<clip>();
+			loaded->name = std::string(name);
+			loaded->file = std::make_unique<mapped_file>(opus.string());
+			loaded->index(loaded->file->bytes());
+			if (loaded->frames.empty()) return nullptr;
+			return loaded;
+		});
+	}
+	/* the same clip as samples for the mixer, transcoded to raw pcm on first use */
+	std::shared_ptr<const pcm_clip> get_pcm(std::string_view name) {
+		if (not plain(name)) return nullptr;
+		return this->load_once(this->pcms, name, [this, name]() -> std::shared_ptr<const pcm_clip> {
+			std::filesystem::path raw = this->transcoded(name, ".pcm", "-f s16le -ar 48000 -ac 2");
+			if (raw.empty()) return nullptr;
+			std::shared_ptr<pcm_clip> loaded = std::make_shared<pcm_clip>();
+			loaded->name = std::string(name);
+			loaded->file = std::make_unique<mapped_file>(raw.string());
+			std::span<const uint8_t> bytes = loaded->file->bytes();
+			loaded->samples = { reinterpret_cast<const int16_t*>(bytes.data()), bytes.size() / sizeof(int16_t) };
+			if (loaded->samples.empty()) return nullptr;
+			return loaded;
+		});
+	}
+	/*
+	 * get_pcm() when that only has to map the transcode, otherwise nullptr while it's made on a thread of its own,
+	 * e.g. a whole song that mustn't hold up a lane
+	 */
+	std::shared_ptr<const pcm_clip> pcm_if_ready(std::string_view name) {
+		if (not plain(name)) return nullptr;
+		{
+			std::lock_guard<std::mutex> g(this->lock);
+			if (this->pcms.loading.contains(name)) return nullptr;
+		}
+		if (not this->transcoded(name, ".pcm", {}, false).empty()) return this->get_pcm(name);
+		/* loaded and dropped again, what's kept is the transcode on disk */
+		std::thread([this, name = std::string(name)] { this->get_pcm(name); }).detach();
+		return nullptr;
+	}
+};
+
+/*
+ * what one guild hears while sources overlap: music, sound effects and speech mixed 20 ms at a time and encoded once.
+ * effects and speech duck the music while they play, every gain change is ramped across a frame so it doesn't click
+ */
+class guild_mixer {
+public:
+	enum kind : uint8_t {
+		mk_music, mk_effect, mk_speech
+	};
+private:
+	struct source {
+		std::shared_ptr<const pcm_clip> pcm{};
+		size_t next{}; /* frame */
+		float gain{}, current{};
+		kind type{};
+		bool loop{};
+	};
+	const pcm_mixer& mixer;
+	opus_encoder encoder{};
+	std::vector<source> sources{};
+	std::vector<mix_input> inputs{};
+	std::vector<std::array<int16_t, mix_samples>> tails{}; /* last, partial frames padded with silence */
+	std::array<int16_t, mix_samples> out{};
+public:
+	/* music's gain while something ducks it */
+	float duck = 0.3f;
+
+	guild_mixer(const pcm_mixer& mixer) : mixer(mixer) {}
+	bool ready() const {
+		return this->encoder.ready();
+	}
+	/* gain is clamped to 0..1, from frame on */
+	void add(std::shared_ptr<const pcm_clip> pcm, kind type, float gain = 1.0f, bool loop = false, size_t frame = 0) {
+		gain = std::clamp(gain, 0.0f, 1.0f);
+		this->sources.emplace_back(std::move(pcm), frame, gain, gain, type, loop);
+	}
+	/* the next encoded frame, empty once every source has ended */
+	std::span<const uint8_t> next() {
+		bool ducked = std::ranges::any_of(this->sources, [](const source& s) { return s.type not_eq mk_music; });
+		this->inputs.clear();
+		this->tails.resize(this->sources.size());
+		for (size_t i = 0; i < this->sources.size(); i++) {
+			source& s = this->sources[i];
+			std::span<const int16_t> rest = s.pcm->samples.subspan(std::min(s.next * mix_samples, s.pcm->samples.size()));
+			const int16_t* pcm = rest.data();
+			if (rest.size() < mix_samples) {
+				std::ranges::fill(std::ranges::copy(rest, this->tails[i].begin()).out, this->tails[i].end(), int16_t{});
+				pcm = this->tails[i].data();
+			}
+			float target = (s.type == mk_music and ducked) ? s.gain * this->duck : s.gain;
+			this->inputs.emplace_back(pcm, s.current, target);
+			s.current = target;
+			if (++s.next * mix_samples >= s.pcm->samples.size() and s.loop) s.next = 0;
+		}
+		if (this->inputs.empty()) return {};
+		this->mixer.mix(this->inputs, this->out.data());
+		std::erase_if(this->sources, [](const source& s) { return s.next * mix_samples >= s.pcm->samples.size(); });
+		return this->encoder.encode(this->out.data());
+	}
+	/* the frame to go on from when the only source left is music called name at full gain, so cached frames can take over */
+	std::optional<size_t> alone(std::string_view name) const {
+		if (this->sources.size() not_eq 1) return std::nullopt;
+		const source& s = this->sources.front();
+		if (s.type not_eq mk_music or s.pcm->name not_eq name or s.current not_eq s.gain) return std::nullopt;
+		return s.next;
+	}
+};
+
+/* where a stream goes: how many seconds its voice client still has queued (negative once it's gone) and how a frame is sent */
+struct voice_out {
+	std::function<double()> ahead{};
+	std::function<void(std::span<const uint8_t>)> send{};
+
+	/* the voice connection of guild on shard */
+	static voice_out of(dpp::discord_client* shard, dpp::snowflake guild) {
+		return {
+			[shard, guild]
+			{
+				dpp::voiceconn* v = shard->get_voice(guild);
+				return (v and v->voiceclient and v->voiceclient->is_ready()) ? static_cast<double>(v->voiceclient->get_secs_remaining()) : -1.0;
+			},
+			[shard, guild](std::span<const uint8_t> frame)
+			{
+				/* dpp encrypts into its own buffer and never writes through the pointer */
+				if (dpp::voiceconn* v = shard->get_voice(guild); v and v->voiceclient) v->voiceclient->send_audio_opus(const_cast<uint8_t*>(frame.data()), frame.size());
+			}
+		};
+	}
+};
+
+/*
+ * every guild's stream, topped up from one thread. a guild plays one clip at a time and a new one replaces it;
+ * layering an effect over it switches the guild to a mixer until the clip plays alone again
+ */
+class voice_pump {
+	struct stream {
+		std::shared_ptr<const clip> playing{};
+		size_t next{};
+		bool loop{};
+		voice_out out{};
+		std::shared_ptr<guild_mixer> mixer{}; /* set while sources overlap */
+	};
+	const pcm_mixer mixer{};
+	std::mutex lock{};
+	std::unordered_map<dpp::snowflake, stream> streams{};
+	std::unordered_map<dpp::snowflake, stream> waiting{}; /* asked for before their voice connection was ready */
+	std::atomic<uint64_t> cpu_ns{}, stream_ns{};
+
+	/* sends until s is lead seconds ahead, false once it has finished or its connection is gone */
+	bool top_up(stream& s) {
+		double ahead = s.out.ahead();
+		if (ahead < 0.0) return false;
+		for (; ahead < this->lead; ahead += 0.02) {
+			if (s.mixer) {
+				std::span<const uint8_t> frame = s.mixer->next();
+				if (frame.empty()) return false;
+				s.out.send(frame);
+				if (std::optional<size_t> at = s.mixer->alone(s.playing->name)) {
+					s.next = std::min(*at, s.playing->frames.size());
+					s.mixer.reset();
+				}
+				continue;
+			}
+			if (s.next == s.playing->frames.size()) {
+				if (not s.loop) return false;
+				s.next = 0;
+			}
+			s.out.send(s.playing->frames[s.next++]);
+		}
+		return true;
+	}
+	void run(std::stop_token stop) {
+		for (std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now(); not stop.stop_requested(); std::this_thread::sleep_until(next += this->tick)) {
+			uint64_t start = thread_cpu();
+			size_t count = 0;
+			{
+				std::lock_guard<std::mutex> g(this->lock);
+				for (auto it = this->streams.begin(); it not_eq this->streams.end();)
+					it = this->top_up(it->second) ? std::next(it) : this->streams.erase(it);
+				count = this->streams.size();
+			}
+			this->cpu_ns += thread_cpu() - start;
+			this->stream_ns += count * std::chrono::duration_cast<std::chrono::nanoseconds>(this->tick).count();
+		}
+	}
+public:
+	/* how far ahead of playback streams are kept, and how often they're topped up */
+	double lead = 0.2;
+	std::chrono::milliseconds tick{ 40 };
+private:
+	std::jthread thread{}; /* last, so it starts after and stops before everything it reads */
+public:
+	voice_pump() : thread([this](std::stop_token stop) { this->run(stop); }) {}
+	/* plays now on a ready connection, replacing what the guild was playing */
+	void start(dpp::snowflake guild, std::shared_ptr<const clip> c, bool loop, voice_out out) {
+		std::lock_guard<std::mutex> g(this->lock);
+		this->waiting.erase(guild);
+		this->streams.insert_or_assign(guild, stream{ std::move(c), 0, loop, std::move(out) });
+	}
+	/* plays once guild's voice connection is ready, see ready() */
+	void later(dpp::snowflake guild, std::shared_ptr<const clip> c, bool loop) {
+		std::lock_guard<std::mutex> g(this->lock);
+		this->waiting.insert_or_assign(guild, stream{ std::move(c), 0, loop, {} });
+	}
+	/* from on_voice_ready, starts what the guild asked for while connecting */
+	void ready(dpp::snowflake guild, voice_out out) {
+		std::lock_guard<std::mutex> g(this->lock);
+		auto it = this->waiting.find(guild);
+		if (it == this->waiting.end()) return;
+		it->second.out = std::move(out);
+		this->streams.insert_or_assign(guild, std::move(it->second));
+		this->waiting.erase(it);
+	}
+	/* the clip guild is playing, empty if none */
+	std::string now_playing(dpp::snowflake guild) {
+		std::lock_guard<std::mutex> g(this->lock);
+		auto it = this->streams.find(guild);
+		return (it == this->streams.end()) ? std::string() : it->second.playing->name;
+	}
+	/*
+	 * mixes effect over what guild is playing, music is that clip's samples (see now_playing()). false when guild
+	 * isn't playing, opus.dll is missing or music isn't the clip playing, rather than mixing the effect over silence
+	 */
+	bool layer(dpp::snowflake guild, std::shared_ptr<const pcm_clip> effect, guild_mixer::kind type, float gain, std::shared_ptr<const pcm_clip> music) {
+		std::lock_guard<std::mutex> g(this->lock);
+		auto it = this->streams.find(guild);
+		if (it == this->streams.end()) return false;
+		stream& s = it->second;
+		if (not s.mixer) {
+			std::shared_ptr<guild_mixer> fresh = std::make_shared<guild_mixer>(this->mixer);
+			if (not fresh->ready() or not music or music->name not_eq s.playing->name) return false;
+			/* the clip goes on from the same frame, as samples */
+			fresh->add(std::move(music), guild_mixer::mk_music, 1.0f, s.loop, s.next);
+			s.mixer = std::move(fresh);
+		}
+		s.mixer->add(std::move(effect), type, gain);
+		return true;
+	}
+	mix_isa isa() const {
+		return this->mixer.isa;
+	}
+	/* false if guild wasn't playing */
+	bool stop(dpp::snowflake guild) {
+		std::lock_guard<std::mutex> g(this->lock);
+		return this->waiting.erase(guild) + this->streams.erase(guild) > 0;
+	}
+	size_t playing() {
+		std::lock_guard<std::mutex> g(this->lock);
+		return this->streams.size();
+	}
+	/* pump cpu per second of one stream, in microseconds. dpp's encryption and sending run on its own threads and aren't in it */
+	double cpu_per_stream() const {
+		uint64_t streamed = this->stream_ns;
+		return streamed ? this->cpu_ns * 1e6 / streamed : 0.0;
+	}
+};
@@ -0,0 +1,75 @@
+#pragma once
+/*
+ * voice pump and mixer costs. e.g. neko.exe --bench voice --clip meow, neko.exe --bench mix
+ */
+#include <bench_common.hpp>
+#include <voice.hpp>
+
+/*
+ * pump cost with n concurrent streams of one shared clip. each stream's voice client is stood in for by a clock
+ * that plays 20 ms per frame, so the pump sees what it would with real connections minus dpp's encryption.
+ * clip is a name in .\sounds\, or a minute of 120 byte frames if it's empty
+ */
+inline int voice_bench(std::string_view name, std::vector<size_t> counts, std::chrono::seconds each) {
+	std::shared_ptr<const clip> shared{};
+	if (not name.empty()) shared = clip_cache().get(name);
+	else {
+		static std::vector<uint8_t> frame(120, 0xFC);
+		std::shared_ptr<clip> synthetic = std::make_shared<clip>();
+		synthetic->name = "synthetic";
+		synthetic->frames.assign(3000, frame);
+		shared = synthetic;
+	}
+	if (not shared) {
+		std::cout << std::format("no clip called {0}", name) << std::endl;
+		return 1;
+	}
+	std::cout << std::format("{0}: {1} frames, {2:.1f} s\n", shared->name, shared->frames.size(), shared->seconds());
+	for (size_t n : counts) {
+		std::atomic<uint64_t> frames{}, sink{};
+		{
+			voice_pump pump{};
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < n; i++) {
+				std::shared_ptr<uint64_t> sent = std::make_shared<uint64_t>(); /* only ever touched by the pump thread */
+				pump.start(i + 1, shared, true, {
+					[sent, start] { return std::max(*sent * 0.02 - std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 0.0); },
+					[sent, &frames, &sink](std::span<const uint8_t> f) { ++*sent; frames++; sink += f.front(); } });
+			}
+			std::this_thread::sleep_for(each);
+			std::cout << std::format("{0} streams: {1:.1f} us cpu per stream-second, {2:.0f} frames/s\n",
+				n, pump.cpu_per_stream(), frames / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+	}
+	std::cout << std::flush;
+	return 0;
+}
+
+/*
+ * cpu per 20 ms frame to mix n sources with every instruction set the CPU has, then to encode the mix once.
+ * sources are noise, so nothing is skipped for silence
+ */
+inline int mix_bench(std::vector<size_t> counts) {
+	std::mt19937 random{ 1 };
+	std::vector<std::array<int16_t, mix_samples>> noise(counts.empty() ? 0 : std::ranges::max(counts));
+	for (auto& frame : noise) std::ranges::generate(frame, [&random] { return static_cast<int16_t>(std::uniform_int_distribution<int>(-8000, 8000)(random)); });
+	std::array<int16_t, mix_samples> out{};
+	std::vector<int> frames(64);
+	mix_isa best = detect_isa();
+	std::cout << std::format("mix, ns cpu per 20 ms frame (detected: {0}, chosen: {1})\n", mix_isa_names[best], mix_isa_names[pcm_mixer::chosen()]);
+	for (mix_isa isa = mi_fallback; isa <= best; isa = static_cast<mix_isa>(isa + 1)) {
+		pcm_mixer mixer(isa);
+		std::string line = std::format("{0:<8}", mix_isa_names[isa]);
+		for (size_t n : counts) {
+			std::vector<mix_input> inputs{};
+			for (size_t i = 0; i < n; i++) inputs.emplace_back(noise[i].data(), 0.5f, 0.8f);
+			line += std::format("  {0} sources: {1:.0f}", n, cpu_per_item(frames, [&](int) { mixer.mix(inputs, out.data()); }));
+		}
+		std::cout << line << "\n";
+	}
+	opus_encoder encoder{};
+	if (encoder.ready()) std::cout << std::format("encode: {0:.0f} ns cpu per 20 ms frame\n", cpu_per_item(frames, [&](int) { encoder.encode(out.data()); }));
+	else std::cout << "encode: opus.dll not found\n";
+	std::cout << std::flush;
+	return 0;
+}
@@ -3,16 +3,86 @@
 #include <palette.hpp>
 #include <image.hpp>
 #include <utility.hpp>
+#include <features.hpp>
+#include <stats.hpp>
+#include <bench.hpp>
+#include <coordinator.hpp>
+#include <lanes.hpp>
+#include <metrics.hpp>
+#include <trace.hpp>
+#include <rest.hpp>
+#include <replay.hpp>
+#include <mock.hpp>
+#include <dashboard.hpp>
+#include <voice.hpp>
+#include <recording.hpp>
+#include <duration.hpp>
+#include <poll.hpp>
+#include <market.hpp>
 using namespace std::chrono;
-std::unique_ptr<dpp::cluster> bot = std::make_unique<dpp::cluster>("MTAwNDUxNDkzNTA1OTAwNTQ3MA.______.", dpp::i_all_intents);
-std::unordered_map<dpp::snowflake, std::future<void>> cmd_sender;
-std::unordered_map<dpp::snowflake, std::future<void>> btn_sender;
-std::vector<std::future<void>> active_code;
+/* every command is answered from the interaction payload, so no module needs member, presence or message intents */
+features modules = features()
+	.add({ "purge", dpp::i_guilds })
+	.add({ "gcreate", dpp::i_guilds })
+	.add({ "poll", dpp::i_guilds })
+	.add({ "market", dpp::i_guilds })
+	.add({ "lvl", dpp::i_guilds })
+	.add({ "capture", dpp::i_guilds })
+	.add({ "trace", dpp::i_guilds })
+	.add({ "stats", dpp::i_guilds })
+	/* voice connections need the guild's voice state and server updates */
+	.add({ "play", dpp::i_guilds | dpp::i_guild_voice_states })
+	.add({ "stop", dpp::i_guilds | dpp::i_guild_voice_states })
+	.add({ "sfx", dpp::i_guilds })
+	.add({ "record", dpp::i_guilds | dpp::i_guild_voice_states });
+registry metrics{};
+family<histogram>& handler_time = metrics.add_histogram("neko_handler_seconds", "time an interaction handler ran on its guild's lane", "command");
+family<histogram>& queue_wait = metrics.add_histogram("neko_queue_wait_seconds", "time an interaction waited for its guild's lane", "command");
+family<histogram>& io_time = metrics.add_histogram("neko_io_seconds", "time spent on files and downloads", "op");
+histogram& render_time = metrics.add_histogram("neko_render_seconds", "time spent drawing a /lvl card").with();
+family<counter>& interactions = metrics.add_counter("neko_interactions_total", "interactions received", "command");
+counter& turned_away = metrics.add_counter("neko_busy_total", "interactions turned away because their guild's lane was full").with();
+/* allocations per handler run on its lane, REST callbacks run elsewhere and aren't charged. off unless --allocations on */
+allocation_ledger handler_allocations{};
+/* a command's series, looked up once so an interaction records without a lock. filled from modules before traffic starts, read only after */
+struct command_metrics {
+	counter* received{};
+	histogram* wait{}, * run{};
+	allocation_ledger::entry* allocs{};
+};
+std::unordered_map<std::string, command_metrics> command_table{};
+static void build_command_table() {
+	std::vector<std::string> names = modules.names();
+	names.emplace_back("other");
+	for (const std::string& name : names)
+		command_table.emplace(name, command_metrics{ &interactions.with(name), &queue_wait.with(name), &handler_time.with(name), &handler_allocations.of(name) });
+}
+/* names outside modules, e.g. a command still registered from an older build, share "other" */
+static const command_metrics& metrics_of(const std::string& name) {
+	auto it = command_table.find(name);
+	return (it == command_table.end()) ? command_table.at("other") : it->second;
+}
+std::unique_ptr<dpp::cluster> bot{};
+std::unique_ptr<lanes> guild_lanes{};
+std::unique_ptr<rest_scheduler> rest{};
+std::unique_ptr<metrics_server> scrape{};
+std::unique_ptr<dashboard> board{};
+clip_cache clips{};
+std::unique_ptr<voice_pump> voice{};
+std::unique_ptr<voice_recorder> recordings{};
+poll_board polls{};
+gateway_recorder recorder{};
+
+/* interaction responses go out ahead of every other call */
+template<typename E> static void respond(std::shared_ptr<E> event, dpp::message m) {
+	rest->submit(rp_interaction, bucket("interaction", event->command.id), [event, m = std::move(m)](dpp::command_completion_event_t done) { event->reply(m, done); });
+}
 
 struct giveaway {
 	std::string description{};
 	uint64_t ends{}, winners{}, host{};
-	std::vector<uint64_t> entries{}, sub_entries{};
+	std::vector<uint64_t> entries{};
+	uint64_t seed{}; /* the draw's, kept from creation so a disputed draw can be replayed */
 	dpp::message message{};
 	void message_update(std::string winners = "") {
 		this->message.embeds[0]
@@ -20,7 +90,12 @@ struct giveaway {
 				this->description, (system_clock::from_time_t(this->ends) <= system_clock::now()) ? "ed" : "s",
 				dpp::utility::timestamp(this->ends, dpp::utility::tf_relative_time), dpp::utility::timestamp(this->ends, dpp::utility::tf_short_datetime),
 				this->host, this->entries.size(), (winners.empty()) ? std::to_string(this->winners) : winners));
-		bot->message_edit(this->message);
+		/* a click flood edits the same message over and over, only the newest waiting edit is worth sending */
+		rest->submit(rp_visible, bucket("messages.edit", this->message.channel_id), [m = this->message](dpp::command_completion_event_t done) { bot->message_edit(m, done); },
+			{}, bucket("edit", this->message.id));
+		static histogram& write_time = io_time.with("giveaway_write");
+		timed t(write_time);
+		span s("giveaway_write");
 		std::ofstream{ std::format(".\\giveaways\\{0}", static_cast<uint64_t>(this->message.id)) } << this->to_json();
 	}
 	nlohmann::json to_json() const {
@@ -30,138 +105,541 @@ struct giveaway {
 		{"w", this->winners},
 		{"h", this->host},
 		{"e", this->entries},
+		{"seed", this->seed},
 		{"m_id", static_cast<uint64_t>(this->message.id)},
-		{"m_cid", static_cast<uint64_t>(this->message.channel_id)} };
+		{"m_cid", static_cast<uint64_t>(this->message.channel_id)},
+		{"g", static_cast<uint64_t>(this->message.guild_id)} };
 	}
 };
-std::unique_ptr<std::unordered_map<dpp::snowflake, giveaway>> _giveaway = std::make_unique<std::unordered_map<dpp::snowflake, giveaway>>();
-std::function<void(dpp::snowflake id)> pending_giveaway = [](dpp::snowflake id)
+/* everything a guild owns. only touched from that guild's lane */
+struct guild_state {
+	std::unordered_map<dpp::snowflake, giveaway> giveaways{};
+	std::unordered_map<dpp::snowflake, steady_clock::time_point> cmd_cooldown{}, btn_cooldown{};
+	market trades{}; /* its journal is .\market\<guild>.bin, see market_of */
+};
+std::unique_ptr<guild_local<guild_state>> guilds{};
+
+/* one interaction per user per second. true if user may go ahead */
+static bool cooldown(std::unordered_map<dpp::snowflake, steady_clock::time_point>& users, dpp::snowflake user) {
+	steady_clock::time_point now = steady_clock::now();
+	if (users.size() > 1024) std::erase_if(users, [now](const auto& u) { return u.second <= now; });
+	auto [it, fresh] = users.try_emplace(user, now + 1s);
+	if (not fresh and it->second > now) return false;
+	it->second = now + 1s;
+	return true;
+}
+
+/*
+ * the winners of a draw, in the order they were picked. only depends on seed and entries in join order,
+ * so changing how it picks breaks replaying every recorded draw
+ */
+static std::vector<uint64_t> draw(uint64_t seed, std::vector<uint64_t> entries, size_t winners) {
+	xoshiro256 rng(seed);
+	sample(rng, std::span(entries), winners);
+	entries.resize(std::min(winners, entries.size()));
+	return entries;
+}
+/* --draw <file> replays a draw recorded in .\draws\ and checks it picks the same winners */
+static int replay_draw(const std::string& file) {
+	nlohmann::json j = nlohmann::json::parse(std::ifstream{ file }, nullptr, false);
+	if (j.is_discarded() or not j.contains("seed")) {
+		std::cout << std::format("{0} isn't a draw record", file) << std::endl;
+		return 1;
+	}
+	std::vector<uint64_t> winners = draw(j["seed"], j["e"], j["w"]);
+	for (uint64_t w : winners) std::cout << w << "\n";
+	bool same = winners == j["winners"].get<std::vector<uint64_t>>();
+	std::cout << (same ? "matches the recorded winners" : "DIFFERS from the recorded winners") << std::endl;
+	return same ? 0 : 1;
+}
+
+std::function<void(dpp::snowflake guild, dpp::snowflake id)> pending_giveaway = [](dpp::snowflake guild, dpp::snowflake id)
 	{
-		std::unique_ptr<giveaway> gw = std::make_unique<giveaway>(_giveaway->at(id));
-		std::this_thread::sleep_until(system_clock::from_time_t(gw->ends));
-		gw.reset(new giveaway(_giveaway->at(id)));
+		std::unordered_map<dpp::snowflake, giveaway>& _giveaway = guilds->of(guild).giveaways;
+		std::unique_ptr<giveaway> gw = std::make_unique<giveaway>(_giveaway.at(id));
 		gw->message.components[0].components[0].set_disabled(true);
-		gw->winners = std::clamp(static_cast<int>(gw->winners), 1, static_cast<int>(gw->entries.size()));
+		std::vector<uint64_t> picked = draw(gw->seed, gw->entries, gw->winners);
 		std::string winners{};
-		if (not gw->entries.empty()) {
-			gw->sub_entries = gw->entries;
-			for (int64_t i = 0; i < gw->winners; i++)
-			{
-				size_t result = rand<size_t>(0, gw->sub_entries.size() - 1);
-				winners += std::format("<@{0}>, ", gw->sub_entries[result]);
-				gw->sub_entries.erase(std::ranges::find(gw->sub_entries, gw->sub_entries[result]));
-			}
-			winners.resize(winners.size() - 2);
-		}
+		for (uint64_t w : picked) winners += std::format("<@{0}>, ", w);
+		if (not winners.empty()) winners.resize(winners.size() - 2);
+		gw->message.embeds[0].set_footer(dpp::embed_footer().set_text(std::format("draw {0}, seed {1:016x}", static_cast<uint64_t>(id), gw->seed)));
 		gw->message_update(winners);
-		_giveaway->erase(id);
+		_giveaway.erase(id);
+		static histogram& remove_time = io_time.with("giveaway_remove");
+		timed t(remove_time);
+		span s("giveaway_remove");
+		/* what's needed to replay the draw stays behind, the giveaway itself is done */
+		nlohmann::json record = gw->to_json();
+		record["winners"] = picked;
+		std::filesystem::create_directories(".\\draws\\");
+		std::ofstream{ std::format(".\\draws\\{0}", static_cast<uint64_t>(id)) } << record;
 		std::filesystem::remove(std::format(".\\giveaways\\{0}", static_cast<uint64_t>(id)));
 	};
+/* runs fn once after seconds on a dpp timer. the mock swaps in its own clock, timers only tick on a started cluster */
+std::function<void(time_t seconds, std::function<void()> fn)> after = [](time_t seconds, std::function<void()> fn)
+	{
+		bot->start_timer([fn = std::move(fn)](dpp::timer t)
+			{
+				bot->stop_timer(t);
+				fn();
+			}, seconds);
+	};
+/* hands the giveaway back to its guild's lane when it ends, instead of parking a thread until then */
+static void schedule_giveaway(dpp::snowflake guild, dpp::snowflake id, time_t ends) {
+	after(std::max<time_t>(ends - time(0), 1), [guild, id] { guild_lanes->post(guild, [guild, id] { pending_giveaway(guild, id); }); });
+}
+
+/* redraws p's chart into its message on its guild's lane. a burst of redraws sends only the newest */
+static void poll_update(std::shared_ptr<poll> p) {
+	span s("poll_render");
+	dpp::message m = p->message;
+	m.attachments.clear(); /* the old chart isn't kept, the new upload replaces it */
+	m.add_file("poll.png", p->draw());
+	m.embeds[0].set_description(std::format("**{0}** votes \nEnd{1}: {2}", p->turnout(), (p->closed) ? "ed" : "s", dpp::utility::timestamp(p->ends, dpp::utility::tf_relative_time)));
+	if (p->closed) for (dpp::component& row : m.components) for (dpp::component& button : row.components) button.set_disabled(true);
+	rest->submit(rp_visible, bucket("messages.edit", m.channel_id), [m = std::move(m)](dpp::command_completion_event_t done) { bot->message_edit(m, done); },
+		{}, bucket("edit", p->message.id));
+}
+/* closes the poll when it ends and draws the final chart */
+static void schedule_poll(dpp::snowflake guild, dpp::snowflake id, time_t ends) {
+	after(std::max<time_t>(ends - time(0), 1), [guild, id]
+		{
+			guild_lanes->post(guild, [id]
+				{
+					std::shared_ptr<poll> p = polls.remove(id);
+					if (not p) return;
+					p->closed = true;
+					poll_update(std::move(p));
+				});
+		});
+}
+/* a click on a poll's button, counted on the thread it came in on. clicking again only changes the vote, so there's no cooldown */
+static void poll_vote(std::shared_ptr<dpp::button_click_t> event) {
+	static histogram& vote_time = handler_time.with("vote");
+	timed t(vote_time);
+	std::shared_ptr<poll> p = polls.find(event->command.msg.id);
+	size_t option = std::strtoull(event->custom_id.c_str() + std::size("poll.") - 1, nullptr, 10);
+	if (not p or p->closed or option >= p->options.size()) return respond(event, dpp::message("> This poll is closed").set_flags(dpp::m_ephemeral));
+	int previous = p->vote(event->command.member.user_id, option);
+	std::string_view what = (previous < 0) ? "Voted for" : (previous == static_cast<int>(option)) ? "You already voted for" : "Changed your vote to";
+	respond(event, dpp::message(std::format("> {0} **{1}**", what, p->options[option])).set_flags(dpp::m_ephemeral));
+}
+
+/*
+ * the guild's market, rebuilt from its journal the first time it's used since the start, null while its journal can't be
+ * opened. only from the guild's lane
+ */
+static market* market_of(dpp::snowflake guild) {
+	market& m = guilds->of(guild).trades;
+	if (not m.opened()) {
+		static histogram& replay_time = io_time.with("market_replay");
+		timed t(replay_time);
+		std::filesystem::create_directories(".\\market\\");
+		std::string file = std::format(".\\market\\{0}.bin", static_cast<uint64_t>(guild));
+		if (not m.open(file)) {
+			bot->log(dpp::ll_error, std::format("market: guild {0}'s journal {1} can't be read or isn't a market journal, its market stays closed", static_cast<uint64_t>(guild), file));
+			return nullptr;
+		}
+		if (m.diverged()) bot->log(dpp::ll_warning, std::format("market: guild {0} replayed {1} fills differently from its journal", static_cast<uint64_t>(guild), m.diverged()));
+		if (m.corrupted()) bot->log(dpp::ll_error, std::format("market: guild {0} skipped {1} corrupt records in its journal", static_cast<uint64_t>(guild), m.corrupted()));
+	}
+	return &m;
+}
+
+/* the bot's own containers for the soak test, each guild's state read by a task on its lane */
+static std::vector<soak_gauge> soak_gauges() {
+	struct sizes {
+		std::atomic<size_t> states{}, giveaways{}, cmd_cooldowns{}, btn_cooldowns{}, lanes_left{};
+	};
+	std::shared_ptr<sizes> s = std::make_shared<sizes>();
+	s->lanes_left = guild_lanes->size();
+	s->lanes_left -= guild_lanes->post_each([s](size_t lane)
+		{
+			guilds->each(lane, [&s](dpp::snowflake, guild_state& state)
+				{
+					s->states++;
+					s->giveaways += state.giveaways.size();
+					s->cmd_cooldowns += state.cmd_cooldown.size();
+					s->btn_cooldowns += state.btn_cooldown.size();
+				});
+			s->lanes_left--;
+		});
+	for (int i = 0; s->lanes_left and i < 1000; i++) std::this_thread::sleep_for(10ms);
+	size_t files = 0;
+	for (const auto& file : std::filesystem::directory_iterator(".\\giveaways\\")) files++;
+	return {
+		{ "guild states", static_cast<double>(s->states.load()), 16 },
+		{ "giveaways", static_cast<double>(s->giveaways.load()), 16 },
+		{ "giveaway files", static_cast<double>(files), 16 },
+		{ "command cooldowns", static_cast<double>(s->cmd_cooldowns.load()), 1024 },
+		{ "button cooldowns", static_cast<double>(s->btn_cooldowns.load()), 1024 }
+	};
+}
 
-static void button_pressed(std::unique_ptr<dpp::button_click_t> event) {
+static void button_pressed(std::shared_ptr<dpp::button_click_t> event) {
+	if (not cooldown(guilds->of(event->command.guild_id).btn_cooldown, event->command.member.user_id)) return;
 	std::unique_ptr<std::vector<std::string>> i = index(event->custom_id, '.');
 	if (i->at(0) == "giveaway") {
-		std::unique_ptr<giveaway> gw = std::make_unique<giveaway>(_giveaway->at(stoull(i->at(1))));
+		std::unordered_map<dpp::snowflake, giveaway>& _giveaway = guilds->of(event->command.guild_id).giveaways;
+		std::unique_ptr<giveaway> gw = std::make_unique<giveaway>(_giveaway.at(stoull(i->at(1))));
 		if (std::ranges::find(gw->entries, static_cast<uint64_t>(event->command.member.user_id)) not_eq gw->entries.end())
-			event->reply(std::make_unique<dpp::message>("> You have already entered this giveaway!")
+			respond(event, std::make_unique<dpp::message>("> You have already entered this giveaway!")
 				->set_flags(dpp::m_ephemeral));
 		else
 		{
 			gw->entries.emplace_back(event->command.member.user_id);
-			_giveaway->at(stoull(i->at(1))) = *gw;
+			_giveaway.at(stoull(i->at(1))) = *gw;
 			gw->message_update();
-			event->reply();
+			rest->submit(rp_interaction, bucket("interaction", event->command.id), [event](dpp::command_completion_event_t done) { event->reply(done); });
 		}
 	}
-	std::this_thread::sleep_for(1s);
-	btn_sender.erase(event->command.member.user_id);
 }
 
-static void command_sent(std::unique_ptr<dpp::slashcommand_t> event)
+static void command_sent(std::shared_ptr<dpp::slashcommand_t> event)
 {
+	if (not cooldown(guilds->of(event->command.guild_id).cmd_cooldown, event->command.member.user_id)) return;
 	if (event->command.get_command_name() == "purge")
 	{
-		bot->messages_get(event->command.channel.id, 0, event->command.id, 0, std::clamp((int)get<int64_t>(event->get_parameter("amount")), 1, 100),
-			[&event](const dpp::confirmation_callback_t& mg_cb)
+		rest->submit(rp_background, bucket("messages.get", event->command.channel.id), [event](dpp::command_completion_event_t done)
 			{
-				if (mg_cb.is_error() or std::get<dpp::message_map>(mg_cb.value).empty()) return;
+				bot->messages_get(event->command.channel.id, 0, event->command.id, 0, std::clamp((int)get<int64_t>(event->get_parameter("amount")), 1, 100), done);
+			},
+			[event](const dpp::confirmation_callback_t& mg_cb)
+			{
+				if (mg_cb.is_error()) return respond(event, dpp::message(std::format("> {0}", mg_cb.get_error().message)).set_flags(dpp::m_ephemeral));
+				if (std::get<dpp::message_map>(mg_cb.value).empty()) return;
 				std::vector<dpp::snowflake> message_vector;
 				for (const auto& [id, m] : std::move(std::get<dpp::message_map>(mg_cb.value))) message_vector.emplace_back(id);
-				bot->message_delete_bulk(message_vector, event->command.channel.id,
-					[&event, mg_cb](const dpp::confirmation_callback_t& mdb_cb)
+				rest->submit(rp_background, bucket("messages.bulk", event->command.channel.id), [event, message_vector](dpp::command_completion_event_t done)
+					{
+						bot->message_delete_bulk(message_vector, event->command.channel.id, done);
+					},
+					[event, mg_cb](const dpp::confirmation_callback_t& mdb_cb)
 					{
 						std::unique_ptr<dpp::message> msg = std::make_unique<dpp::message>();
 						std::string what = mdb_cb.is_error() ?
 							std::format("> {0}", mdb_cb.get_error().message) :
 							std::format("> Deleted **{0}** messages", std::get<dpp::message_map>(mg_cb.value).size());
 						msg->set_content(std::move(what)).set_flags(dpp::m_ephemeral);
-						event->reply(std::move(*msg));
+						respond(event, std::move(*msg));
 					});
 			});
 	}
 	if (event->command.get_command_name() == "gcreate")
 	{
+		parsed_time duration = parse_time(get<std::string>(event->get_parameter("duration")));
 		giveaway gw = {
 			get<std::string>(event->get_parameter("description")),
-			string_to_time(get<std::string>(event->get_parameter("duration"))), get<int64_t>(event->get_parameter("winners")),
-			event->command.member.user_id
+			duration.resolve(time(0)), get<int64_t>(event->get_parameter("winners")),
+			event->command.member.user_id, {}, random_seed()
 		};
-		if (system_clock::from_time_t(gw.ends) <= system_clock::now())
-			event->reply(std::make_unique<dpp::message>("> invalid duration. e.g. **1h, 30m**")
-				->set_flags(dpp::m_ephemeral));
+		if (duration.error)
+			respond(event, dpp::message(std::format("> invalid duration, {0} at character {1}. e.g. **1h 30m**, **2d** or **2025-01-31 18:00**", time_error_names[duration.error], duration.at + 1))
+				.set_flags(dpp::m_ephemeral));
+		else if (system_clock::from_time_t(gw.ends) <= system_clock::now())
+			respond(event, dpp::message("> that's already over, pick a time in the future").set_flags(dpp::m_ephemeral));
 		else
 		{
-			bot->message_create(std::make_unique<dpp::message>(event->command.channel.id,
+			rest->submit(rp_visible, bucket("messages.create", event->command.channel.id), [m = std::make_unique<dpp::message>(event->command.channel.id,
 				std::make_unique<dpp::embed>()
 				->set_title({ get<std::string>(event->get_parameter("title")) }))
 				->add_component(std::make_unique<dpp::component>()->add_component(std::make_unique<dpp::component>()
-					->set_emoji(u8"🎉").set_id("nullptr"))),
-				[&event, &gw](const dpp::confirmation_callback_t& callback)
+					->set_emoji(u8"🎉").set_id("nullptr")))](dpp::command_completion_event_t done) { bot->message_create(m, done); },
+				[event, gw](const dpp::confirmation_callback_t& callback)
 				{
-					if (callback.is_error()) return;
-					gw.message = std::move(*std::make_unique<dpp::message>(std::get<dpp::message>(callback.value)));
-					gw.description = std::move(get<std::string>(event->get_parameter("description"))); // TODO
-					gw.message.components[0].components[0].set_id(std::format(".giveaway.{0}", (uint64_t)gw.message.id));
-					gw.message_update();
-					_giveaway->emplace(gw.message.id, gw);
-					active_code.emplace_back(std::async(std::launch::async, pending_giveaway, gw.message.id));
-					event->reply(std::make_unique<dpp::message>(std::format("> The giveaway was successfully created! ID: **{0}**", static_cast<uint64_t>(gw.message.id)))
-						->set_flags(dpp::m_ephemeral));
+					if (callback.is_error()) return respond(event, dpp::message(std::format("> {0}", callback.get_error().message)).set_flags(dpp::m_ephemeral));
+					/* REST callbacks run on dpp's threads, the new giveaway is handed to its guild's lane */
+					guild_lanes->post(event->command.guild_id, [event, gw, message = std::get<dpp::message>(callback.value)]() mutable
+						{
+							gw.message = std::move(message);
+							gw.message.guild_id = event->command.guild_id; /* not part of the REST reply, needed to find the owning shard */
+							gw.description = std::move(get<std::string>(event->get_parameter("description"))); // TODO
+							gw.message.components[0].components[0].set_id(std::format(".giveaway.{0}", (uint64_t)gw.message.id));
+							gw.message_update();
+							guilds->of(event->command.guild_id).giveaways.emplace(gw.message.id, gw);
+							schedule_giveaway(event->command.guild_id, gw.message.id, gw.ends);
+							respond(event, std::make_unique<dpp::message>(std::format("> The giveaway was successfully created! ID: **{0}**", static_cast<uint64_t>(gw.message.id)))
+								->set_flags(dpp::m_ephemeral));
+						});
+				});
+		}
+	}
+	if (event->command.get_command_name() == "poll")
+	{
+		parsed_time duration = parse_time(get<std::string>(event->get_parameter("duration")));
+		std::vector<std::string> options{};
+		for (const std::string& o : *index(get<std::string>(event->get_parameter("options")), ';')) {
+			size_t first = o.find_first_not_of(' '), last = o.find_last_not_of(' ');
+			if (first not_eq std::string::npos) options.emplace_back(o.substr(first, std::min<size_t>(last - first + 1, 80))); /* button labels stop at 80 */
+		}
+		if (duration.error)
+			respond(event, dpp::message(std::format("> invalid duration, {0} at character {1}. e.g. **1h 30m**, **2d** or **2025-01-31 18:00**", time_error_names[duration.error], duration.at + 1))
+				.set_flags(dpp::m_ephemeral));
+		else if (options.size() < 2 or options.size() > poll::max_options)
+			respond(event, dpp::message(std::format("> Give between 2 and {0} options, separated by **;**", poll::max_options)).set_flags(dpp::m_ephemeral));
+		else if (system_clock::from_time_t(duration.resolve(time(0))) <= system_clock::now())
+			respond(event, dpp::message("> that's already over, pick a time in the future").set_flags(dpp::m_ephemeral));
+		else
+		{
+			std::shared_ptr<poll> p = std::make_shared<poll>(get<std::string>(event->get_parameter("question")), std::move(options), duration.resolve(time(0)));
+			dpp::message m(event->command.channel.id, dpp::embed()
+				.set_title(p->question)
+				.set_description(std::format("**0** votes \nEnds: {0}", dpp::utility::timestamp(p->ends, dpp::utility::tf_relative_time)))
+				.set_image("attachment://poll.png"));
+			for (size_t i = 0; i < p->options.size(); i++) {
+				if (i % 5 == 0) m.add_component(dpp::component());
+				m.components.back().add_component(dpp::component().set_label(p->options[i]).set_style(dpp::cos_secondary).set_id(std::format("poll.{0}", i)));
+			}
+			m.add_file("poll.png", p->draw());
+			rest->submit(rp_visible, bucket("messages.create", event->command.channel.id), [m = std::move(m)](dpp::command_completion_event_t done) { bot->message_create(m, done); },
+				[event, p](const dpp::confirmation_callback_t& callback)
+				{
+					if (callback.is_error()) return respond(event, dpp::message(std::format("> {0}", callback.get_error().message)).set_flags(dpp::m_ephemeral));
+					/* votes find it by message id, so it's complete before it's added */
+					p->message = std::get<dpp::message>(callback.value);
+					p->message.guild_id = event->command.guild_id;
+					polls.add(p);
+					schedule_poll(event->command.guild_id, p->message.id, p->ends);
+					respond(event, dpp::message(std::format("> The poll is open! ID: **{0}**", static_cast<uint64_t>(p->message.id))).set_flags(dpp::m_ephemeral));
 				});
 		}
 	}
+	if (event->command.get_command_name() == "market")
+	{
+		std::string action = get<std::string>(event->get_parameter("action")), item = market::normalize(get<std::string>(event->get_parameter("item")));
+		dpp::command_value quantity = event->get_parameter("quantity"), price = event->get_parameter("price"), order = event->get_parameter("order");
+		uint64_t user = event->command.member.user_id;
+		if (item.empty()) return respond(event, dpp::message("> Name an item").set_flags(dpp::m_ephemeral));
+		market* open = market_of(event->command.guild_id);
+		if (not open) return respond(event, dpp::message("> This server's market is closed, its records can't be read right now").set_flags(dpp::m_ephemeral));
+		market& m = *open;
+		/* the journal failed mid-write, the next use replays whatever of it reached the file */
+		const std::string unsaved = "> This server's market couldn't save that, check your orders and try again";
+		if (action == "book")
+		{
+			auto [bids, asks] = m.depth(item, 5);
+			auto side = [](const std::vector<std::pair<int64_t, uint64_t>>& levels)
+				{
+					std::string out{};
+					for (const auto& [p, q] : levels) out += std::format("{0}**{1}** x{2}", out.empty() ? "" : ", ", p, q);
+					return out.empty() ? std::string("none") : out;
+				};
+			return respond(event, dpp::message(std::format("> **{0}**\nSelling: {1}\nBuying: {2}", item, side(asks), side(bids))).set_flags(dpp::m_ephemeral));
+		}
+		if (action == "cancel")
+		{
+			if (not std::holds_alternative<int64_t>(order)) return respond(event, dpp::message("> Give the order's id to cancel").set_flags(dpp::m_ephemeral));
+			std::optional<uint64_t> left = m.cancel(user, item, static_cast<uint64_t>(std::get<int64_t>(order)));
+			if (not left) return respond(event, dpp::message(unsaved).set_flags(dpp::m_ephemeral));
+			return respond(event, dpp::message(*left ? std::format("> Cancelled, **{0}** {1} taken off the market", *left, item) : std::string("> You have no such order open"))
+				.set_flags(dpp::m_ephemeral));
+		}
+		if (not std::holds_alternative<int64_t>(quantity) or not std::holds_alternative<int64_t>(price))
+			return respond(event, dpp::message("> Give a quantity and a price to buy or sell").set_flags(dpp::m_ephemeral));
+		order_side side = (action == "buy") ? os_buy : os_sell;
+		std::vector<fill> fills{};
+		std::optional<std::pair<uint64_t, uint64_t>> placed = m.place(user, item, side, std::get<int64_t>(price), static_cast<uint64_t>(std::get<int64_t>(quantity)), fills);
+		if (not placed) return respond(event, dpp::message(unsaved).set_flags(dpp::m_ephemeral));
+		auto [id, resting] = *placed;
+		if (not id) return respond(event, dpp::message(std::format("> This server's market has orders in all of its {0} items", market::max_items)).set_flags(dpp::m_ephemeral));
+		/* in public, so whoever was on the other side of a fill is pinged */
+		uint64_t filled = 0;
+		std::string trades{};
+		for (size_t i = 0; i < fills.size(); i++) {
+			filled += fills[i].quantity;
+			if (i < 5) trades += std::format("\n{0} x{1} at **{2}** {3} <@{4}>", item, fills[i].quantity, fills[i].price, (side == os_buy) ? "from" : "to", (side == os_buy) ? fills[i].seller : fills[i].buyer);
+		}
+		if (fills.size() > 5) trades += std::format("\nand {0} more", fills.size() - 5);
+		uint64_t wanted = static_cast<uint64_t>(std::get<int64_t>(quantity));
+		std::string dropped = (wanted > filled + resting) ? std::format(", {0} dropped rather than trade with your own order", wanted - filled - resting) : std::string();
+		respond(event, dpp::message(std::format("> Order **{0}**: {1} **{2}** {3} at **{4}**, {5} filled, {6} on the market{7}{8}",
+			id, (side == os_buy) ? "buy" : "sell", wanted, item, std::get<int64_t>(price), filled, resting, dropped, trades)));
+	}
 	if (event->command.get_command_name() == "lvl")
 	{
+		/* acknowledge first, the card upload is background work that must not hold up other guilds' replies */
+		rest->submit(rp_interaction, bucket("interaction", event->command.id), [event](dpp::command_completion_event_t done) { event->thinking(false, done); });
+		{
+			static histogram& download_time = io_time.with("avatar_download");
+			timed t(download_time);
+			span s("avatar_download");
+			URLDownloadToFileW(NULL,
+				to_wstring(event->command.get_issuing_user().get_avatar_url(128, dpp::i_jpg)).c_str(),
+				to_wstring(".\\cache\\" + std::to_string(event->command.member.user_id) + ".jpg").c_str(), 0, NULL);
+		}
+		steady_clock::time_point drawing = steady_clock::now();
 		image img(event->command.member.user_id, { 140, 500 }, { blue(43), green(45), red(49) });
 		img.add_line({ 20, 140 / 2 }, { 480, 140 / 2 }, { {}, {}, {}}, 4);
 		img.add_line({ 20 /* + XP */, 140 / 2 }, { 480, 140 / 2 }, { blue() / 2.0, green() / 2.0, red() / 2.0 }, 4);
-		img.add_text(event->command.member.get_user()->username,
-			{ (480 / 2) - static_cast<int>(event->command.member.get_user()->username.size()) * 4, 140 / 2 - 35 }, cv::FONT_HERSHEY_PLAIN, { {}, {}, {} });
-		URLDownloadToFileW(NULL,
-			to_wstring(event->command.member.get_user()->get_avatar_url(128, dpp::i_jpg)).c_str(),
-			to_wstring(".\\cache\\" + std::to_string(event->command.member.user_id) + ".jpg").c_str(), 0, NULL);
+		img.add_text(event->command.get_issuing_user().username,
+			{ (480 / 2) - static_cast<int>(event->command.get_issuing_user().username.size()) * 4, 140 / 2 - 35 }, cv::FONT_HERSHEY_PLAIN, { {}, {}, {} });
 		img.add_image(std::to_string(event->command.member.user_id), { 0, 0 });
-		img.image_write();
-		event->reply(dpp::message(event->command.channel.id, "").add_file(img.path().c_str(), img.raw()));
+		render_time.record(steady_clock::now() - drawing);
+		trace_span("render", trace_current, trace_time(drawing), trace_now());
+		std::string card{};
+		{
+			static histogram& write_time = io_time.with("card_write");
+			timed t(write_time);
+			span s("card_write");
+			img.image_write();
+			card = img.raw();
+		}
+		/* same bucket as the acknowledgement, so the edit can't overtake it */
+		rest->submit(rp_background, bucket("interaction", event->command.id), [event, m = dpp::message(event->command.channel.id, "").add_file(img.path().c_str(), card)](dpp::command_completion_event_t done)
+			{
+				event->edit_original_response(m, done);
+			});
+	}
+	if (event->command.get_command_name() == "capture")
+	{
+		/* only this process records, with several clusters each one is started separately */
+		if (std::get<bool>(event->get_parameter("on")))
+			respond(event, dpp::message(std::format("> Recording interactions to **{0}**", recorder.start())).set_flags(dpp::m_ephemeral));
+		else
+		{
+			recorder.stop();
+			respond(event, dpp::message("> Recording stopped").set_flags(dpp::m_ephemeral));
+		}
+	}
+	if (event->command.get_command_name() == "trace")
+	{
+		/* open in chrome://tracing or ui.perfetto.dev, every span carries its interaction id */
+		int64_t seconds = std::clamp<int64_t>(get<int64_t>(event->get_parameter("seconds")), 1, 60);
+		respond(event, dpp::message(std::format("> Spans from the last {0} s", seconds))
+			.add_file(std::format("trace-{0}.json", time(0)), chrome_trace(std::chrono::seconds(seconds))).set_flags(dpp::m_ephemeral));
+	}
+	if (event->command.get_command_name() == "stats")
+	{
+		/* drawn at most every board->redraw, a flood of /stats gets the same card */
+		respond(event, dpp::message().add_file("stats.png", board->get()));
+	}
+	if (event->command.get_command_name() == "play")
+	{
+		std::string name = std::get<std::string>(event->get_parameter("clip"));
+		dpp::command_value loop = event->get_parameter("loop");
+		/* only the first play of a clip transcodes it, every later one maps the cached frames */
+		std::shared_ptr<const clip> c = clips.get(name);
+		if (not c) return respond(event, dpp::message(std::format("> There's no clip called **{0}**", name)).set_flags(dpp::m_ephemeral));
+		if (not event->from) return respond(event, dpp::message("> Voice needs a gateway connection").set_flags(dpp::m_ephemeral)); /* replayed or mocked */
+		dpp::snowflake guild = event->command.guild_id, channel = std::get<dpp::snowflake>(event->get_parameter("channel"));
+		if (dpp::voiceconn* v = event->from->get_voice(guild); v and v->channel_id == channel and v->is_ready())
+			voice->start(guild, c, std::holds_alternative<bool>(loop) and std::get<bool>(loop), voice_out::of(event->from, guild));
+		else
+		{
+			voice->later(guild, c, std::holds_alternative<bool>(loop) and std::get<bool>(loop));
+			event->from->connect_voice(guild, channel);
+		}
+		respond(event, dpp::message(std::format("> Playing **{0}** ({1:.0f} s) in <#{2}>", name, c->seconds(), static_cast<uint64_t>(channel))));
+	}
+	if (event->command.get_command_name() == "sfx")
+	{
+		std::string name = std::get<std::string>(event->get_parameter("clip"));
+		dpp::command_value volume = event->get_parameter("volume");
+		/*
+		 * samples of the effect and of what's playing, fetched before the pump is locked since either may transcode.
+		 * effects are short and made here, a song is made off the lane and the first /sfx over it asks to try again
+		 */
+		std::string playing = voice->now_playing(event->command.guild_id);
+		std::shared_ptr<const pcm_clip> effect = clips.get_pcm(name), music = clips.pcm_if_ready(playing);
+		if (not effect) return respond(event, dpp::message(std::format("> There's no clip called **{0}**", name)).set_flags(dpp::m_ephemeral));
+		if (playing.empty()) return respond(event, dpp::message("> Nothing is playing, start something with /play first").set_flags(dpp::m_ephemeral));
+		if (not music) return respond(event, dpp::message(std::format("> Getting **{0}** ready to mix, try again in a few seconds", playing)).set_flags(dpp::m_ephemeral));
+		float gain = std::holds_alternative<int64_t>(volume) ? std::get<int64_t>(volume) / 100.0f : 1.0f;
+		if (not voice->layer(event->command.guild_id, effect, guild_mixer::mk_effect, gain, music))
+			return respond(event, dpp::message("> Can't mix over what's playing right now").set_flags(dpp::m_ephemeral));
+		respond(event, dpp::message(std::format("> Playing **{0}** over the music", name)).set_flags(dpp::m_ephemeral));
+	}
+	if (event->command.get_command_name() == "stop")
+	{
+		bool playing = voice->stop(event->command.guild_id);
+		recordings->stop(event->command.guild_id); /* leaving ends a recording too */
+		if (event->from) event->from->disconnect_voice(event->command.guild_id);
+		respond(event, dpp::message(playing ? "> Stopped" : "> Nothing is playing").set_flags(dpp::m_ephemeral));
+	}
+	if (event->command.get_command_name() == "record")
+	{
+		dpp::snowflake guild = event->command.guild_id;
+		if (not std::get<bool>(event->get_parameter("on")))
+		{
+			if (not recordings->stop(guild)) return respond(event, dpp::message("> Nothing is being recorded").set_flags(dpp::m_ephemeral));
+			/* stays for the music if something is playing */
+			if (event->from and voice->now_playing(guild).empty()) event->from->disconnect_voice(guild);
+			return respond(event, dpp::message("> Recording stopped").set_flags(dpp::m_ephemeral));
+		}
+		dpp::command_value c = event->get_parameter("channel");
+		if (not std::holds_alternative<dpp::snowflake>(c)) return respond(event, dpp::message("> Pick a voice channel to record").set_flags(dpp::m_ephemeral));
+		if (not event->from) return respond(event, dpp::message("> Voice needs a gateway connection").set_flags(dpp::m_ephemeral));
+		dpp::snowflake channel = std::get<dpp::snowflake>(c);
+		dpp::voiceconn* v = event->from->get_voice(guild);
+		if (v and v->channel_id not_eq channel) return respond(event, dpp::message(std::format("> Already in <#{0}>, /stop first", static_cast<uint64_t>(v->channel_id))).set_flags(dpp::m_ephemeral));
+		std::string dir = recordings->start(guild, channel);
+		if (dir.empty()) return respond(event, dpp::message("> Already recording").set_flags(dpp::m_ephemeral));
+		/* packets only arrive once the connection is up, nothing waits on it */
+		if (not v) event->from->connect_voice(guild, channel);
+		respond(event, dpp::message(std::format("> Recording <#{0}> to **{1}**, one file per speaker", static_cast<uint64_t>(channel), dir)).set_flags(dpp::m_ephemeral));
 	}
-	std::this_thread::sleep_for(1s);
-	cmd_sender.erase(event->command.member.user_id);
 }
 
-int main()
+int main(int argc, char* argv[])
 {
+	if (std::string_view name = option(argc, argv, "--bench"); not name.empty()) return bench(argc, argv, name);
+	if (std::string_view file = option(argc, argv, "--draw"); not file.empty()) return replay_draw(std::string(file));
+	std::string_view shards = option(argc, argv, "--shards");
+	if (std::string_view clusters = option(argc, argv, "--coordinator"); not clusters.empty())
+		return coordinator(std::stoul(std::string(clusters)), shards.empty() ? 0 : std::stoul(std::string(shards))).run();
+	/* --cluster auto takes a slice from the coordinator, otherwise this process runs every shard */
+	shard_range range{ 0, 1, shards.empty() ? 0 : static_cast<uint32_t>(std::stoul(std::string(shards))) };
+	SOCKET coordinator_link = INVALID_SOCKET;
+	if (option(argc, argv, "--cluster") == "auto") range = coordinator::join(coordinator_link);
+	std::optional<gateway_profile> parsed_gateway = gateway_profile::from(option(argc, argv, "--gateway"));
+	if (not parsed_gateway)
+	{
+		std::cout << std::format("unknown --gateway {0}, use etf, etf+zlib, json or json+zlib", option(argc, argv, "--gateway")) << std::endl;
+		return 1;
+	}
+	gateway_profile gateway = *parsed_gateway;
+	if (option(argc, argv, "--trace") == "off") trace_enabled = false;
+	/* --allocations on charges every handler run's allocations to its command, replay and mock always do */
+	alloc_attribution = option(argc, argv, "--allocations") == "on" or not option(argc, argv, "--replay").empty() or not option(argc, argv, "--mock").empty() or not option(argc, argv, "--soak").empty();
+	/*
+	 * per handler run budgets, none set until they're measured: replay a capture of real traffic with
+	 * neko.exe --replay <capture> --speed max, take each command's "max" from the allocations: lines, add a quarter and
+	 * set it here as handler_allocations.budget("purge", { count, bytes }) with the capture and date in a comment.
+	 * raise one on purpose, not to silence a warning
+	 */
+	build_command_table();
+	bot = std::make_unique<dpp::cluster>("MTAwNDUxNDkzNTA1OTAwNTQ3MA.______.", modules.intents(), range.shards, range.cluster_id, range.maxclusters, gateway.compressed, modules.cache_policy());
+	bot->set_websocket_protocol(gateway.protocol);
+	guild_lanes = std::make_unique<lanes>();
+	rest = std::make_unique<rest_scheduler>(&metrics);
+	board = std::make_unique<dashboard>(*bot, *guild_lanes, *rest, handler_time);
+	voice = std::make_unique<voice_pump>();
+	bot->log(dpp::ll_info, std::format("voice: mixing with {0}", mix_isa_names[voice->isa()]));
+	recordings = std::make_unique<voice_recorder>();
+	guilds = std::make_unique<guild_local<guild_state>>(*guild_lanes);
 	bot->on_ready([](const dpp::ready_t& event)
 		{
 			for (const auto& file : std::filesystem::directory_iterator(".\\giveaways\\"))
 			{
 				nlohmann::json j = nlohmann::json::parse(std::ifstream{ file.path().string() });
-				bot->message_get(dpp::snowflake(j["m_id"].get<uint64_t>()), dpp::snowflake(j["m_cid"].get<uint64_t>()), [j](const dpp::confirmation_callback_t& callback) {
+				/* only the shard owning the guild resumes it, so each giveaway runs once across every process. files older than "g" go to shard 0 */
+				if (shard_of(j.value("g", uint64_t{}), bot->numshards) not_eq event.from->shard_id) continue;
+				rest->submit(rp_background, bucket("message.get", j["m_cid"].get<uint64_t>()), [j](dpp::command_completion_event_t done)
+					{
+						bot->message_get(dpp::snowflake(j["m_id"].get<uint64_t>()), dpp::snowflake(j["m_cid"].get<uint64_t>()), done);
+					}, [j](const dpp::confirmation_callback_t& callback) {
 					if (callback.is_error()) return;
-					giveaway gw = { j["desc"], j["ends"], j["w"], j["h"], j["e"], {}, std::get<dpp::message>(callback.value) };
-					_giveaway->emplace(gw.message.id, std::move(gw));
-					active_code.emplace_back(std::async(std::launch::async, pending_giveaway, gw.message.id));
+					/* files from before draws were seeded get their seed now */
+					giveaway gw = { j["desc"], j["ends"], j["w"], j["h"], j["e"], j.value("seed", random_seed()), std::get<dpp::message>(callback.value) };
+					gw.message.guild_id = j.value("g", uint64_t{});
+					guild_lanes->post(gw.message.guild_id, [gw]
+						{
+							if (not guilds->of(gw.message.guild_id).giveaways.try_emplace(gw.message.id, gw).second) return; /* resumed by an earlier ready */
+							schedule_giveaway(gw.message.guild_id, gw.message.id, gw.ends);
+						});
 					});
 			}
+			if (bot->cluster_id not_eq 0 or not dpp::run_once<struct register_commands>()) return;
 			std::vector<dpp::slashcommand> cmds = {
 				dpp::slashcommand("purge", "mass delete messages", bot->me.id)
 					.set_default_permissions(dpp::p_administrator)
@@ -171,23 +649,198 @@ int main()
 					.set_default_permissions(dpp::p_administrator)
 					.add_option(dpp::command_option(dpp::co_string, "title", "what you're giveawaying", true))
 					.add_option(dpp::command_option(dpp::co_string, "description", "describe the giveaway", true))
-					.add_option(dpp::command_option(dpp::co_string, "duration", "the length of the giveaway e.g. 1h, 30m", true))
+					.add_option(dpp::command_option(dpp::co_string, "duration", "how long it runs or when it ends e.g. 1h 30m, 2d, 2025-01-31 18:00", true))
 					.add_option(dpp::command_option(dpp::co_integer, "winners", "amount of winners", true).set_min_value(1)),
 
-				dpp::slashcommand("lvl", "check your level", bot->me.id)
+				dpp::slashcommand("poll", "start a poll, one button per option", bot->me.id)
+					.set_default_permissions(dpp::p_administrator)
+					.add_option(dpp::command_option(dpp::co_string, "question", "what you're asking", true))
+					.add_option(dpp::command_option(dpp::co_string, "options", "up to 25, separated by ; e.g. pizza; sushi; tacos", true))
+					.add_option(dpp::command_option(dpp::co_string, "duration", "how long it runs or when it ends e.g. 1h 30m, 2d, 2025-01-31 18:00", true)),
+
+				dpp::slashcommand("market", "buy and sell items with other players", bot->me.id)
+					.add_option(dpp::command_option(dpp::co_string, "action", "what to do", true)
+						.add_choice(dpp::command_option_choice("buy", std::string("buy")))
+						.add_choice(dpp::command_option_choice("sell", std::string("sell")))
+						.add_choice(dpp::command_option_choice("cancel", std::string("cancel")))
+						.add_choice(dpp::command_option_choice("book", std::string("book"))))
+					.add_option(dpp::command_option(dpp::co_string, "item", "the item's name", true))
+					.add_option(dpp::command_option(dpp::co_integer, "quantity", "how many, to buy or sell", false).set_min_value(1).set_max_value(1'000'000))
+					.add_option(dpp::command_option(dpp::co_integer, "price", "per item, the most you'll pay or the least you'll take", false).set_min_value(1).set_max_value(1'000'000'000))
+					.add_option(dpp::command_option(dpp::co_integer, "order", "the order's id, to cancel", false).set_min_value(1)),
+
+				dpp::slashcommand("lvl", "check your level", bot->me.id),
+
+				dpp::slashcommand("capture", "record incoming interactions for offline replay", bot->me.id)
+					.set_default_permissions(dpp::p_administrator)
+					.add_option(dpp::command_option(dpp::co_boolean, "on", "start or stop recording", true)),
+
+				dpp::slashcommand("trace", "download recent interaction spans as a chrome trace", bot->me.id)
+					.set_default_permissions(dpp::p_administrator)
+					.add_option(dpp::command_option(dpp::co_integer, "seconds", "how far back to go", true).set_min_value(1).set_max_value(60)),
+
+				dpp::slashcommand("stats", "show how the bot is doing", bot->me.id)
+					.set_default_permissions(dpp::p_administrator),
+
+				dpp::slashcommand("play", "play a clip in a voice channel", bot->me.id)
+					.add_option(dpp::command_option(dpp::co_string, "clip", "name of the clip", true))
+					.add_option(dpp::command_option(dpp::co_channel, "channel", "voice channel to play in", true).add_channel_type(dpp::CHANNEL_VOICE))
+					.add_option(dpp::command_option(dpp::co_boolean, "loop", "start over when it ends", false)),
+
+				dpp::slashcommand("stop", "stop playing and leave voice", bot->me.id),
+
+				dpp::slashcommand("sfx", "play a clip over what's playing", bot->me.id)
+					.add_option(dpp::command_option(dpp::co_string, "clip", "name of the clip", true))
+					.add_option(dpp::command_option(dpp::co_integer, "volume", "percent, 100 by default", false).set_min_value(0).set_max_value(100)),
+
+				dpp::slashcommand("record", "record a voice channel, one file per speaker", bot->me.id)
+					.set_default_permissions(dpp::p_administrator)
+					.add_option(dpp::command_option(dpp::co_boolean, "on", "start or stop recording", true))
+					.add_option(dpp::command_option(dpp::co_channel, "channel", "voice channel to record", false).add_channel_type(dpp::CHANNEL_VOICE))
 			};
-			bot->global_bulk_command_create(std::move(cmds));
+			rest->submit(rp_background, "commands", [cmds = std::move(cmds)](dpp::command_completion_event_t done) { bot->global_bulk_command_create(cmds, done); });
 		});
 	bot->on_slashcommand([](const dpp::slashcommand_t& event)
 		{
-			if (cmd_sender.contains(event.command.member.user_id)) return;
-			cmd_sender.try_emplace(event.command.member.user_id, std::async(std::launch::async, command_sent, std::make_unique<dpp::slashcommand_t>(std::move(event))));
+			trace_scope scope(event.command.id);
+			span s("receive");
+			recorder.record(event);
+			std::shared_ptr<dpp::slashcommand_t> e = std::make_shared<dpp::slashcommand_t>(event);
+			const command_metrics& series = metrics_of(event.command.get_command_name());
+			series.received->add();
+			if (not guild_lanes->post(event.command.guild_id, [e, &series, queued = steady_clock::now()]
+				{
+					std::string name = e->command.get_command_name();
+					series.wait->record(steady_clock::now() - queued);
+					allocation_scope allocs{};
+					{
+						timed t(*series.run);
+						command_sent(e);
+					}
+					if (alloc_attribution and handler_allocations.charge(*series.allocs, allocs.total()))
+						bot->log(dpp::ll_warning, std::format("allocations: /{0} made {1} allocations, {2} bytes, over its budget", name, allocs.total().count, allocs.total().bytes));
+				}))
+			{
+				turned_away.add();
+				respond(e, dpp::message("> This server is busy, try again in a moment").set_flags(dpp::m_ephemeral));
+			}
+		});
+	bot->on_voice_ready([](const dpp::voice_ready_t& event)
+		{
+			voice->ready(event.voice_client->server_id, voice_out::of(event.from, event.voice_client->server_id));
 		});
+	/* on dpp's voice threads, the recorder copies the opus packets out and doesn't touch the lanes */
+	bot->on_voice_receive([](const dpp::voice_receive_t& event) { recordings->receive(event); });
 	bot->on_button_click([](const dpp::button_click_t& event)
 		{
-			if (btn_sender.contains(event.command.member.user_id)) return;
-			btn_sender.try_emplace(event.command.member.user_id, std::async(std::launch::async, button_pressed, std::make_unique<dpp::button_click_t>(std::move(event))));
+			static counter& clicks = interactions.with("click");
+			static histogram& click_wait = queue_wait.with("click"), & click_time = handler_time.with("click");
+			static allocation_ledger::entry& click_allocs = handler_allocations.of("click");
+			trace_scope scope(event.command.id);
+			span s("receive");
+			recorder.record(event);
+			std::shared_ptr<dpp::button_click_t> e = std::make_shared<dpp::button_click_t>(event);
+			clicks.add();
+			/* a vote touches no guild state, it's counted here instead of queueing behind everything else on the guild's lane */
+			if (e->custom_id.starts_with("poll.")) return poll_vote(e);
+			if (not guild_lanes->post(event.command.guild_id, [e, queued = steady_clock::now()]
+				{
+					click_wait.record(steady_clock::now() - queued);
+					allocation_scope allocs{};
+					{
+						timed t(click_time);
+						button_pressed(e);
+					}
+					if (alloc_attribution and handler_allocations.charge(click_allocs, allocs.total()))
+						bot->log(dpp::ll_warning, std::format("allocations: click made {0} allocations, {1} bytes, over its budget", allocs.total().count, allocs.total().bytes));
+				}))
+			{
+				turned_away.add();
+				respond(e, dpp::message("> This server is busy, try again in a moment").set_flags(dpp::m_ephemeral));
+			}
 		});
 	bot->on_log(dpp::utility::cout_logger());
+	bot->log(dpp::ll_info, "modules: " + modules.to_string());
+	bot->log(dpp::ll_info, "gateway: " + gateway.to_string());
+	bot->log(dpp::ll_info, std::format("cluster: {0}/{1}, shards: {2}", range.cluster_id, range.maxclusters, range.shards));
+	/* --replay <capture> [--speed 1|10|max] runs the handlers over a recorded capture instead of connecting */
+	if (std::string_view capture = option(argc, argv, "--replay"); not capture.empty())
+	{
+		std::string_view speed = option(argc, argv, "--speed");
+		rest->sink = true;
+		return replay(*bot, *guild_lanes, *rest, handler_allocations, std::string(capture), (speed.empty() or speed == "max") ? 0.0 : std::stod(std::string(speed)));
+	}
+	/*
+	 * --mock <seconds> [--rate n] [--guilds n] [--mix gcreate:1,click:90,purge:4,lvl:5] runs an interaction storm against a local stand-in for discord,
+	 * --soak <hours> [--speedup 60] with the same options keeps one going and fails if memory, threads, handles or containers keep growing
+	 */
+	std::string_view seconds = option(argc, argv, "--mock"), hours = option(argc, argv, "--soak");
+	if (not seconds.empty() or not hours.empty())
+	{
+		storm_script script{};
+		if (not seconds.empty()) script.seconds = std::stod(std::string(seconds));
+		if (std::string_view rate = option(argc, argv, "--rate"); not rate.empty()) script.rate = std::stod(std::string(rate));
+		if (std::string_view count = option(argc, argv, "--guilds"); not count.empty()) script.guilds = std::stoull(std::string(count));
+		if (std::string_view speedup = option(argc, argv, "--speedup"); not speedup.empty()) script.speedup = std::max(std::stod(std::string(speedup)), 1.0);
+		else if (not hours.empty()) script.speedup = 60.0; /* hour-long giveaways end every minute */
+		script.set_mix(option(argc, argv, "--mix"));
+		mock_discord discord{};
+		/* put dpp's timers back before discord goes, nothing may schedule on the mock after it */
+		std::function<void(time_t seconds, std::function<void()> fn)> dpp_after = std::move(after);
+		rest->transport = [&discord](const std::string& bucket, dpp::command_completion_event_t done) { discord.call(bucket, std::move(done)); };
+		after = [&discord](time_t seconds, std::function<void()> fn) { discord.after(static_cast<double>(seconds), std::move(fn)); };
+		int result = hours.empty() ?
+			discord.storm(*bot, *guild_lanes, *rest, handler_allocations, script) :
+			discord.soak(*bot, *guild_lanes, *rest, script, std::stod(std::string(hours)), soak_gauges);
+		rest->transport = {};
+		after = std::move(dpp_after);
+		return result;
+	}
+	/* --metrics-port n, 9464 by default. only this machine can scrape it */
+	std::string_view port = option(argc, argv, "--metrics-port");
+	scrape = std::make_unique<metrics_server>(metrics, port.empty() ? 9464 : static_cast<uint16_t>(std::stoul(std::string(port))));
+	metrics.add_collector([](std::string& out) { out += std::format("# HELP neko_rss_bytes working set\n# TYPE neko_rss_bytes gauge\nneko_rss_bytes {0}\n", rss()); });
+	if (alloc_attribution) metrics.add_collector([](std::string& out)
+		{
+			auto series = [&out](std::string_view name, std::string_view help, std::atomic<uint64_t> allocation_ledger::entry::* field)
+				{
+					out += std::format("# HELP {0} {1}\n# TYPE {0} counter\n", name, help);
+					handler_allocations.each([&](std::string_view command, const allocation_ledger::entry& e) { out += std::format("{0}{{command=\"{1}\"}} {2}\n", name, command, (e.*field).load()); });
+				};
+			series("neko_handler_allocations_total", "heap allocations made by handlers on their lane", &allocation_ledger::entry::count);
+			series("neko_handler_allocated_bytes_total", "bytes allocated by handlers on their lane", &allocation_ledger::entry::bytes);
+			series("neko_handler_over_budget_total", "handler runs over their command's allocation budget", &allocation_ledger::entry::over);
+		});
+	bot->start_timer([rate = std::make_shared<gateway_rate>()](dpp::timer)
+		{
+			bot->log(dpp::ll_info, std::format("gateway: {0:.2f} events/s, rss: {1} MiB", rate->sample(*bot), rss() / (1024 * 1024)));
+			/* the guilds that waited longest for their turn this last minute, to check one guild isn't starving the rest */
+			std::vector<std::pair<dpp::snowflake, queue_latency>> waits = guild_lanes->latency();
+			std::ranges::sort(waits, std::ranges::greater{}, [](const auto& w) { return w.second.percentile(0.99); });
+			for (const auto& [guild, wait] : waits | std::views::take(5))
+				bot->log(dpp::ll_info, std::format("queue: guild {0}, {1} tasks, mean {2:.2f} ms, p99 {3:.2f} ms, max {4:.2f} ms",
+					static_cast<uint64_t>(guild), wait.count, wait.mean(), wait.percentile(0.99), wait.max_ns / 1e6));
+			for (const std::string& lane : rest->report()) bot->log(dpp::ll_info, "rest: " + lane);
+			if (size_t open = polls.size()) bot->log(dpp::ll_info, std::format("polls: {0} open", open));
+			if (size_t streams = voice->playing()) bot->log(dpp::ll_info, std::format("voice: {0} streams, {1:.1f} us cpu per stream-second", streams, voice->cpu_per_stream()));
+			if (voice_recorder::totals_t r = recordings->totals(); r.recording)
+				bot->log(dpp::ll_info, std::format("recording: {0} channels, {1} speakers, {2} MiB written, {3} pages dropped, {4} packets rejected, {5} blocks free, "
+					"{6} files not opened, {7} blocks not written", r.recording, r.speakers, r.bytes / (1024 * 1024), r.dropped, r.rejected, r.free_blocks,
+					r.open_failures, r.write_failures));
+		}, 60);
+	bot->start_timer([](dpp::timer) { board->sample(); }, 5);
+	/* market journals are only held open while their guild trades, the crt has a few thousand FILEs to go around */
+	bot->start_timer([](dpp::timer)
+		{
+			guild_lanes->post_each([before = std::chrono::steady_clock::now() - std::chrono::minutes(5)](size_t lane)
+				{
+					guilds->each(lane, [before](dpp::snowflake, guild_state& state) { state.trades.close_idle(before); });
+				});
+		}, 60);
+	/* only polls voted on since the last redraw are drawn, each on its guild's lane */
+	bot->start_timer([](dpp::timer)
+		{
+			for (std::shared_ptr<poll>& p : polls.changed()) guild_lanes->post(p->message.guild_id, [p] { poll_update(p); });
+		}, polls.redraw.count());
 	bot->start(dpp::start_type::st_wait);
 }
\ No newline at end of file